@@ -0,0 +1,135 @@
+/*
+	Bias.h
+	Header file for an adaptive bias potential, which flattens the distribution of a single
+	walker over the bins so that it crosses the barrier and switches lattices even at low kT.
+	With the BIAS option, the bias is built over the first BIAS steps of each replica: every
+	step deposits height * exp(-B(x) / (kT * (BIAS_FACTOR - 1))) at the walker's position x, as
+	in well-tempered metadynamics, so the deposits shrink as the bias fills the wells. Since
+	each deposit only raises the bias where the walker is, like the Wang-Landau method, the
+	bias converges to -(1 - 1 / BIAS_FACTOR) times the free energy profile.
+
+	The bias is a value at the centre of each bin of the histogram (x_min, x_max, nobins),
+	interpolated linearly between the centres and constant beyond the first and last, so
+	its force is defined everywhere. It is added to the potential in every dynamics step and
+	lattice switch. After the building steps the bias is frozen and those steps discarded,
+	and each following sample is reweighted by exp(B(x) / kT) to recover the free energy
+	difference of the unbiased potential. The histogram records the biased distribution.
+	Positions beyond the first and last centres deposit nothing, as a deposit there would
+	raise the end value, and with it the bias everywhere beyond, without flattening anything.
+
+	The lattice switch already moves the walker between the wells, so the bias only helps at
+	low kT with Monte-Carlo walkers, and can make the error of BAOAB walkers larger, as they
+	follow the force of the bias, which is rough between the bins.
+
+	Reference: "Well-tempered metadynamics: a smoothly converging and tunable free-energy
+	method" by A. Barducci, G. Bussi and M. Parrinello, Phys. Rev. Lett. 100, 020603 (2008).
+*/
+
+#ifndef BIAS_H
+#define BIAS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "Parameters.h"
+
+/* Structure to store the bias potential of a walker, allocated in one block so it can be checkpointed */
+struct bias_potential {
+    double first_centre;  // Position of the centre of the first bin
+    double inv_width;     // One over the width of a bin
+    long nobins;          // Number of bins, and of values of the bias
+    double height;        // Deposit at zero bias
+    double tempering;     // Bias over which the deposits fall by a factor of e, kT * (BIAS_FACTOR - 1)
+    int adapting;         // Indicates that the bias is still being built
+    double reference;     // Largest value of the frozen bias, subtracted so that the weights do not overflow
+    double weight_left;   // Sum of the weights of the samples in the left well once the bias is frozen
+    double weight_total;  // Sum of the weights of every sample once the bias is frozen
+    double values[];      // Bias at the centre of each bin
+};
+
+typedef struct bias_potential bias_potential;
+
+
+// Returns the size in bytes of a bias over nobins bins
+static inline size_t bias_size(long nobins) {
+    return sizeof(bias_potential) + sizeof(double) * nobins;
+}
+
+// Allocates a zero bias over the bins given in the parameters
+bias_potential *new_bias(parameters *params) {
+    bias_potential *b = calloc(1, bias_size(params->nobins));
+    if (b == NULL) {
+        printf("Failed to allocate bias of %ld bins\n", params->nobins);
+        exit(1);
+    }
+    b->first_centre = params->x_min + 0.5 * params->bin_width;
+    b->inv_width = 1 / params->bin_width;
+    b->nobins = params->nobins;
+    b->height = params->bias_height * params->kT;
+    b->tempering = (params->bias_factor - 1) * params->kT;
+    b->adapting = 1;
+    return b;
+}
+
+/*
+    Returns the bias at x, and adds its force to force. Stores in node the index of the value on the
+    left of x and in frac how far x is towards the next one, for deposits.
+*/
+static inline double bias_at(bias_potential *b, double x, double *force, long *node, double *frac) {
+    double t = (x - b->first_centre) * b->inv_width; // Position in units of bins from the first centre
+    if (!(t > 0)) {
+        *node = 0;
+        *frac = 0;
+        return b->values[0];
+    }
+    if (t >= b->nobins - 1) {
+        *node = b->nobins - 1;
+        *frac = 0;
+        return b->values[b->nobins - 1];
+    }
+    long j = (long) t;
+    double f = t - j;
+    *force -= (b->values[j + 1] - b->values[j]) * b->inv_width;
+    *node = j;
+    *frac = f;
+    return (1 - f) * b->values[j] + f * b->values[j + 1];
+}
+
+// Returns the bias at x, and adds its force to force
+static inline double bias_energy_force(bias_potential *b, double x, double *force) {
+    long node;
+    double frac;
+    return bias_at(b, x, force, &node, &frac);
+}
+
+// Deposits bias at x, shared between the neighbouring centres as in the interpolation
+static inline void bias_deposit(bias_potential *b, double x) {
+    double t = (x - b->first_centre) * b->inv_width; // Position in units of bins from the first centre
+    if (!(t >= 0 && t <= b->nobins - 1)) return; // Beyond the centres the bias is held at the end values
+    double force = 0; // Unused
+    long node;
+    double frac;
+    double deposit = b->height * exp(-bias_at(b, x, &force, &node, &frac) / b->tempering);
+    b->values[node] += (1 - frac) * deposit;
+    if (frac > 0) b->values[node + 1] += frac * deposit;
+}
+
+// Freezes the bias, so that the following samples are reweighted
+void freeze_bias(bias_potential *b) {
+    b->adapting = 0;
+    b->reference = b->values[0];
+    for (long j = 1; j < b->nobins; j++) {
+        if (b->values[j] > b->reference) b->reference = b->values[j];
+    }
+    b->weight_left = 0;
+    b->weight_total = 0;
+}
+
+// Adds a sample with the given bias to the reweighted samples of the frozen bias
+static inline void bias_sample(bias_potential *b, double bias_energy, int well, double kT) {
+    double weight = exp((bias_energy - b->reference) / kT);
+    b->weight_total += weight;
+    if (well == 0) b->weight_left += weight;
+}
+
+#endif // BIAS_H
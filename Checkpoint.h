@@ -0,0 +1,249 @@
+/*
+	Checkpoint.h
+	Header file for saving and restoring the complete state of a replica: its walker or
+	ensemble, including the random number stream, its progress and its histogram. Each
+	replica has its own checkpoint file, written to a temporary file which is then renamed
+	over the previous checkpoint, so a run killed at any point leaves a consistent file. A
+	replica resumed from a checkpoint continues exactly as if it had not been interrupted.
+
+	Checkpoints are enabled with the CHECKPOINT option, giving the number of steps between
+	them, and a killed run is resumed by running it again with RESTART after the seed.
+*/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "Parameters.h"
+#include "Walker.h"
+#include "Ensemble.h"
+#include "Histogram.h"
+
+#define CHECKPOINT_MAGIC "LSW1DCK2" // Identifies checkpoint files and their format version
+
+/* Structure identifying the replica a checkpoint belongs to, which must match to resume from it */
+struct checkpoint_header {
+    char magic[8];
+    uint64_t seed;            // Seed of the simulation
+    uint64_t stream;          // Random stream of the replica
+    char dynamics_type[256];
+    char potential_name[256];
+    long tot_steps;
+    long nowalkers;
+    long nobins;              // Number of bins, or 0 if bins are not saved
+    double kT;
+    double timestep;
+    double jump_size;
+    double friction_param;
+    double tolerance;
+    long adapt_steps;
+    double target_acceptance;
+    int gaussian_proposal;
+    int tries;
+    int estimators;
+    long bias_steps;
+    double bias_height;
+    double bias_factor;
+    int switch_regularity;
+    int start_well;
+    double mass;
+    double x_min;
+    double x_max;
+    long block_steps;
+    uint64_t potential_hash;  // Hash of the table of the TABULATED potential, or the formula and minima of EXPRESSION
+    long struct_sizes[3];     // Sizes of the walker, progress and random stream structures
+};
+
+typedef struct checkpoint_header checkpoint_header;
+
+/* Structure to store where and how often a replica is checkpointed */
+struct checkpoint {
+    char filename[1100];       // Checkpoint file of the replica
+    long steps;                // Number of steps between checkpoints
+    checkpoint_header header;  // Header identifying the replica
+};
+
+typedef struct checkpoint checkpoint;
+
+
+// Continues the 64-bit FNV-1a hash of a sequence of bytes with size more bytes of data
+static uint64_t checkpoint_hash(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < size; i++) hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    return hash;
+}
+
+// Returns the hash of what defines a potential loaded at run time, or 0 for the potentials built in
+static uint64_t potential_hash(parameters *params) {
+    uint64_t hash = 14695981039346656037ULL;
+    if (strcmp(params->potential_name, "TABULATED") == 0) {
+        const tabulated_potential *tab = &TABULATED_TABLE;
+        hash = checkpoint_hash(hash, &tab->x_min, sizeof(double));
+        hash = checkpoint_hash(hash, &tab->inv_width, sizeof(double));
+        hash = checkpoint_hash(hash, tab->coeffs, sizeof(double[4]) * tab->nointervals);
+        hash = checkpoint_hash(hash, &tab->wall_stiffness, sizeof(double));
+    } else if (strcmp(params->potential_name, "EXPRESSION") == 0) {
+        hash = checkpoint_hash(hash, EXPRESSION_PROGRAM.text, strlen(EXPRESSION_PROGRAM.text));
+        hash = checkpoint_hash(hash, EXPRESSION_MINIMA, sizeof(double) * EXPRESSION_NOMINIMA);
+    } else {
+        return 0;
+    }
+    return hash;
+}
+
+// Fills the header for a replica
+void init_checkpoint_header(checkpoint_header *header, uint64_t seed, uint64_t stream, histogram *bins, \
+        parameters *params) {
+    memset(header, 0, sizeof(checkpoint_header)); // So that padding compares equal
+    memcpy(header->magic, CHECKPOINT_MAGIC, 8);
+    header->seed = seed;
+    header->stream = stream;
+    strcpy(header->dynamics_type, params->dynamics_type);
+    strcpy(header->potential_name, params->potential_name);
+    header->tot_steps = params->tot_steps;
+    header->nowalkers = params->nowalkers;
+    header->nobins = (bins != NULL) ? bins->nobins : 0;
+    header->kT = params->kT;
+    header->timestep = params->timestep;
+    header->jump_size = params->jump_size;
+    header->friction_param = params->friction_param;
+    header->tolerance = params->tolerance;
+    header->adapt_steps = params->adapt_steps;
+    header->target_acceptance = params->target_acceptance;
+    header->gaussian_proposal = params->gaussian_proposal;
+    header->tries = params->tries;
+    header->estimators = params->estimators;
+    header->bias_steps = params->bias_steps;
+    header->bias_height = params->bias_height;
+    header->bias_factor = params->bias_factor;
+    header->switch_regularity = params->switch_regularity;
+    header->start_well = params->start_well;
+    header->mass = params->mass;
+    header->x_min = params->x_min;
+    header->x_max = params->x_max;
+    header->block_steps = params->block_steps;
+    header->potential_hash = potential_hash(params);
+    header->struct_sizes[0] = sizeof(walker);
+    header->struct_sizes[1] = sizeof(replica_progress);
+    header->struct_sizes[2] = sizeof(rng_stream);
+}
+
+// Sets up the checkpoint of a task, stored next to the datastore as <datastore>.ckpt.<task>
+void init_checkpoint(checkpoint *c, char *datastore_filename, long task, uint64_t seed, uint64_t stream, \
+        histogram *bins, parameters *params) {
+    snprintf(c->filename, sizeof(c->filename), "%s.ckpt.%ld", datastore_filename, task);
+    c->steps = params->checkpoint_steps;
+    init_checkpoint_header(&c->header, seed, stream, bins, params);
+}
+
+static void write_block(FILE *file, const void *data, size_t size, char *filename) {
+    if (size > 0 && fwrite(data, size, 1, file) != 1) {
+        printf("Failed to write checkpoint %s\n", filename);
+        exit(1);
+    }
+}
+
+static int read_block(FILE *file, void *data, size_t size) {
+    return size == 0 || fread(data, size, 1, file) == 1;
+}
+
+// Atomically replaces the checkpoint of a replica, which is either the walker w or the ensemble e (if not NULL)
+void write_checkpoint(char *filename, checkpoint_header *header, replica_progress *progress, walker *w, \
+        ensemble *e, histogram *bins) {
+    char tmp_filename[1100]; // Temporary file, renamed once completely written
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", filename);
+    FILE *file = fopen(tmp_filename, "wb");
+    if (file == NULL) {
+        printf("Failed to open checkpoint %s\n", tmp_filename);
+        exit(1);
+    }
+
+    write_block(file, header, sizeof(checkpoint_header), filename);
+    write_block(file, progress, sizeof(replica_progress), filename);
+    if (e != NULL) {
+        long n = e->nowalkers;
+        write_block(file, &e->rng, sizeof(rng_stream), filename);
+        write_block(file, &e->count, sizeof(counters), filename);
+        write_block(file, &e->prop, sizeof(proposal_state), filename);
+        write_block(file, e->x, sizeof(double) * n, filename);
+        write_block(file, e->p, sizeof(double) * n, filename);
+        write_block(file, e->R0, sizeof(double) * n, filename);
+        write_block(file, e->R1, sizeof(double) * n, filename);
+        write_block(file, e->cur_well, sizeof(long) * n, filename);
+        write_block(file, e->no_left, sizeof(long) * n, filename);
+    } else {
+        write_block(file, w, sizeof(walker), filename);
+    }
+    switch_record *switches = (e != NULL) ? e->switches : w->switches;
+    if (switches != NULL) write_block(file, switches, sizeof(switch_record), filename);
+    if (w != NULL && w->bias != NULL) write_block(file, w->bias, bias_size(w->bias->nobins), filename);
+    if (bins != NULL) write_block(file, bins->counts, sizeof(long) * (bins->nobins + 2), filename);
+
+    // Makes sure the data is on disk before it replaces the previous checkpoint
+    if (fflush(file) != 0 || fsync(fileno(file)) != 0) {
+        printf("Failed to write checkpoint %s\n", filename);
+        exit(1);
+    }
+    fclose(file);
+    if (rename(tmp_filename, filename) != 0) {
+        printf("Failed to replace checkpoint %s\n", filename);
+        exit(1);
+    }
+}
+
+/*
+    Restores a replica from its checkpoint, returning 0 if there is no checkpoint. A checkpoint
+    belonging to a different run, or from a different build of the code, is an error.
+*/
+int read_checkpoint(char *filename, checkpoint_header *header, replica_progress *progress, walker *w, \
+        ensemble *e, histogram *bins) {
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) return 0;
+
+    checkpoint_header file_header;
+    int ok = read_block(file, &file_header, sizeof(checkpoint_header));
+    if (!ok || memcmp(&file_header, header, sizeof(checkpoint_header)) != 0) {
+        printf("Checkpoint %s does not match this run\n", filename);
+        exit(1);
+    }
+
+    ok = read_block(file, progress, sizeof(replica_progress));
+    if (e != NULL) {
+        long n = e->nowalkers;
+        ok = ok && read_block(file, &e->rng, sizeof(rng_stream));
+        ok = ok && read_block(file, &e->count, sizeof(counters));
+        ok = ok && read_block(file, &e->prop, sizeof(proposal_state));
+        ok = ok && read_block(file, e->x, sizeof(double) * n);
+        ok = ok && read_block(file, e->p, sizeof(double) * n);
+        ok = ok && read_block(file, e->R0, sizeof(double) * n);
+        ok = ok && read_block(file, e->R1, sizeof(double) * n);
+        ok = ok && read_block(file, e->cur_well, sizeof(long) * n);
+        ok = ok && read_block(file, e->no_left, sizeof(long) * n);
+    } else {
+        // The stored pointers belong to the previous run
+        switch_record *kept_switches = w->switches;
+        stream_tap *kept_tap = w->tap;
+        bias_potential *kept_bias = w->bias;
+        ok = ok && read_block(file, w, sizeof(walker));
+        w->switches = kept_switches;
+        w->tap = kept_tap;
+        w->bias = kept_bias;
+    }
+    switch_record *switches = (e != NULL) ? e->switches : w->switches;
+    if (switches != NULL) ok = ok && read_block(file, switches, sizeof(switch_record));
+    if (w != NULL && w->bias != NULL) ok = ok && read_block(file, w->bias, bias_size(w->bias->nobins));
+    if (bins != NULL) ok = ok && read_block(file, bins->counts, sizeof(long) * (bins->nobins + 2));
+    fclose(file);
+
+    if (!ok) {
+        printf("Checkpoint %s is incomplete\n", filename);
+        exit(1);
+    }
+    return 1;
+}
+
+#endif // CHECKPOINT_H
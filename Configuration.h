@@ -0,0 +1,438 @@
+/*
+	Configuration.h
+	Header file for the lattice switch procedure on a walker made of many particles in D
+	dimensions. The coordinates are stored as a structure of arrays, coordinate d of
+	particle i being pos[d * noparticles + i], so every kernel is a loop over contiguous
+	arrays which the compiler can vectorise, and each dimension stays contiguous however
+	many dimensions there are. The force on every coordinate, and the potential of every
+	particle, come from a single call to the gradient of the potential.
+
+	The potential of a configuration is the sum over the particles of the 1-D potential of
+	the first coordinate, plus a harmonic confinement of stiffness TRANSVERSE_STIFFNESS along
+	every other dimension. Each particle is in the well of its first coordinate, and the
+	minimum of each well is a D-dimensional vector. The particles do not interact, so at a
+	lattice switch each particle is moved to the same displacement from the minimum of its
+	other well, and accepted or not on the change in its own shifted potential. Monte-Carlo
+	moves are accepted particle by particle in the same way. Switching
+	them together instead would make the whole configuration change wells at once, so that
+	the fraction of particle steps in the left well measured N times the difference. The
+	free energy difference per particle follows from that fraction, and equals the 1-D
+	result, since the extra dimensions are the same in both wells.
+*/
+
+#ifndef CONFIGURATION_H
+#define CONFIGURATION_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "Parameters.h"
+#include "Random.h"
+#include "Histogram.h"
+#include "Counters.h"
+
+#define TRANSVERSE_STIFFNESS 5.0 // Stiffness of the harmonic confinement along every dimension after the first
+
+/* Structure to store the state of a walker made of many particles */
+struct configuration {
+    int dim;             // Number of dimensions of each particle
+    long noparticles;    // Number of particles
+    long nocoords;       // Number of coordinates, dim * noparticles
+    double *pos;         // Coordinates, pos[d * noparticles + i] being coordinate d of particle i
+    double *force;       // Force on every coordinate, in the same layout
+    double *energies;    // Potential of each particle, from its first coordinate
+    double *p;           // Momenta, used in the regular BAOAB method
+    double *R0;          // Current normally distributed numbers, used in the BAOAB limit method
+    double *R1;          // Next normally distributed numbers, used in the BAOAB limit method
+    double *trial;       // Trial coordinates of Monte-Carlo moves and lattice switches
+    double *trial_force; // Force at the trial coordinates
+    double *trial_energies; // Potential of each particle at the trial coordinates
+    double *noise;       // Random numbers for the current step, one for each coordinate and particle
+    long *cur_well;      // Which well each particle is in (0 is left well, 1 is right well)
+    double *lattice[2];  // D-dimensional minima of the left and right wells
+    double energy;       // Potential of the configuration
+    long no_left;        // Number of particle timesteps spent in the left well
+    rng_stream rng;      // Random number stream of this walker
+    counters count;      // Counters of events in the step loop (see Counters.h)
+};
+
+typedef struct configuration configuration;
+
+/*
+    Typedef for a function pointer to the potential of a configuration, returning it and storing the force on
+    every coordinate and the potential of the first coordinate of each particle
+*/
+typedef double (*GradientFun)(const double*, double*, double*, long, int);
+
+// Typedef for a function pointer to a dynamics step of a configuration
+typedef void (*ConfigurationDynamicsFun)(configuration*, parameters*, GradientFun);
+
+// Typedef for a function pointer to an instantiated simulation of a configuration
+typedef void (*ConfigurationFun)(histogram*, histogram_2d*, configuration*, parameters*, long, long);
+
+
+// Allocates an array of n doubles
+static double *configuration_array(long n) {
+    double *arr = malloc(sizeof(double) * n);
+    if (arr == NULL) {
+        printf("Failed to allocate configuration of %ld coordinates\n", n);
+        exit(1);
+    }
+    return arr;
+}
+
+// Places every particle at the minimum of the starting well, with a random stream determined by the seed and stream number
+void init_configuration(configuration *c, uint64_t seed, uint64_t stream, parameters *params) {
+    long n = params->noparticles;
+    c->dim = params->dim;
+    c->noparticles = n;
+    c->nocoords = params->dim * n;
+    c->pos = configuration_array(c->nocoords);
+    c->force = configuration_array(c->nocoords);
+    c->energies = configuration_array(n);
+    c->p = configuration_array(c->nocoords);
+    c->R0 = configuration_array(c->nocoords);
+    c->R1 = configuration_array(c->nocoords);
+    c->trial = configuration_array(c->nocoords);
+    c->trial_force = configuration_array(c->nocoords);
+    c->trial_energies = configuration_array(n);
+    c->noise = configuration_array(c->nocoords + n);
+    c->lattice[0] = configuration_array(c->dim);
+    c->lattice[1] = configuration_array(c->dim);
+    c->cur_well = malloc(sizeof(long) * n);
+    if (c->cur_well == NULL) {
+        printf("Failed to allocate configuration of %ld particles\n", n);
+        exit(1);
+    }
+
+    rng_init(&c->rng, seed, stream, 0);
+    init_counters(&c->count);
+    for (int well = 0; well < 2; well++) {
+        c->lattice[well][0] = params->minima[well];
+        for (int d = 1; d < c->dim; d++) c->lattice[well][d] = 0;
+    }
+    for (int d = 0; d < c->dim; d++) {
+        for (long i = 0; i < n; i++) c->pos[d * n + i] = c->lattice[params->start_well][d];
+    }
+    for (long i = 0; i < n; i++) c->cur_well[i] = params->start_well;
+    c->no_left = 0;
+
+    for (long k = 0; k < c->nocoords; k++) {
+        c->p[k] = 0;
+        c->R0[k] = 0;
+        c->R1[k] = 0;
+    }
+    if (strcmp(params->dynamics_type, "BAOAB_LIMIT") == 0) {
+        rng_fill_normal(&c->rng, c->R0, c->nocoords);
+        rng_fill_normal(&c->rng, c->R1, c->nocoords);
+    } else if (strcmp(params->dynamics_type, "BAOAB_REGULAR") == 0) {
+        // Draws the momenta from the Maxwell-Boltzmann distribution
+        rng_fill_normal(&c->rng, c->p, c->nocoords);
+        for (long k = 0; k < c->nocoords; k++) c->p[k] *= sqrt(params->mass * params->kT);
+    }
+}
+
+void free_configuration(configuration *c) {
+    free(c->pos);
+    free(c->force);
+    free(c->energies);
+    free(c->p);
+    free(c->R0);
+    free(c->R1);
+    free(c->trial);
+    free(c->trial_force);
+    free(c->trial_energies);
+    free(c->noise);
+    free(c->lattice[0]);
+    free(c->lattice[1]);
+    free(c->cur_well);
+}
+
+// Swaps two arrays of a configuration
+static inline void swap_arrays(double **a, double **b) {
+    double *tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+
+// Returns the harmonic potential of the coordinates after the first, storing their forces
+static inline double configuration_transverse(const double *pos, double *force, long n, int dim) {
+    double energy = 0;
+    for (int d = 1; d < dim; d++) {
+        const double *q = pos + d * n;
+        double *f = force + d * n;
+#pragma omp simd reduction(+:energy)
+        for (long i = 0; i < n; i++) {
+            energy += 0.5 * TRANSVERSE_STIFFNESS * q[i] * q[i];
+            f[i] = -TRANSVERSE_STIFFNESS * q[i];
+        }
+    }
+    return energy;
+}
+
+/*
+    Generic potential, taking the 1-D kernel of the potential as an argument, and always inlined into
+    the gradient of each potential below
+*/
+static inline __attribute__((always_inline)) double configuration_gradient(const double *pos, double *force, \
+        double *energies, long n, int dim, EnergyForceFun energy_and_force) {
+    double energy = 0;
+#pragma omp simd reduction(+:energy)
+    for (long i = 0; i < n; i++) {
+        energies[i] = energy_and_force(pos[i], &force[i]);
+        energy += energies[i];
+    }
+    return energy + configuration_transverse(pos, force, n, dim);
+}
+
+/* Dynamics steps, as in Dynamics.h, on every coordinate at once */
+
+// High friction limit of BAOAB method
+static inline __attribute__((always_inline)) void configuration_BAOAB_limit(configuration *c, parameters *params, \
+        GradientFun gradient) {
+    long m = c->nocoords;
+    double *pos = c->pos, *force = c->force, *R0 = c->R0, *R1 = c->R1;
+    double drift = params->drift_const, noise = params->noise_const;
+#pragma omp simd
+    for (long k = 0; k < m; k++) pos[k] += drift * force[k] + noise * (R0[k] + R1[k]);
+    c->energy = gradient(c->pos, c->force, c->energies, c->noparticles, c->dim);
+
+    swap_arrays(&c->R0, &c->R1); // Current values of R become the next ones
+    rng_fill_normal(&c->rng, c->R1, m); // Next values for R are drawn from a normal distribution
+}
+
+// Regular BAOAB method, with the coefficients precomputed in the parameters
+static inline __attribute__((always_inline)) void configuration_BAOAB_regular(configuration *c, parameters *params, \
+        GradientFun gradient) {
+    long m = c->nocoords;
+    double *pos = c->pos, *force = c->force, *p = c->p, *R = c->noise;
+    double h = params->half_timestep, a = params->half_drift, decay = params->ou_decay, ou = params->ou_noise;
+    rng_fill_normal(&c->rng, R, m);
+#pragma omp simd
+    for (long k = 0; k < m; k++) {
+        p[k] += h * force[k]; // B, using the force already known
+        pos[k] += a * p[k]; // A
+        p[k] = decay * p[k] + ou * R[k]; // O
+        pos[k] += a * p[k]; // A
+    }
+    c->energy = gradient(c->pos, c->force, c->energies, c->noparticles, c->dim);
+    force = c->force;
+#pragma omp simd
+    for (long k = 0; k < m; k++) p[k] += h * force[k]; // B
+}
+
+/*
+    Monte-Carlo move of every particle, each coordinate displaced uniformly by up to the jump size. The
+    particles do not interact, so each move is accepted or not on the change in its own potential, as at a
+    lattice switch, and the acceptance does not fall with the number of particles.
+*/
+static inline __attribute__((always_inline)) void configuration_Monte_Carlo(configuration *c, parameters *params, \
+        GradientFun gradient) {
+    long n = c->noparticles, m = c->nocoords;
+    int dim = c->dim;
+    double *pos = c->pos, *trial = c->trial, *U = c->noise, *T = c->noise + m;
+    double j = params->jump_size;
+    rng_fill_uniform(&c->rng, U, m + n);
+#pragma omp simd
+    for (long k = 0; k < m; k++) trial[k] = pos[k] + (2 * U[k] - 1) * j;
+    gradient(trial, c->trial_force, c->trial_energies, n, dim);
+
+    double *energies = c->energies, *trial_energies = c->trial_energies, *force = c->force;
+    const double *trial_force = c->trial_force;
+    double energy_change = 0;
+    long accepts = 0;
+    for (long i = 0; i < n; i++) {
+        double diff_poten = trial_energies[i] - energies[i];
+        for (int d = 1; d < dim; d++) {
+            double q = pos[d * n + i], t = trial[d * n + i];
+            diff_poten += 0.5 * TRANSVERSE_STIFFNESS * (t * t - q * q);
+        }
+        if (diff_poten < -params->kT * log(T[i])) {
+            energy_change += diff_poten;
+            for (int d = 0; d < dim; d++) {
+                pos[d * n + i] = trial[d * n + i];
+                force[d * n + i] = trial_force[d * n + i];
+            }
+            energies[i] = trial_energies[i];
+            accepts++;
+        }
+    }
+    c->energy += energy_change;
+    COUNTER_ADD(c->count, mc_attempts, n);
+    COUNTER_ADD(c->count, mc_accepts, accepts);
+}
+
+// Attempts a lattice switch of each particle to the same displacement from the minimum of its other well
+static inline __attribute__((always_inline)) void configuration_lattice_switch(configuration *c, parameters *params, \
+        GradientFun gradient) {
+    long n = c->noparticles;
+    int dim = c->dim;
+    long *cur_well = c->cur_well;
+    double *pos = c->pos, *trial = c->trial, *U = c->noise;
+    for (int d = 0; d < dim; d++) {
+        const double *q = pos + d * n;
+        double *t = trial + d * n;
+        double to_right = c->lattice[1][d] - c->lattice[0][d]; // Translation from the left to the right well
+#pragma omp simd
+        for (long i = 0; i < n; i++) t[i] = q[i] + ((cur_well[i] == 0) ? to_right : -to_right);
+    }
+    gradient(trial, c->trial_force, c->trial_energies, n, dim);
+    rng_fill_uniform(&c->rng, U, n);
+
+    // Each particle is accepted on the change in its own shifted potential, its transverse part included
+    double *energies = c->energies, *trial_energies = c->trial_energies, *force = c->force;
+    const double *trial_force = c->trial_force;
+    double shift = params->shift_value, energy_change = 0;
+    long accepts = 0;
+    for (long i = 0; i < n; i++) {
+        double diff_poten = trial_energies[i] - energies[i] + ((trial[i] > 0) - (pos[i] > 0)) * shift;
+        for (int d = 1; d < dim; d++) {
+            double q = pos[d * n + i], t = trial[d * n + i];
+            diff_poten += 0.5 * TRANSVERSE_STIFFNESS * (t * t - q * q);
+        }
+        if (diff_poten < -params->kT * log(U[i])) {
+            energy_change += diff_poten - ((trial[i] > 0) - (pos[i] > 0)) * shift;
+            for (int d = 0; d < dim; d++) {
+                pos[d * n + i] = trial[d * n + i];
+                force[d * n + i] = trial_force[d * n + i];
+            }
+            energies[i] = trial_energies[i];
+            cur_well[i] = 1 - cur_well[i];
+            accepts++;
+        }
+    }
+    c->energy += energy_change;
+    COUNTER_ADD(c->count, switch_attempts, n);
+    COUNTER_ADD(c->count, switch_accepts, accepts);
+}
+
+
+/*
+    Performs the lattice switching method on a configuration for steps first_step to end_step - 1, as in
+    simulate (see Simulation.h). The first coordinate of every particle is added to bins and the first two
+    to bins_2d, unless they are NULL.
+*/
+static inline __attribute__((always_inline)) void simulate_configuration(histogram *bins, histogram_2d *bins_2d, \
+        configuration *c, parameters *params, long first_step, long end_step, ConfigurationDynamicsFun dynamics, \
+        GradientFun gradient) {
+    long n = c->noparticles;
+    c->energy = gradient(c->pos, c->force, c->energies, n, c->dim);
+
+    for (long stepno = first_step; stepno < end_step; stepno++) {
+        int timed = timed_step(stepno); // Whether the phases of this step are timed
+        double phase_start = timed ? counter_time() : 0;
+
+        if (bins != NULL) histogram_add_array(bins, c->pos, n);
+        if (bins_2d != NULL) histogram_2d_add_array(bins_2d, c->pos, c->pos + n, n);
+        if (bins != NULL || bins_2d != NULL) end_phase(timed, &phase_start, &c->count.bins_seconds);
+
+        // Counts the particles in the left well and the non-finite coordinates
+        long *cur_well = c->cur_well;
+        const double *pos = c->pos;
+        long left = 0, nonfinite = 0;
+#pragma omp simd reduction(+:left)
+        for (long i = 0; i < n; i++) left += (cur_well[i] == 0);
+#pragma omp simd reduction(+:nonfinite)
+        for (long k = 0; k < c->nocoords; k++) nonfinite += !isfinite(pos[k]);
+        c->no_left += left;
+        if (nonfinite > 0) {
+            printf("Infinite x value reached\n");
+            COUNTER_ADD(c->count, nonfinite, nonfinite);
+        }
+
+        // Perform dynamics step
+        dynamics(c, params, gradient);
+
+        // Recalibrate the wells of the particles which have crossed over the barrier
+        pos = c->pos;
+        long crossings = 0;
+#pragma omp simd reduction(+:crossings)
+        for (long i = 0; i < n; i++) {
+            long well = (pos[i] > 0) ? 1 : ((pos[i] < 0) ? 0 : cur_well[i]);
+            crossings += (well != cur_well[i]);
+            cur_well[i] = well;
+        }
+        COUNTER_ADD(c->count, crossings, crossings);
+        end_phase(timed, &phase_start, &c->count.dynamics_seconds);
+
+        // Attempts a lattice switch
+        if (stepno % params->switch_regularity == 0) {
+            configuration_lattice_switch(c, params, gradient);
+            end_phase(timed, &phase_start, &c->count.switch_seconds);
+        }
+    }
+}
+
+
+/* Instances for every potential and dynamics */
+
+#define CONFIGURATION_POTENTIAL(POTEN) \
+    double POTEN##_gradient(const double *pos, double *force, double *energies, long n, int dim) { \
+        return configuration_gradient(pos, force, energies, n, dim, &POTEN##_energy_and_force); \
+    }
+
+CONFIGURATION_POTENTIAL(KT)
+CONFIGURATION_POTENTIAL(QUARTIC)
+CONFIGURATION_POTENTIAL(DIFF_WIDTH)
+CONFIGURATION_POTENTIAL(TABULATED)
+
+// The formula of the EXPRESSION potential is evaluated for every particle in one call (see Expression.h)
+double EXPRESSION_gradient(const double *pos, double *force, double *energies, long n, int dim) {
+    double energy = 0;
+    for (long start = 0; start < n; start += EXPRESSION_BLOCK) {
+        int width = (n - start < EXPRESSION_BLOCK) ? (int) (n - start) : EXPRESSION_BLOCK;
+        expression_block(&EXPRESSION_PROGRAM, &pos[start], &energies[start], &force[start], width);
+        for (int i = 0; i < width; i++) energy += energies[start + i];
+    }
+    return energy + configuration_transverse(pos, force, n, dim);
+}
+
+#define CONFIGURATION_SIMULATION(DYNAMICS, POTEN) \
+    void DYNAMICS##_##POTEN##_simulate(histogram *bins, histogram_2d *bins_2d, configuration *c, \
+            parameters *params, long first_step, long end_step) { \
+        simulate_configuration(bins, bins_2d, c, params, first_step, end_step, &DYNAMICS, &POTEN##_gradient); \
+    }
+
+CONFIGURATION_SIMULATION(configuration_BAOAB_limit, KT)
+CONFIGURATION_SIMULATION(configuration_BAOAB_limit, QUARTIC)
+CONFIGURATION_SIMULATION(configuration_BAOAB_limit, DIFF_WIDTH)
+CONFIGURATION_SIMULATION(configuration_BAOAB_regular, KT)
+CONFIGURATION_SIMULATION(configuration_BAOAB_regular, QUARTIC)
+CONFIGURATION_SIMULATION(configuration_BAOAB_regular, DIFF_WIDTH)
+CONFIGURATION_SIMULATION(configuration_Monte_Carlo, KT)
+CONFIGURATION_SIMULATION(configuration_Monte_Carlo, QUARTIC)
+CONFIGURATION_SIMULATION(configuration_Monte_Carlo, DIFF_WIDTH)
+CONFIGURATION_SIMULATION(configuration_BAOAB_limit, TABULATED)
+CONFIGURATION_SIMULATION(configuration_BAOAB_regular, TABULATED)
+CONFIGURATION_SIMULATION(configuration_Monte_Carlo, TABULATED)
+CONFIGURATION_SIMULATION(configuration_BAOAB_limit, EXPRESSION)
+CONFIGURATION_SIMULATION(configuration_BAOAB_regular, EXPRESSION)
+CONFIGURATION_SIMULATION(configuration_Monte_Carlo, EXPRESSION)
+
+// Returns the simulation of a configuration instantiated for the chosen dynamics and potential
+ConfigurationFun Configuration_selector(char dynamics_type[], char potential_name[]) {
+    ConfigurationFun sim_fun = NULL; // Simulation for the chosen dynamics and potential
+    int baoab = (strcmp(dynamics_type, "BAOAB_LIMIT") == 0);
+    int regular = (strcmp(dynamics_type, "BAOAB_REGULAR") == 0); // Otherwise Monte-Carlo
+    if (strcmp(potential_name, "KT") == 0) {
+        sim_fun = baoab ? &configuration_BAOAB_limit_KT_simulate : (regular ? \
+                  &configuration_BAOAB_regular_KT_simulate : &configuration_Monte_Carlo_KT_simulate);
+    } else if (strcmp(potential_name, "QUARTIC") == 0) {
+        sim_fun = baoab ? &configuration_BAOAB_limit_QUARTIC_simulate : (regular ? \
+                  &configuration_BAOAB_regular_QUARTIC_simulate : &configuration_Monte_Carlo_QUARTIC_simulate);
+    } else if (strcmp(potential_name, "DIFF_WIDTH") == 0) {
+        sim_fun = baoab ? &configuration_BAOAB_limit_DIFF_WIDTH_simulate : (regular ? \
+                  &configuration_BAOAB_regular_DIFF_WIDTH_simulate : &configuration_Monte_Carlo_DIFF_WIDTH_simulate);
+    } else if (strcmp(potential_name, "TABULATED") == 0) {
+        sim_fun = baoab ? &configuration_BAOAB_limit_TABULATED_simulate : (regular ? \
+                  &configuration_BAOAB_regular_TABULATED_simulate : &configuration_Monte_Carlo_TABULATED_simulate);
+    } else if (strcmp(potential_name, "EXPRESSION") == 0) {
+        sim_fun = baoab ? &configuration_BAOAB_limit_EXPRESSION_simulate : (regular ? \
+                  &configuration_BAOAB_regular_EXPRESSION_simulate : &configuration_Monte_Carlo_EXPRESSION_simulate);
+    }
+    return sim_fun;
+}
+
+#endif // CONFIGURATION_H
@@ -0,0 +1,104 @@
+/*
+	Convergence.h
+	Header file for estimating the statistical error of the free energy difference while
+	a replica runs, so that it can stop once a requested tolerance is reached. The fraction
+	of samples in the left well is averaged over blocks of equal length. When the maximum
+	number of blocks is reached, neighbouring blocks are merged and the block length doubles,
+	so the blocks eventually become longer than the autocorrelation time of the well
+	indicator, and the spread of the block averages gives its standard error.
+
+	Reference: "Statistical analysis of simulations: data correlations and data
+	reduction" by H. Flyvbjerg, in Advances in Computer Simulation (Springer, 1998).
+*/
+
+#ifndef CONVERGENCE_H
+#define CONVERGENCE_H
+
+#include <math.h>
+#include "Parameters.h"
+
+#define MAX_BLOCKS 64 // Number of blocks at which neighbouring blocks are merged
+#define MIN_BLOCKS 32 // Number of blocks needed before the error estimate is trusted
+#define MIN_BLOCK_TAU 10 // Number of autocorrelation times each block needs before the error estimate is trusted
+
+/* Structure to store the block averages of the well indicator */
+struct block_average {
+    long block_steps;          // Number of steps in each block
+    int noblocks;              // Number of complete blocks
+    double left[MAX_BLOCKS];   // Number of samples in the left well in each block
+    double samples[MAX_BLOCKS]; // Number of samples in each block
+};
+
+typedef struct block_average block_average;
+
+
+void init_block_average(block_average *b, long block_steps) {
+    b->block_steps = block_steps;
+    b->noblocks = 0;
+}
+
+// Adds a complete block, merging neighbouring blocks once the maximum number of blocks is reached
+void block_average_add(block_average *b, double left, double samples) {
+    b->left[b->noblocks] = left;
+    b->samples[b->noblocks] = samples;
+    b->noblocks++;
+    if (b->noblocks == MAX_BLOCKS) {
+        for (int k = 0; k < MAX_BLOCKS / 2; k++) {
+            b->left[k] = b->left[2 * k] + b->left[2 * k + 1];
+            b->samples[k] = b->samples[2 * k] + b->samples[2 * k + 1];
+        }
+        b->noblocks = MAX_BLOCKS / 2;
+        b->block_steps *= 2;
+    }
+}
+
+// Returns the variance between the fractions of samples in the left well of blocks made of every "merge" blocks
+double merged_block_variance(block_average *b, int merge, double p) {
+    int nomerged = b->noblocks / merge; // Number of merged blocks
+    double block_var = 0;
+    for (int k = 0; k < nomerged; k++) {
+        double left = 0, samples = 0;
+        for (int j = k * merge; j < (k + 1) * merge; j++) {
+            left += b->left[j];
+            samples += b->samples[j];
+        }
+        block_var += (left / samples - p) * (left / samples - p);
+    }
+    return block_var / (nomerged - 1);
+}
+
+/*
+    Returns the standard error of the free energy difference, -kT * log(p / (1 - p)) for a fraction
+    p of samples in the left well, and stores the integrated autocorrelation time of the well
+    indicator (in steps) in tau. The error of p is estimated from the blocks and from the blocks
+    merged in pairs, and the larger is used, since the estimate only stops growing once the blocks
+    are longer than the autocorrelation time. Returns INFINITY until there are enough blocks, the
+    blocks are much longer than the autocorrelation time and both wells have been visited.
+*/
+double block_average_error(block_average *b, parameters *params, double *tau) {
+    *tau = 0;
+    if (b->noblocks < MIN_BLOCKS) return INFINITY;
+
+    double tot_left = 0, tot_samples = 0;
+    for (int k = 0; k < b->noblocks; k++) {
+        tot_left += b->left[k];
+        tot_samples += b->samples[k];
+    }
+    double p = tot_left / tot_samples; // Fraction of samples in the left well
+    if (p <= 0 || p >= 1) return INFINITY;
+
+    // Squared standard errors of p from the blocks and from pairs of blocks
+    double p_var = merged_block_variance(b, 1, p) / b->noblocks;
+    double pair_p_var = merged_block_variance(b, 2, p) / (b->noblocks / 2);
+    if (pair_p_var > p_var) p_var = pair_p_var;
+
+    // The variance of p is 2 tau p (1 - p) / samples for independent walkers with correlated steps
+    *tau = 0.5 * tot_samples * p_var / (p * (1 - p));
+
+    if (b->block_steps < MIN_BLOCK_TAU * *tau) return INFINITY;
+
+    // Standard error of p, propagated through the logarithm
+    return params->kT * sqrt(p_var) / (p * (1 - p));
+}
+
+#endif // CONVERGENCE_H
@@ -0,0 +1,95 @@
+/*
+	Counters.h
+	Header file for counters of what happens in the step loop: lattice switch attempts and
+	acceptances, Monte-Carlo acceptances, crossings of the barrier by the dynamics, non-finite
+	positions and the time spent in each phase. They are compiled in only when COUNTERS is 1
+	(e.g. CFLAGS=-DCOUNTERS=1 sh compile.sh), and otherwise every update is removed by the
+	compiler. The counters of every replica are written as JSON to <datastore>.counters.json.
+
+	Timing every step would cost more than the step itself, so the phases are timed on one
+	step in every TIMING_STRIDE and the times are scaled up by TIMING_STRIDE.
+*/
+
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <stdio.h>
+#include <time.h>
+
+#ifndef COUNTERS
+#define COUNTERS 0 // 1 to count events in the step loop
+#endif
+
+#define TIMING_STRIDE 64 // Number of steps per timed step
+
+/* Structure to store the counters of one replica */
+struct counters {
+    long switch_attempts;    // Number of lattice switches attempted
+    long switch_accepts;     // Number of lattice switches accepted
+    long mc_attempts;        // Number of Monte-Carlo moves attempted
+    long mc_accepts;         // Number of Monte-Carlo moves accepted
+    long crossings;          // Number of times the dynamics crossed the barrier
+    long nonfinite;          // Number of steps with a non-finite position
+    double dynamics_seconds; // Time spent in the dynamics step
+    double switch_seconds;   // Time spent in lattice switches
+    double bins_seconds;     // Time spent adding positions to the histogram
+    double io_seconds;       // Time spent writing checkpoints
+};
+
+typedef struct counters counters;
+
+// Adds n to a counter, only if the counters are compiled in
+#define COUNTER_ADD(c, field, n) do { if (COUNTERS) (c).field += (n); } while (0)
+
+
+void init_counters(counters *c) {
+    c->switch_attempts = 0;
+    c->switch_accepts = 0;
+    c->mc_attempts = 0;
+    c->mc_accepts = 0;
+    c->crossings = 0;
+    c->nonfinite = 0;
+    c->dynamics_seconds = 0;
+    c->switch_seconds = 0;
+    c->bins_seconds = 0;
+    c->io_seconds = 0;
+}
+
+// Returns the wall time in seconds from an arbitrary starting point
+static inline double counter_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+// Returns whether a step is timed
+static inline int timed_step(long stepno) {
+    return COUNTERS && (stepno % TIMING_STRIDE == 0);
+}
+
+// Ends a phase of a timed step, adding its scaled time to phase_seconds and starting the next phase
+static inline void end_phase(int timed, double *phase_start, double *phase_seconds) {
+    if (timed) {
+        double now = counter_time();
+        *phase_seconds += TIMING_STRIDE * (now - *phase_start);
+        *phase_start = now;
+    }
+}
+
+// Returns numerator / denominator, or 0 if the denominator is 0
+static inline double counter_rate(long numerator, long denominator) {
+    return (denominator > 0) ? (double) numerator / denominator : 0;
+}
+
+// Writes the counters of a replica as the members of a JSON object
+void fprint_counters_json(FILE *file, counters *c) {
+    fprintf(file, "\"switch_attempts\": %ld, \"switch_accepts\": %ld, \"switch_acceptance\": %.6g, ", \
+            c->switch_attempts, c->switch_accepts, counter_rate(c->switch_accepts, c->switch_attempts));
+    fprintf(file, "\"mc_attempts\": %ld, \"mc_accepts\": %ld, \"mc_acceptance\": %.6g, ", \
+            c->mc_attempts, c->mc_accepts, counter_rate(c->mc_accepts, c->mc_attempts));
+    fprintf(file, "\"crossings\": %ld, \"nonfinite\": %ld, ", c->crossings, c->nonfinite);
+    fprintf(file, "\"seconds\": {\"dynamics\": %.6g, \"switching\": %.6g, \"binning\": %.6g, \"io\": %.6g}", \
+            c->dynamics_seconds, c->switch_seconds, c->bins_seconds, c->io_seconds);
+}
+
+#endif // COUNTERS_H
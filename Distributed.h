@@ -0,0 +1,150 @@
+/*
+	Distributed.h
+	Header file for running the tasks of a sweep over several MPI processes (ranks), when
+	compiled with -DUSE_MPI (Lattice_Switch_1D_mpi in compile.sh) and started with, e.g.,
+	mpirun -np 4 ./Lattice_Switch_1D_mpi input.txt results.csv NOBINS 1
+	Every thread of every rank takes its next task from one counter held by rank 0, which
+	the others increment with one-sided atomic operations, so the queue is dynamic without
+	a dedicated master rank, and works the same on one machine or across nodes. Each task
+	keeps its own random stream, so the results do not depend on the number of ranks. Once
+	the tasks are done, rank 0 gathers the results and histograms of every rank and writes
+	the single combined result table.
+	Without USE_MPI there is a single rank, and the tasks are shared between the threads by
+	the work-stealing scheduler (see Scheduler.h).
+*/
+
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+#include "Scheduler.h"
+#include "Walker.h"
+
+/* Structure to store the ranks and the task counter shared between them */
+struct distributed {
+    int rank;       // Rank of this process, 0 for the one which writes the results
+    int size;       // Number of ranks
+    long notasks;   // Number of tasks shared between the ranks
+#ifdef USE_MPI
+    MPI_Win window; // Window holding the counter of the next task, on rank 0
+    long *counter;
+#endif
+};
+
+typedef struct distributed distributed;
+
+
+// Starts MPI if it is used, before anything else reads the arguments
+void init_distributed(distributed *d, int *argc, char ***argv) {
+    d->rank = 0;
+    d->size = 1;
+    d->notasks = 0;
+#ifdef USE_MPI
+    int provided; // Threads may take tasks one at a time (see distributed_next)
+    MPI_Init_thread(argc, argv, MPI_THREAD_SERIALIZED, &provided);
+    if (provided < MPI_THREAD_SERIALIZED) {
+        printf("MPI does not support threads taking tasks in turn\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    MPI_Comm_rank(MPI_COMM_WORLD, &d->rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &d->size);
+#else
+    (void) argc;
+    (void) argv;
+#endif
+}
+
+// Creates the counter of notasks tasks shared between the ranks, called by every rank
+void open_task_counter(distributed *d, long notasks) {
+    d->notasks = notasks;
+#ifdef USE_MPI
+    MPI_Aint counter_size = (d->rank == 0) ? sizeof(long) : 0;
+    MPI_Win_allocate(counter_size, sizeof(long), MPI_INFO_NULL, MPI_COMM_WORLD, &d->counter, &d->window);
+    if (d->rank == 0) *d->counter = 0;
+    MPI_Barrier(MPI_COMM_WORLD); // No rank takes a task before the counter is set
+    MPI_Win_lock_all(0, d->window);
+#endif
+}
+
+void close_task_counter(distributed *d) {
+#ifdef USE_MPI
+    MPI_Win_unlock_all(d->window);
+    MPI_Win_free(&d->window);
+#else
+    (void) d;
+#endif
+}
+
+// Stores the next task for a thread in task, returning 0 once every rank has taken every task
+int distributed_next(distributed *d, scheduler *sched, int thread, long *task) {
+#ifdef USE_MPI
+    (void) sched;
+    (void) thread;
+    long one = 1;
+#pragma omp critical (task_counter)
+    {
+        MPI_Fetch_and_op(&one, task, MPI_LONG, 0, 0, MPI_SUM, d->window);
+        MPI_Win_flush(0, d->window);
+    }
+    return *task < d->notasks;
+#else
+    (void) d;
+    return scheduler_next(sched, thread, task);
+#endif
+}
+
+/*
+    Collects the results of every task on rank 0, from the ranks which ran them. The results must
+    start zeroed, so that the tasks this rank ran are those with a number of steps.
+*/
+void gather_results(distributed *d, replica_result *results, long noresults) {
+#ifdef USE_MPI
+    int *owners = malloc(sizeof(int) * noresults); // Rank which ran each task
+    if (owners == NULL) {
+        printf("Failed to allocate owners of %ld results\n", noresults);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    for (long i = 0; i < noresults; i++) owners[i] = (results[i].steps > 0) ? d->rank : -1;
+    MPI_Allreduce(MPI_IN_PLACE, owners, (int) noresults, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    for (long i = 0; i < noresults; i++) {
+        if (owners[i] <= 0) continue;
+        if (d->rank == 0) {
+            MPI_Recv(&results[i], sizeof(replica_result), MPI_BYTE, owners[i], 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        } else if (d->rank == owners[i]) {
+            MPI_Send(&results[i], sizeof(replica_result), MPI_BYTE, 0, 0, MPI_COMM_WORLD);
+        }
+    }
+    free(owners);
+#else
+    (void) d;
+    (void) results;
+    (void) noresults;
+#endif
+}
+
+// Sums counts over every rank into those of rank 0
+void reduce_counts(distributed *d, long *counts, long nocounts) {
+#ifdef USE_MPI
+    if (d->rank == 0) {
+        MPI_Reduce(MPI_IN_PLACE, counts, (int) nocounts, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    } else {
+        MPI_Reduce(counts, NULL, (int) nocounts, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    }
+#else
+    (void) d;
+    (void) counts;
+    (void) nocounts;
+#endif
+}
+
+void finalize_distributed(void) {
+#ifdef USE_MPI
+    MPI_Finalize();
+#endif
+}
+
+#endif // DISTRIBUTED_H
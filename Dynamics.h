@@ -14,59 +14,152 @@
 #include "Parameters.h"
 #include "Random.h"
 #include "MiscFunctions.h"
-#include "mt19937ar.h"
+#include "Walker.h"
 
 #define PI 3.14159265358979323846264338327
 
-// Typedef for a function pointer
-typedef double (*DynamicsFun)(double, parameters*);
+/*
+	Each step takes the fused energy and force kernel of the potential as an argument, and is
+	always inlined into the simulation instantiated for that potential (see Simulation.h), so
+	the kernel is called directly. The walker's energy and force are kept up to date with x,
+	the force and acceptance including the adaptive bias if the walker has one (see Bias.h).
+*/
+
+// Adds the force of the bias at the walker's position to its force, and stores the bias there
+static inline void apply_bias(walker *w) {
+	if (w->bias != NULL) w->bias_energy = bias_energy_force(w->bias, w->x, &w->force);
+}
+
+// Typedef for a function pointer to a dynamics step
+typedef void (*DynamicsFun)(walker*, parameters*, EnergyForceFun);
 
 // High friction limit of BAOAB method
-double BAOAB_limit(double x, parameters *params){
-    // Set x according to the formula given in Leimkuhler & Matthews
-	x = x - params->timestep * (*params->Poten_deriv)(x) / params->mass +\
-		sqrt(0.5 * params->kT * params->timestep / params->mass) * (params->R[0] + params->R[1]);
-
-	params->R[0] = params->R[1]; // Current value of R becomes the next one
-	params->R[1] = box_muller_rand(); // Next value for R is drawn from a normal distribution
-	return x;
+static inline __attribute__((always_inline)) void BAOAB_limit(walker *w, parameters *params, \
+		EnergyForceFun energy_and_force){
+    // Set x according to the formula given in Leimkuhler & Matthews, rounded as x - timestep * deriv / mass
+	w->x = w->x + params->timestep * w->force / params->mass + params->noise_const * (w->R[0] + w->R[1]);
+	w->energy = energy_and_force(w->x, &w->force);
+	apply_bias(w);
+
+	w->R[0] = w->R[1]; // Current value of R becomes the next one
+	w->R[1] = rng_normal(&w->rng); // Next value for R is drawn from a normal distribution
 }
 
 
-// // Regular BAOAB method
-// void BAOAB_regular(double ret_arr[2], double x, double p, parameters *params, double R[2]){
-// 	double p_half = p - 0.5 * params->timestep * params->Poten_deriv(x);
-// 	double x_half = x + 0.5 * params->timestep * p_half / params->mass;
-// 	double p_half_bar = params->const1 * p_half + params->const3 * sqrt(params->mass) * R[1];
-// 	ret_arr[0] = x_half + 0.5 * params->timestep * p_half_bar / params->mass;
-// 	ret_arr[1] = p_half_bar - 0.5 * params->timestep * params->Poten_deriv(x);
-// }
+// Regular BAOAB method, with the momentum of the walker and the coefficients precomputed in the parameters
+static inline __attribute__((always_inline)) void BAOAB_regular(walker *w, parameters *params, \
+		EnergyForceFun energy_and_force){
+	w->p += params->half_timestep * w->force; // B, using the force already known at x
+	w->x += params->half_drift * w->p; // A
+	w->p = params->ou_decay * w->p + params->ou_noise * rng_normal(&w->rng); // O
+	w->x += params->half_drift * w->p; // A
+	w->energy = energy_and_force(w->x, &w->force);
+	apply_bias(w);
+	w->p += params->half_timestep * w->force; // B
+}
+
 
+// Returns a proposed displacement for a move with width j
+static inline double propose_displacement(walker *w, double j, int gaussian) {
+	return gaussian ? j * rng_normal(&w->rng) : (2 * rng_uniform(&w->rng) - 1) * j;
+}
 
-// Using Monte-Carlo method to determine where the particle jumps to
-double Monte_Carlo_step(double x, parameters *params){
-    // Possible new position, uniformly distributed
-	double new_x = x + (2 * genrand_real1() - 1) * params->jump_size;
+// Moves the walker to new_x, with the potential and force already known there
+static inline void accept_move(walker *w, int well, double new_x, double new_energy, double new_force) {
+	COUNTER_ADD(w->count, mc_accepts, 1);
+	w->prop.accepts[well]++;
+	w->x = new_x;
+	w->energy = new_energy;
+	w->force = new_force;
+}
 
-    // Difference in the potential between the new position and the current position
-	double potential_difference = params->Poten(new_x) - params->Poten(x);
+/*
+	Multiple-try Metropolis move, from "The multiple-try method and local optimization in Metropolis
+	sampling" by J. S. Liu, F. Liang and W. H. Wong, J. Am. Stat. Assoc. 95, 121 (2000), with the
+	weights w(y, x) = pi(y) T(y, x), which are valid for any proposal T. The weights are taken
+	relative to pi at the current position, so they do not overflow.
+*/
+static inline __attribute__((always_inline)) void Monte_Carlo_multiple_try(walker *w, parameters *params, \
+		EnergyForceFun energy_and_force){
+	int tries = params->tries, gaussian = params->gaussian_proposal;
+	int well = proposal_well(w->x);
+	double j_x = w->prop.jump_size[well];
+	double y[MAX_TRIES], y_energy[MAX_TRIES], y_force[MAX_TRIES], weight[MAX_TRIES];
 
-	double P_move = min(1, exp(-potential_difference / params->kT)); // Probability of moving to new_x
-	if (genrand_real1() < P_move){
-        // Moves to new_x with probability P_move
-		return new_x;
+	// Draws the tries from the current position and weights them
+	double tot_weight = 0;
+	for (int k = 0; k < tries; k++) {
+		y[k] = w->x + propose_displacement(w, j_x, gaussian);
+		y_energy[k] = energy_and_force(y[k], &y_force[k]);
+		double j_y = w->prop.jump_size[proposal_well(y[k])];
+		weight[k] = exp(-(y_energy[k] - w->energy) / params->kT) * proposal_density(w->x - y[k], j_y, gaussian);
+		tot_weight += weight[k];
+	}
+
+	// Selects one try with probability proportional to its weight
+	double u = rng_uniform(&w->rng) * tot_weight;
+	int chosen = tries - 1;
+	for (int k = 0; k < tries - 1; k++) {
+		u -= weight[k];
+		if (u < 0) {
+			chosen = k;
+			break;
+		}
+	}
+
+	// Draws the reference points from the chosen try, the last one being the current position
+	double j_chosen = w->prop.jump_size[proposal_well(y[chosen])];
+	double ref_weight = proposal_density(y[chosen] - w->x, j_x, gaussian);
+	for (int k = 0; k < tries - 1; k++) {
+		double ref_x = y[chosen] + propose_displacement(w, j_chosen, gaussian);
+		double ref_force;
+		double ref_energy = energy_and_force(ref_x, &ref_force);
+		double j_ref = w->prop.jump_size[proposal_well(ref_x)];
+		ref_weight += exp(-(ref_energy - w->energy) / params->kT) * proposal_density(y[chosen] - ref_x, j_ref, gaussian);
+	}
+
+	COUNTER_ADD(w->count, mc_attempts, 1);
+	w->prop.attempts[well]++;
+	if (tot_weight > 0 && rng_uniform(&w->rng) * ref_weight < tot_weight) {
+		accept_move(w, well, y[chosen], y_energy[chosen], y_force[chosen]);
 	}
-	return x; // If not moving to new_x, stay where currently are
 }
 
-DynamicsFun Dynamics_selector(char name[]){
-    DynamicsFun dyn_fun; // Function for the chosen dynamics
-	if (strcmp(name, "BAOAB_LIMIT") == 0){
-		dyn_fun = &BAOAB_limit;
-	} else if (strcmp(name, "MONTE-CARLO") == 0){
-		dyn_fun = &Monte_Carlo_step;
+// Using Monte-Carlo method to determine where the particle jumps to
+static inline __attribute__((always_inline)) void Monte_Carlo_step(walker *w, parameters *params, \
+		EnergyForceFun energy_and_force){
+	if (params->tries > 1) {
+		Monte_Carlo_multiple_try(w, params, energy_and_force);
+		return;
+	}
+
+	// Proposal width of the well the move starts from
+	int well = proposal_well(w->x);
+	double j_x = w->prop.jump_size[well];
+
+    // Possible new position, uniformly (or normally) distributed
+	double new_x = w->x + propose_displacement(w, j_x, params->gaussian_proposal);
+	double new_force;
+	double new_energy = energy_and_force(new_x, &new_force);
+	double new_bias = (w->bias != NULL) ? bias_energy_force(w->bias, new_x, &new_force) : 0;
+
+    // Difference in the potential (and bias) between the new position and the current position
+	double potential_difference = new_energy + new_bias - w->energy - w->bias_energy;
+
+	// Hastings ratio of the proposal densities, which is 1 while both wells have the same width
+	double j_new = w->prop.jump_size[proposal_well(new_x)];
+	double proposal_ratio = (j_new == j_x) ? 1 : proposal_density(w->x - new_x, j_new, params->gaussian_proposal) \
+	                                             / proposal_density(new_x - w->x, j_x, params->gaussian_proposal);
+
+	double P_move = min(1, exp(-potential_difference / params->kT) * proposal_ratio); // Probability of moving to new_x
+	COUNTER_ADD(w->count, mc_attempts, 1);
+	w->prop.attempts[well]++;
+	if (rng_uniform(&w->rng) < P_move){
+        // Moves to new_x with probability P_move
+		accept_move(w, well, new_x, new_energy, new_force);
+		w->bias_energy = new_bias;
 	}
-	return dyn_fun;
+	// If not moving to new_x, stay where currently are
 }
 
 
@@ -0,0 +1,494 @@
+/*
+	Ensemble.h
+	Header file for advancing many independent walkers together. The walkers are stored
+	as a structure of arrays, and every kernel is a single branch-free loop over the
+	walkers, so that the compiler can vectorise the force evaluation, the noise update
+	and the Metropolis accept/reject (compile with -O3 -march=native -fopenmp).
+
+	Accept/reject decisions are made in log space, u < exp(-dV / kT) being equivalent
+	to dV < -kT * log(u), so the thresholds are computed while drawing the random
+	numbers and the kernels themselves only compare.
+*/
+
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "Parameters.h"
+#include "Random.h"
+#include "Histogram.h"
+#include "Counters.h"
+#include "Proposal.h"
+#include "Estimators.h"
+
+/* Structure to store the state of an ensemble of walkers */
+struct ensemble {
+    long nowalkers;  // Number of walkers in the ensemble
+    double *x;       // Positions of the walkers
+    double *p;       // Momenta of the walkers, used in the regular BAOAB method
+    double *R0;      // Current normally distributed number of each walker, used in the BAOAB method
+    double *R1;      // Next normally distributed number of each walker, used in the BAOAB method
+    long *cur_well;  // Which well each walker is in (0 is left well, 1 is right well)
+    long *no_left;   // Number of timesteps each walker has spent in the left well
+    double *rand1;   // First random number of each walker for the current step
+    double *rand2;   // Second random number of each walker for the current step
+    double *scratch; // Three values for each walker, for kernels which evaluate the potential of every walker at once
+    rng_stream rng;  // Random number stream shared by the whole ensemble
+    counters count;  // Counters of events in the step loop, summed over the walkers (see Counters.h)
+    proposal_state prop; // Proposal widths and acceptance of each well, shared by the walkers (see Proposal.h)
+    switch_record *switches; // Energy differences of the lattice switch attempts of every walker, NULL unless they are recorded
+    void (*dynamics)(struct ensemble*, parameters*);       // Kernel for the dynamics step
+    void (*lattice_switch)(struct ensemble*, parameters*); // Kernel for the lattice switch
+};
+
+typedef struct ensemble ensemble;
+
+// Typedef for a function pointer to an ensemble kernel
+typedef void (*EnsembleFun)(ensemble*, parameters*);
+
+// Typedef for a function pointer filling the energies of a number of positions
+typedef void (*EnsembleEnergiesFun)(const double*, double*, long);
+
+void Ensemble_selector(EnsembleFun func_arr[], char dynamics_type[], char potential_name[]);
+
+
+// Allocates an ensemble and places every walker at the bottom of the starting well
+void init_ensemble(ensemble *e, uint64_t seed, uint64_t stream, parameters *params) {
+    long n = params->nowalkers;
+    e->nowalkers = n;
+    e->x = malloc(sizeof(double) * n);
+    e->p = malloc(sizeof(double) * n);
+    e->R0 = malloc(sizeof(double) * n);
+    e->R1 = malloc(sizeof(double) * n);
+    e->cur_well = malloc(sizeof(long) * n);
+    e->no_left = malloc(sizeof(long) * n);
+    e->rand1 = malloc(sizeof(double) * n);
+    e->rand2 = malloc(sizeof(double) * n);
+    e->scratch = malloc(sizeof(double) * 3 * n);
+    if (e->x == NULL || e->p == NULL || e->R0 == NULL || e->R1 == NULL || e->cur_well == NULL || e->no_left == NULL || \
+        e->rand1 == NULL || e->rand2 == NULL || e->scratch == NULL) {
+        printf("Failed to allocate ensemble of %ld walkers\n", n);
+        exit(1);
+    }
+
+    rng_init(&e->rng, seed, stream, 0);
+    init_counters(&e->count);
+    init_proposal(&e->prop, params->jump_size);
+    e->switches = params->estimators ? new_switch_record() : NULL;
+
+    for (long i = 0; i < n; i++) {
+        e->x[i] = params->minima[params->start_well];
+        e->cur_well[i] = params->start_well;
+        e->no_left[i] = 0;
+        e->R0[i] = 0;
+        e->R1[i] = 0;
+        e->p[i] = 0;
+    }
+    if (strcmp(params->dynamics_type, "BAOAB_LIMIT") == 0) {
+        rng_fill_normal(&e->rng, e->R0, n);
+        rng_fill_normal(&e->rng, e->R1, n);
+    } else if (strcmp(params->dynamics_type, "BAOAB_REGULAR") == 0) {
+        // Draws the momenta from the Maxwell-Boltzmann distribution
+        rng_fill_normal(&e->rng, e->p, n);
+        for (long i = 0; i < n; i++) e->p[i] *= sqrt(params->mass * params->kT);
+    }
+
+    EnsembleFun func_arr[] = {0, 0}; // Dynamics and lattice switch kernels
+    Ensemble_selector(func_arr, params->dynamics_type, params->potential_name);
+    e->dynamics = func_arr[0];
+    e->lattice_switch = func_arr[1];
+}
+
+// Frees the arrays of an ensemble
+void free_ensemble(ensemble *e) {
+    free(e->x);
+    free(e->p);
+    free(e->R0);
+    free(e->R1);
+    free(e->cur_well);
+    free(e->no_left);
+    free(e->rand1);
+    free(e->rand2);
+    free(e->scratch);
+    free(e->switches);
+}
+
+// Fills an array with acceptance thresholds -kT * log(u), for u uniformly distributed on (0,1)
+void fill_threshold(rng_stream *rng, double *arr, long n, double kT) {
+    rng_fill_uniform(rng, arr, n);
+    for (long i = 0; i < n; i++) arr[i] = -kT * log(arr[i]);
+}
+
+// Counts the number of walkers with a non-finite position
+long count_nonfinite(ensemble *e) {
+    long count = 0;
+    double *x = e->x;
+#pragma omp simd reduction(+:count)
+    for (long i = 0; i < e->nowalkers; i++) count += !isfinite(x[i]);
+    return count;
+}
+
+
+/*
+    Generic kernels, taking the potential kernels as arguments. They are always inlined into
+    the potential specific kernels below, so the potential is called directly and can be vectorised.
+*/
+
+// Counts the walkers in the left well, performs a BAOAB limit step and recalibrates the wells
+static inline __attribute__((always_inline)) void ensemble_BAOAB_limit(ensemble *e, parameters *params, \
+        EnergyForceFun energy_and_force) {
+    long n = e->nowalkers;
+    double *x = e->x, *R0 = e->R0, *R1 = e->R1, *R = e->rand1;
+    long *cur_well = e->cur_well, *no_left = e->no_left;
+    double drift_const = params->drift_const, noise_const = params->noise_const;
+
+    long crossings = 0; // Number of walkers which crossed the barrier
+    rng_fill_normal(&e->rng, R, n);
+
+#pragma omp simd reduction(+:crossings)
+    for (long i = 0; i < n; i++) {
+        no_left[i] += (cur_well[i] == 0);
+        double force;
+        energy_and_force(x[i], &force);
+        double new_x = x[i] + drift_const * force + noise_const * (R0[i] + R1[i]);
+        R0[i] = R1[i];
+        R1[i] = R[i];
+        x[i] = new_x;
+        long new_well = (new_x > 0) ? 1 : ((new_x < 0) ? 0 : cur_well[i]);
+        crossings += (new_well != cur_well[i]);
+        cur_well[i] = new_well;
+    }
+    COUNTER_ADD(e->count, crossings, crossings);
+}
+
+/*
+    Counts the walkers in the left well, performs a regular BAOAB step and recalibrates the wells. The
+    force at the start of the step is recomputed rather than kept, as lattice switches move the walkers.
+*/
+static inline __attribute__((always_inline)) void ensemble_BAOAB_regular(ensemble *e, parameters *params, \
+        EnergyForceFun energy_and_force) {
+    long n = e->nowalkers;
+    double *x = e->x, *p = e->p, *R = e->rand1;
+    long *cur_well = e->cur_well, *no_left = e->no_left;
+    double half_timestep = params->half_timestep, half_drift = params->half_drift;
+    double ou_decay = params->ou_decay, ou_noise = params->ou_noise;
+
+    long crossings = 0; // Number of walkers which crossed the barrier
+    rng_fill_normal(&e->rng, R, n);
+
+#pragma omp simd reduction(+:crossings)
+    for (long i = 0; i < n; i++) {
+        no_left[i] += (cur_well[i] == 0);
+        double force;
+        energy_and_force(x[i], &force);
+        double new_p = p[i] + half_timestep * force; // B
+        double new_x = x[i] + half_drift * new_p; // A
+        new_p = ou_decay * new_p + ou_noise * R[i]; // O
+        new_x += half_drift * new_p; // A
+        energy_and_force(new_x, &force);
+        p[i] = new_p + half_timestep * force; // B
+        x[i] = new_x;
+        long new_well = (new_x > 0) ? 1 : ((new_x < 0) ? 0 : cur_well[i]);
+        crossings += (new_well != cur_well[i]);
+        cur_well[i] = new_well;
+    }
+    COUNTER_ADD(e->count, crossings, crossings);
+}
+
+// Fills energy with the potential at each of n positions, one position at a time
+static inline __attribute__((always_inline)) void ensemble_energies(const double *x, double *energy, long n, \
+        EnergyForceFun energy_and_force) {
+#pragma omp simd
+    for (long i = 0; i < n; i++) {
+        double force;
+        energy[i] = energy_and_force(x[i], &force);
+    }
+}
+
+/*
+    Counts the walkers in the left well, performs a Monte-Carlo step and recalibrates the wells. The
+    proposal width depends on the side of the barrier a move starts from (see Proposal.h), so the
+    threshold includes the log of the Hastings ratio, which is 0 while both wells have the same width.
+    The energies of every walker are found by energies between the proposals and the acceptances.
+*/
+static inline __attribute__((always_inline)) void ensemble_Monte_Carlo(ensemble *e, parameters *params, \
+        EnsembleEnergiesFun energies) {
+    long n = e->nowalkers;
+    double *x = e->x, *U = e->rand1, *T = e->rand2;
+    double *new_x = e->scratch, *new_energy = e->scratch + n, *energy = e->scratch + 2 * n;
+    long *cur_well = e->cur_well, *no_left = e->no_left;
+    double jump_left = e->prop.jump_size[0], jump_right = e->prop.jump_size[1];
+    double log_ratio = params->kT * log(jump_left / jump_right); // kT times the log of the ratio of the widths
+    int same_width = (jump_left == jump_right);
+
+    rng_fill_uniform(&e->rng, U, n);
+    fill_threshold(&e->rng, T, n, params->kT);
+#pragma omp simd
+    for (long i = 0; i < n; i++) new_x[i] = x[i] + (2 * U[i] - 1) * ((x[i] > 0) ? jump_right : jump_left);
+    energies(new_x, new_energy, n);
+    energies(x, energy, n);
+
+    long crossings = 0; // Number of walkers which crossed the barrier
+    long attempts_right = 0, accepts_left = 0, accepts_right = 0; // Moves from each side of the barrier
+#pragma omp simd reduction(+:crossings, attempts_right, accepts_left, accepts_right)
+    for (long i = 0; i < n; i++) {
+        no_left[i] += (cur_well[i] == 0);
+        int from_right = x[i] > 0;
+        int to_right = new_x[i] > 0;
+        double jump_back = to_right ? jump_right : jump_left; // Width of the reverse move
+        // kT times the log of the Hastings ratio jump_size / jump_back
+        double hastings = (from_right == to_right) ? 0 : (from_right ? -log_ratio : log_ratio);
+        int reachable = same_width || (fabs(new_x[i] - x[i]) < jump_back); // Whether the reverse move is possible
+        int accept = (new_energy[i] - energy[i] - hastings < T[i]) && reachable;
+        attempts_right += from_right;
+        accepts_left += accept & !from_right;
+        accepts_right += accept & from_right;
+        double pos = accept ? new_x[i] : x[i];
+        x[i] = pos;
+        long new_well = (pos > 0) ? 1 : ((pos < 0) ? 0 : cur_well[i]);
+        crossings += (new_well != cur_well[i]);
+        cur_well[i] = new_well;
+    }
+    e->prop.attempts[0] += n - attempts_right;
+    e->prop.attempts[1] += attempts_right;
+    e->prop.accepts[0] += accepts_left;
+    e->prop.accepts[1] += accepts_right;
+    COUNTER_ADD(e->count, mc_attempts, n);
+    COUNTER_ADD(e->count, mc_accepts, accepts_left + accepts_right);
+    COUNTER_ADD(e->count, crossings, crossings);
+}
+
+// Attempts a lattice switch for every walker, leaving the difference in the shifted potential of each attempt in rand2
+static inline __attribute__((always_inline)) void ensemble_lattice_switch(ensemble *e, parameters *params, \
+        double (*shifted_delta)(double, int)) {
+    long n = e->nowalkers;
+    double *x = e->x, *T = e->rand1, *diff = e->rand2;
+    long *cur_well = e->cur_well;
+    double left_min = params->minima[0], right_min = params->minima[1];
+
+    fill_threshold(&e->rng, T, n, params->kT);
+    long accepts = 0; // Number of walkers which switched
+
+#pragma omp simd reduction(+:accepts)
+    for (long i = 0; i < n; i++) {
+        long oth_well = 1 - cur_well[i];
+        // Position in the other well with the same displacement from its minimum
+        double oth_x = x[i] + ((oth_well == 0) ? left_min - right_min : right_min - left_min);
+        double diff_poten = shifted_delta(x[i], (int) cur_well[i]);
+        diff[i] = diff_poten;
+        int accept = diff_poten < T[i];
+        accepts += accept;
+        x[i] = accept ? oth_x : x[i];
+        cur_well[i] = accept ? oth_well : cur_well[i];
+    }
+    COUNTER_ADD(e->count, switch_attempts, n);
+    COUNTER_ADD(e->count, switch_accepts, accepts);
+}
+
+// Records the lattice switch attempts of the last step, each walker having switched if its difference is below its threshold
+void record_ensemble_switches(ensemble *e, parameters *params) {
+    for (long i = 0; i < e->nowalkers; i++) {
+        int accept = e->rand2[i] < e->rand1[i];
+        int well = (int) (accept ? 1 - e->cur_well[i] : e->cur_well[i]); // Well the attempt started from
+        switch_record_add(e->switches, well, e->rand2[i] / params->kT);
+    }
+}
+
+
+/* Kernels specific to each potential */
+
+#define ENSEMBLE_KERNELS(POTEN) \
+    void POTEN##_ensemble_BAOAB_limit(ensemble *e, parameters *params) { \
+        ensemble_BAOAB_limit(e, params, &POTEN##_energy_and_force); \
+    } \
+    void POTEN##_ensemble_BAOAB_regular(ensemble *e, parameters *params) { \
+        ensemble_BAOAB_regular(e, params, &POTEN##_energy_and_force); \
+    } \
+    static void POTEN##_ensemble_energies(const double *x, double *energy, long n) { \
+        ensemble_energies(x, energy, n, &POTEN##_energy_and_force); \
+    } \
+    void POTEN##_ensemble_Monte_Carlo(ensemble *e, parameters *params) { \
+        ensemble_Monte_Carlo(e, params, &POTEN##_ensemble_energies); \
+    } \
+    void POTEN##_ensemble_lattice_switch(ensemble *e, parameters *params) { \
+        ensemble_lattice_switch(e, params, &POTEN##_shifted_delta); \
+    }
+
+ENSEMBLE_KERNELS(KT)
+ENSEMBLE_KERNELS(QUARTIC)
+ENSEMBLE_KERNELS(DIFF_WIDTH)
+ENSEMBLE_KERNELS(TABULATED)
+
+
+/*
+    Kernels for the EXPRESSION potential, which evaluate the formula for every walker in one call before
+    each loop over the walkers (see Expression.h), rather than for one walker at a time within the loop.
+    The loops are otherwise those of the generic kernels, and the Monte-Carlo step is the generic one.
+*/
+
+void EXPRESSION_ensemble_BAOAB_limit(ensemble *e, parameters *params) {
+    long n = e->nowalkers;
+    double *x = e->x, *R0 = e->R0, *R1 = e->R1, *R = e->rand1;
+    double *forces = e->scratch, *energies = e->scratch + n;
+    long *cur_well = e->cur_well, *no_left = e->no_left;
+    double drift_const = params->drift_const, noise_const = params->noise_const;
+
+    long crossings = 0; // Number of walkers which crossed the barrier
+    rng_fill_normal(&e->rng, R, n);
+    expression_eval(&EXPRESSION_PROGRAM, x, energies, forces, n);
+
+#pragma omp simd reduction(+:crossings)
+    for (long i = 0; i < n; i++) {
+        no_left[i] += (cur_well[i] == 0);
+        double new_x = x[i] + drift_const * forces[i] + noise_const * (R0[i] + R1[i]);
+        R0[i] = R1[i];
+        R1[i] = R[i];
+        x[i] = new_x;
+        long new_well = (new_x > 0) ? 1 : ((new_x < 0) ? 0 : cur_well[i]);
+        crossings += (new_well != cur_well[i]);
+        cur_well[i] = new_well;
+    }
+    COUNTER_ADD(e->count, crossings, crossings);
+}
+
+void EXPRESSION_ensemble_BAOAB_regular(ensemble *e, parameters *params) {
+    long n = e->nowalkers;
+    double *x = e->x, *p = e->p, *R = e->rand1;
+    double *forces = e->scratch, *energies = e->scratch + n, *new_x = e->scratch + 2 * n;
+    long *cur_well = e->cur_well, *no_left = e->no_left;
+    double half_timestep = params->half_timestep, half_drift = params->half_drift;
+    double ou_decay = params->ou_decay, ou_noise = params->ou_noise;
+
+    long crossings = 0; // Number of walkers which crossed the barrier
+    rng_fill_normal(&e->rng, R, n);
+    expression_eval(&EXPRESSION_PROGRAM, x, energies, forces, n);
+
+#pragma omp simd
+    for (long i = 0; i < n; i++) {
+        double new_p = p[i] + half_timestep * forces[i]; // B
+        double pos = x[i] + half_drift * new_p; // A
+        new_p = ou_decay * new_p + ou_noise * R[i]; // O
+        new_x[i] = pos + half_drift * new_p; // A
+        p[i] = new_p;
+    }
+    expression_eval(&EXPRESSION_PROGRAM, new_x, energies, forces, n);
+
+#pragma omp simd reduction(+:crossings)
+    for (long i = 0; i < n; i++) {
+        no_left[i] += (cur_well[i] == 0);
+        p[i] += half_timestep * forces[i]; // B
+        x[i] = new_x[i];
+        long new_well = (new_x[i] > 0) ? 1 : ((new_x[i] < 0) ? 0 : cur_well[i]);
+        crossings += (new_well != cur_well[i]);
+        cur_well[i] = new_well;
+    }
+    COUNTER_ADD(e->count, crossings, crossings);
+}
+
+static void EXPRESSION_ensemble_energies(const double *x, double *energy, long n) {
+    expression_eval(&EXPRESSION_PROGRAM, x, energy, NULL, n);
+}
+
+void EXPRESSION_ensemble_Monte_Carlo(ensemble *e, parameters *params) {
+    ensemble_Monte_Carlo(e, params, &EXPRESSION_ensemble_energies);
+}
+
+void EXPRESSION_ensemble_lattice_switch(ensemble *e, parameters *params) {
+    long n = e->nowalkers;
+    double *x = e->x, *T = e->rand1, *diff = e->rand2;
+    double *oth_x = e->scratch, *oth_energy = e->scratch + n, *energy = e->scratch + 2 * n;
+    long *cur_well = e->cur_well;
+    double left_min = params->minima[0], right_min = params->minima[1], shift = params->shift_value;
+
+    fill_threshold(&e->rng, T, n, params->kT);
+#pragma omp simd
+    for (long i = 0; i < n; i++) {
+        // Position in the other well with the same displacement from its minimum
+        oth_x[i] = x[i] + ((cur_well[i] == 1) ? left_min - right_min : right_min - left_min);
+    }
+    expression_eval(&EXPRESSION_PROGRAM, oth_x, oth_energy, NULL, n);
+    expression_eval(&EXPRESSION_PROGRAM, x, energy, NULL, n);
+
+    long accepts = 0; // Number of walkers which switched
+#pragma omp simd reduction(+:accepts)
+    for (long i = 0; i < n; i++) {
+        long oth_well = 1 - cur_well[i];
+        double diff_poten = oth_energy[i] + ((oth_x[i] > 0) ? shift : 0) - energy[i] - ((x[i] > 0) ? shift : 0);
+        diff[i] = diff_poten;
+        int accept = diff_poten < T[i];
+        accepts += accept;
+        x[i] = accept ? oth_x[i] : x[i];
+        cur_well[i] = accept ? oth_well : cur_well[i];
+    }
+    COUNTER_ADD(e->count, switch_attempts, n);
+    COUNTER_ADD(e->count, switch_accepts, accepts);
+}
+
+// Performs the lattice switching method on every walker for steps first_step to end_step - 1 (see Simulation.h)
+void simulate_ensemble(histogram *bins, ensemble *e, parameters *params, long first_step, long end_step) {
+    for (long stepno = first_step; stepno < end_step; stepno++) {
+        int timed = timed_step(stepno); // Whether the phases of this step are timed
+        double phase_start = timed ? counter_time() : 0;
+
+        if (bins != NULL) {
+            histogram_add_array(bins, e->x, e->nowalkers);
+            end_phase(timed, &phase_start, &e->count.bins_seconds);
+        }
+
+        long nonfinite = count_nonfinite(e);
+        if (nonfinite > 0) {
+            printf("Infinite x value reached\n");
+            COUNTER_ADD(e->count, nonfinite, nonfinite);
+        }
+
+        // Counts walkers in the left well, performs the dynamics step and recalibrates the wells
+        (*e->dynamics)(e, params);
+        end_phase(timed, &phase_start, &e->count.dynamics_seconds);
+
+        // Attempts a lattice switch
+        if (stepno % params->switch_regularity == 0) {
+            (*e->lattice_switch)(e, params);
+            if (e->switches != NULL) record_ensemble_switches(e, params);
+            end_phase(timed, &phase_start, &e->count.switch_seconds);
+        }
+    }
+}
+
+// Returns the number of timesteps spent in the left well, summed over the walkers
+long ensemble_no_left(ensemble *e) {
+    long no_left = 0;
+    for (long i = 0; i < e->nowalkers; i++) no_left += e->no_left[i];
+    return no_left;
+}
+
+// Returns the dynamics and lattice switch kernels for the chosen dynamics and potential
+void Ensemble_selector(EnsembleFun func_arr[], char dynamics_type[], char potential_name[]) {
+    int baoab = (strcmp(dynamics_type, "BAOAB_LIMIT") == 0);
+    int regular = (strcmp(dynamics_type, "BAOAB_REGULAR") == 0); // Otherwise Monte-Carlo
+    if (strcmp(potential_name, "KT") == 0) {
+        func_arr[0] = baoab ? &KT_ensemble_BAOAB_limit : (regular ? &KT_ensemble_BAOAB_regular : \
+                                                                    &KT_ensemble_Monte_Carlo);
+        func_arr[1] = &KT_ensemble_lattice_switch;
+    } else if (strcmp(potential_name, "QUARTIC") == 0) {
+        func_arr[0] = baoab ? &QUARTIC_ensemble_BAOAB_limit : (regular ? &QUARTIC_ensemble_BAOAB_regular : \
+                                                                         &QUARTIC_ensemble_Monte_Carlo);
+        func_arr[1] = &QUARTIC_ensemble_lattice_switch;
+    } else if (strcmp(potential_name, "DIFF_WIDTH") == 0) {
+        func_arr[0] = baoab ? &DIFF_WIDTH_ensemble_BAOAB_limit : (regular ? &DIFF_WIDTH_ensemble_BAOAB_regular : \
+                                                                            &DIFF_WIDTH_ensemble_Monte_Carlo);
+        func_arr[1] = &DIFF_WIDTH_ensemble_lattice_switch;
+    } else if (strcmp(potential_name, "TABULATED") == 0) {
+        func_arr[0] = baoab ? &TABULATED_ensemble_BAOAB_limit : (regular ? &TABULATED_ensemble_BAOAB_regular : \
+                                                                           &TABULATED_ensemble_Monte_Carlo);
+        func_arr[1] = &TABULATED_ensemble_lattice_switch;
+    } else if (strcmp(potential_name, "EXPRESSION") == 0) {
+        func_arr[0] = baoab ? &EXPRESSION_ensemble_BAOAB_limit : (regular ? &EXPRESSION_ensemble_BAOAB_regular : \
+                                                                            &EXPRESSION_ensemble_Monte_Carlo);
+        func_arr[1] = &EXPRESSION_ensemble_lattice_switch;
+    }
+}
+
+#endif // ENSEMBLE_H
@@ -0,0 +1,146 @@
+/*
+	Estimators.h
+	Header file for estimating the free energy difference from the energy differences of the
+	lattice switch attempts, besides the fraction of steps in each well. With the ESTIMATORS ALL
+	option, every attempt records W = V(x') - V(x) for the shifted potential, where x' is the
+	position the walker would switch to, separately for switches from the left and right wells.
+
+	From these, the free energy difference is estimated by exponential averaging (Zwanzig) of
+	either direction, and by the Bennett acceptance ratio, which combines both directions and
+	has the lowest variance. The exponential averages are accumulated exactly, as log-sum-exps.
+	For the Bennett acceptance ratio, W / kT is counted in fine bins (SWITCH_BIN_WIDTH), with
+	the values beyond +-SWITCH_MAX in end bins, whose weight in the estimate is negligible.
+
+	Reference: "Efficient estimation of free energy differences from Monte Carlo data" by
+	C. H. Bennett, J. Comput. Phys. 22, 245 (1976).
+*/
+
+#ifndef ESTIMATORS_H
+#define ESTIMATORS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "Parameters.h"
+
+#define SWITCH_MAX 200.0       // Largest |W| / kT counted in its own bin
+#define SWITCH_BIN_WIDTH 0.005 // Width of the bins of W / kT
+#define SWITCH_BINS 80000      // Number of bins between -SWITCH_MAX and SWITCH_MAX
+#define NOESTIMATORS 3         // Exponential averaging from the left, from the right, and the Bennett acceptance ratio
+
+/* Structure to store the energy differences of the lattice switch attempts from each well */
+struct switch_record {
+    long noattempts[2];                // Number of attempts from each well
+    double exp_max[2];                 // Largest -W / kT from each well
+    double exp_sum[2];                 // Sum of exp(-W / kT - exp_max) from each well
+    long counts[2][SWITCH_BINS + 2];   // Counts of W / kT from each well, with the end bins first and last
+};
+
+typedef struct switch_record switch_record;
+
+
+// Allocates an empty record
+switch_record *new_switch_record(void) {
+    switch_record *rec = calloc(1, sizeof(switch_record));
+    if (rec == NULL) {
+        printf("Failed to allocate switch record\n");
+        exit(1);
+    }
+    return rec;
+}
+
+// Adds an attempt from a well with energy difference beta_W = W / kT
+static inline void switch_record_add(switch_record *rec, int well, double beta_W) {
+    double v = -beta_W; // Exponent of the Boltzmann factor
+    if (rec->noattempts[well] == 0) {
+        rec->exp_max[well] = v;
+        rec->exp_sum[well] = 1;
+    } else if (v <= rec->exp_max[well]) {
+        rec->exp_sum[well] += exp(v - rec->exp_max[well]);
+    } else {
+        rec->exp_sum[well] = rec->exp_sum[well] * exp(rec->exp_max[well] - v) + 1;
+        rec->exp_max[well] = v;
+    }
+    rec->noattempts[well]++;
+
+    long j; // Index of the bin of beta_W
+    if (beta_W < -SWITCH_MAX) {
+        j = 0;
+    } else if (!(beta_W < SWITCH_MAX)) {
+        j = SWITCH_BINS + 1;
+    } else {
+        j = (long) ((beta_W + SWITCH_MAX) / SWITCH_BIN_WIDTH) + 1;
+        if (j > SWITCH_BINS) j = SWITCH_BINS;
+    }
+    rec->counts[well][j]++;
+}
+
+// Returns W / kT at the centre of bin j, the end bins being taken at +-SWITCH_MAX
+static inline double switch_bin_value(long j) {
+    if (j == 0) return -SWITCH_MAX;
+    if (j == SWITCH_BINS + 1) return SWITCH_MAX;
+    return -SWITCH_MAX + (j - 0.5) * SWITCH_BIN_WIDTH;
+}
+
+// Returns 1 / (1 + exp(z)) without overflow
+static inline double fermi(double z) {
+    return (z > 0) ? exp(-z) / (1 + exp(-z)) : 1 / (1 + exp(z));
+}
+
+/*
+    Returns the difference between the two sides of the Bennett acceptance ratio equation for a
+    reduced free energy difference d = (F_R - F_L) / kT of the shifted wells, which increases with d
+*/
+double bar_imbalance(switch_record *rec, double d) {
+    double M = log((double) rec->noattempts[0] / rec->noattempts[1]);
+    double forward = 0, reverse = 0;
+    for (long j = 0; j < SWITCH_BINS + 2; j++) {
+        double beta_W = switch_bin_value(j);
+        if (rec->counts[0][j] > 0) forward += rec->counts[0][j] * fermi(M + beta_W - d);
+        if (rec->counts[1][j] > 0) reverse += rec->counts[1][j] * fermi(-M + beta_W + d);
+    }
+    return forward - reverse;
+}
+
+/*
+    Stores the estimates of the free energy difference, F_L - F_R as in calc_energy_difference, from
+    exponential averaging of the switches from the left well, from the right well, and from the Bennett
+    acceptance ratio, in estimates. Estimates without attempts in the directions they need are NAN.
+*/
+void switch_estimates(switch_record *rec, parameters *params, double estimates[NOESTIMATORS]) {
+    double kT = params->kT;
+    for (int k = 0; k < NOESTIMATORS; k++) estimates[k] = NAN;
+
+    // log of the mean Boltzmann factor of the switches from each well
+    double log_mean[2];
+    for (int well = 0; well < 2; well++) {
+        if (rec->noattempts[well] == 0) continue;
+        log_mean[well] = rec->exp_max[well] + log(rec->exp_sum[well]) - log((double) rec->noattempts[well]);
+    }
+    if (rec->noattempts[0] > 0) estimates[0] = kT * log_mean[0] + params->shift_value;
+    if (rec->noattempts[1] > 0) estimates[1] = -kT * log_mean[1] + params->shift_value;
+    if (rec->noattempts[0] == 0 || rec->noattempts[1] == 0) return;
+
+    // Solves the Bennett equation by bisection, starting from a bracket around the exponential averages
+    double low = -log_mean[0], high = log_mean[1]; // Reduced estimates of F_R - F_L
+    if (low > high) {
+        double tmp = low;
+        low = high;
+        high = tmp;
+    }
+    low -= 1;
+    high += 1;
+    while (bar_imbalance(rec, low) > 0) low -= 2 * (high - low);
+    while (bar_imbalance(rec, high) < 0) high += 2 * (high - low);
+    for (int iter = 0; iter < 200 && high - low > 1e-12; iter++) {
+        double mid = 0.5 * (low + high);
+        if (bar_imbalance(rec, mid) < 0) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    estimates[2] = -kT * 0.5 * (low + high) + params->shift_value;
+}
+
+#endif // ESTIMATORS_H
@@ -0,0 +1,453 @@
+/*
+	Expression.h
+	Header file for potentials given as a formula in the input file, with the EXPRESSION
+	option, e.g.
+	    EXPRESSION (x <= -1) ? 5*(x+2)^2 : ((x <= 1.2) ? 10 - 5*x^2 : 5*(x-2.4)^2 - 4.4)
+	The formula is a function of x built from numbers, + - * / ^, the functions exp, log,
+	sqrt, sin, cos, tanh, abs, min and max, the comparisons < <= > >= (1 if true, 0 if not)
+	and the choice c ? a : b, which makes piecewise potentials.
+
+	The formula is parsed once into a tree, which is compiled into a flat program for a
+	machine of registers, each holding a value and its derivative with respect to x. Every
+	instruction computes both (forward mode automatic differentiation), so the force is
+	exact and never needs writing down. Subtrees of numbers are folded, and integer powers
+	become multiplications. A choice computes both of its branches and selects between
+	them without branching, so walkers on either side of a join take the same path.
+
+	The program runs on blocks of EXPRESSION_BLOCK positions at a time, each instruction
+	looping over the block, so one call evaluates many walkers (see the EXPRESSION kernels
+	of Ensemble.h) and the cost of decoding an instruction is shared between them. A single
+	walker still decodes the whole program at every step, so the formula of KT above runs
+	four to five times slower than the built-in KT, and about twice as slow with WALKERS 1024.
+*/
+
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#define EXPRESSION_MAX_NODES 512     // Largest number of nodes in the tree of a formula
+#define EXPRESSION_MAX_REGISTERS 32  // Largest number of registers a program may use
+#define EXPRESSION_BLOCK 32          // Number of positions evaluated together by each instruction
+
+/* Operations of the nodes of the tree and of the instructions of a program */
+enum expression_op {
+    OP_CONST, // The number constant
+    OP_X,     // The position x
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV,
+    OP_NEG,
+    OP_POWI,  // a to the integer power constant
+    OP_POW,   // a to the power b
+    OP_EXP, OP_LOG, OP_SQRT, OP_SIN, OP_COS, OP_TANH, OP_ABS,
+    OP_LT, OP_LE, OP_GT, OP_GE,
+    OP_SELECT // a if c is not 0, otherwise b
+};
+
+/* Structure to store a node of the tree of a formula */
+struct expression_node {
+    int op;          // Operation of the node
+    int args[3];     // Nodes of the arguments, the condition being the third of a choice
+    double constant; // Number of a constant, or power of an integer power
+};
+
+typedef struct expression_node expression_node;
+
+/* Structure to store an instruction, which leaves its result in register dst */
+struct expression_instruction {
+    int op;          // Operation of the instruction
+    int dst;         // Register of the result
+    int args[3];     // Registers of the arguments
+    double constant; // Number of a constant, or power of an integer power
+};
+
+typedef struct expression_instruction expression_instruction;
+
+/* Structure to store a compiled formula, whose result is left in register 0 */
+struct expression_program {
+    int noinstructions;
+    int noregisters;
+    expression_instruction code[EXPRESSION_MAX_NODES];
+    char text[1024]; // Formula the program was compiled from
+};
+
+typedef struct expression_program expression_program;
+
+/* Structure to store the state of the parser */
+struct expression_parser {
+    const char *text; // Formula being parsed
+    const char *pos;  // Next character to parse
+    int nonodes;
+    expression_node nodes[EXPRESSION_MAX_NODES];
+};
+
+typedef struct expression_parser expression_parser;
+
+
+static void expression_error(expression_parser *p, const char *message) {
+    printf("Failed to parse expression %s at character %ld: %s\n", p->text, (long) (p->pos - p->text) + 1, message);
+    exit(1);
+}
+
+// Returns the value of an operation on constant arguments, for folding
+static double fold_constant(int op, const double *a, double power) {
+    switch (op) {
+        case OP_ADD: return a[0] + a[1];
+        case OP_SUB: return a[0] - a[1];
+        case OP_MUL: return a[0] * a[1];
+        case OP_DIV: return a[0] / a[1];
+        case OP_NEG: return -a[0];
+        case OP_POWI: return pow(a[0], power);
+        case OP_POW: return pow(a[0], a[1]);
+        case OP_EXP: return exp(a[0]);
+        case OP_LOG: return log(a[0]);
+        case OP_SQRT: return sqrt(a[0]);
+        case OP_SIN: return sin(a[0]);
+        case OP_COS: return cos(a[0]);
+        case OP_TANH: return tanh(a[0]);
+        case OP_ABS: return fabs(a[0]);
+        case OP_LT: return a[0] < a[1];
+        case OP_LE: return a[0] <= a[1];
+        case OP_GT: return a[0] > a[1];
+        case OP_GE: return a[0] >= a[1];
+        default: return (a[2] != 0) ? a[0] : a[1];
+    }
+}
+
+// Adds a node with noargs arguments, folding it into a constant if every argument is one
+static int add_node(expression_parser *p, int op, int noargs, int a, int b, int c, double constant) {
+    if (p->nonodes == EXPRESSION_MAX_NODES) expression_error(p, "expression too long");
+    int args[3] = {a, b, c};
+    int folded = (op != OP_X && op != OP_CONST);
+    double values[3] = {0, 0, 0};
+    for (int k = 0; k < noargs; k++) {
+        folded = folded && (p->nodes[args[k]].op == OP_CONST);
+        if (folded) values[k] = p->nodes[args[k]].constant;
+    }
+    expression_node *node = &p->nodes[p->nonodes];
+    if (folded) {
+        node->op = OP_CONST;
+        node->constant = fold_constant(op, values, constant);
+    } else {
+        node->op = op;
+        node->constant = constant;
+        for (int k = 0; k < 3; k++) node->args[k] = args[k];
+    }
+    return p->nonodes++;
+}
+
+static void skip_spaces(expression_parser *p) {
+    while (isspace((unsigned char) *p->pos)) p->pos++;
+}
+
+// Consumes the string s if it comes next
+static int accept_token(expression_parser *p, const char *s) {
+    skip_spaces(p);
+    size_t length = strlen(s);
+    if (strncmp(p->pos, s, length) != 0) return 0;
+    p->pos += length;
+    return 1;
+}
+
+static void expect_token(expression_parser *p, const char *s) {
+    if (!accept_token(p, s)) {
+        char message[64];
+        snprintf(message, sizeof(message), "expected %s", s);
+        expression_error(p, message);
+    }
+}
+
+static int parse_choice(expression_parser *p);
+static int parse_unary(expression_parser *p);
+
+// primary := number | x | function ( arguments ) | ( choice )
+static int parse_primary(expression_parser *p) {
+    skip_spaces(p);
+    if (isdigit((unsigned char) *p->pos) || *p->pos == '.') {
+        char *end;
+        double value = strtod(p->pos, &end);
+        p->pos = end;
+        return add_node(p, OP_CONST, 0, 0, 0, 0, value);
+    }
+    if (accept_token(p, "(")) {
+        int node = parse_choice(p);
+        expect_token(p, ")");
+        return node;
+    }
+    if (!isalpha((unsigned char) *p->pos)) expression_error(p, "expected a number, x, a function or (");
+
+    char name[16];
+    int length = 0;
+    while (isalnum((unsigned char) *p->pos) && length < 15) name[length++] = *p->pos++;
+    name[length] = '\0';
+    if (strcmp(name, "x") == 0) return add_node(p, OP_X, 0, 0, 0, 0, 0);
+
+    static const char *functions[] = {"exp", "log", "sqrt", "sin", "cos", "tanh", "abs"};
+    static const int function_ops[] = {OP_EXP, OP_LOG, OP_SQRT, OP_SIN, OP_COS, OP_TANH, OP_ABS};
+    expect_token(p, "(");
+    int a = parse_choice(p);
+    for (int k = 0; k < 7; k++) {
+        if (strcmp(name, functions[k]) == 0) {
+            expect_token(p, ")");
+            return add_node(p, function_ops[k], 1, a, 0, 0, 0);
+        }
+    }
+    if (strcmp(name, "min") == 0 || strcmp(name, "max") == 0) {
+        expect_token(p, ",");
+        int b = parse_choice(p);
+        expect_token(p, ")");
+        int cond = add_node(p, (name[1] == 'i') ? OP_LT : OP_GT, 2, a, b, 0, 0);
+        return add_node(p, OP_SELECT, 3, a, b, cond, 0);
+    }
+    expression_error(p, "unknown function");
+    return -1;
+}
+
+// power := primary [^ unary], where integer powers are kept apart to become multiplications
+static int parse_power(expression_parser *p) {
+    int base = parse_primary(p);
+    if (!accept_token(p, "^")) return base;
+    int exponent = parse_unary(p);
+    if (p->nodes[exponent].op == OP_CONST) {
+        double power = p->nodes[exponent].constant;
+        if (power == 0) return add_node(p, OP_CONST, 0, 0, 0, 0, 1);
+        if (power == floor(power) && fabs(power) <= 64) return add_node(p, OP_POWI, 1, base, 0, 0, power);
+    }
+    return add_node(p, OP_POW, 2, base, exponent, 0, 0);
+}
+
+// unary := - unary | + unary | power
+static int parse_unary(expression_parser *p) {
+    if (accept_token(p, "-")) return add_node(p, OP_NEG, 1, parse_unary(p), 0, 0, 0);
+    if (accept_token(p, "+")) return parse_unary(p);
+    return parse_power(p);
+}
+
+// product := unary {(* | /) unary}
+static int parse_product(expression_parser *p) {
+    int node = parse_unary(p);
+    for (;;) {
+        if (accept_token(p, "*")) {
+            node = add_node(p, OP_MUL, 2, node, parse_unary(p), 0, 0);
+        } else if (accept_token(p, "/")) {
+            node = add_node(p, OP_DIV, 2, node, parse_unary(p), 0, 0);
+        } else {
+            return node;
+        }
+    }
+}
+
+// sum := product {(+ | -) product}
+static int parse_sum(expression_parser *p) {
+    int node = parse_product(p);
+    for (;;) {
+        if (accept_token(p, "+")) {
+            node = add_node(p, OP_ADD, 2, node, parse_product(p), 0, 0);
+        } else if (accept_token(p, "-")) {
+            node = add_node(p, OP_SUB, 2, node, parse_product(p), 0, 0);
+        } else {
+            return node;
+        }
+    }
+}
+
+// comparison := sum [(<= | < | >= | >) sum]
+static int parse_comparison(expression_parser *p) {
+    int node = parse_sum(p);
+    int op = accept_token(p, "<=") ? OP_LE : accept_token(p, "<") ? OP_LT : accept_token(p, ">=") ? OP_GE : \
+             accept_token(p, ">") ? OP_GT : -1;
+    if (op < 0) return node;
+    return add_node(p, op, 2, node, parse_sum(p), 0, 0);
+}
+
+// choice := comparison [? choice : choice]
+static int parse_choice(expression_parser *p) {
+    int cond = parse_comparison(p);
+    if (!accept_token(p, "?")) return cond;
+    int a = parse_choice(p);
+    expect_token(p, ":");
+    int b = parse_choice(p);
+    return add_node(p, OP_SELECT, 3, a, b, cond, 0);
+}
+
+// Returns the number of arguments of an operation
+static int expression_noargs(int op) {
+    if (op == OP_CONST || op == OP_X) return 0;
+    if (op == OP_SELECT) return 3;
+    if (op == OP_NEG || op == OP_POWI || (op >= OP_EXP && op <= OP_ABS)) return 1;
+    return 2;
+}
+
+/*
+    Emits the instructions leaving node in register dst, using only the registers from dst up, so the
+    registers form a stack and a program needs as many as the tree is deep
+*/
+static void emit_node(expression_parser *p, expression_program *prog, int node, int dst) {
+    expression_node *n = &p->nodes[node];
+    int noargs = expression_noargs(n->op);
+    if (dst + noargs > EXPRESSION_MAX_REGISTERS) expression_error(p, "expression nested too deeply");
+    for (int k = 0; k < noargs; k++) emit_node(p, prog, n->args[k], dst + k);
+    expression_instruction *ins = &prog->code[prog->noinstructions++];
+    ins->op = n->op;
+    ins->dst = dst;
+    for (int k = 0; k < 3; k++) ins->args[k] = dst + ((k < noargs) ? k : 0);
+    ins->constant = n->constant;
+    if (dst + noargs > prog->noregisters) prog->noregisters = dst + noargs;
+    if (prog->noregisters == 0) prog->noregisters = 1;
+}
+
+// Parses a formula and compiles it into prog
+void compile_expression(expression_program *prog, const char *text) {
+    expression_parser *p = malloc(sizeof(expression_parser));
+    if (p == NULL) {
+        printf("Failed to allocate expression parser\n");
+        exit(1);
+    }
+    p->text = text;
+    p->pos = text;
+    p->nonodes = 0;
+    int root = parse_choice(p);
+    skip_spaces(p);
+    if (*p->pos != '\0') expression_error(p, "unexpected character");
+
+    prog->noinstructions = 0;
+    prog->noregisters = 0;
+    emit_node(p, prog, root, 0);
+    snprintf(prog->text, sizeof(prog->text), "%s", text);
+    free(p);
+}
+
+/*
+    Evaluates a program at width positions, at most EXPRESSION_BLOCK, storing the potential in energy
+    and the force in force (if not NULL). Each instruction loops over the block, so the loops vectorise.
+    Always inlined, so that a call for a single position loses the loops.
+*/
+static inline __attribute__((always_inline)) void expression_block(const expression_program *prog, const double *x, \
+        double *energy, double *force, int width) {
+    double v[EXPRESSION_MAX_REGISTERS][EXPRESSION_BLOCK]; // Values in each register
+    double d[EXPRESSION_MAX_REGISTERS][EXPRESSION_BLOCK]; // Derivatives with respect to x in each register
+    for (int i = 0; i < width; i++) {
+        // The result register, so a program not yet compiled gives zero
+        v[0][i] = 0;
+        d[0][i] = 0;
+    }
+    for (int k = 0; k < prog->noinstructions; k++) {
+        const expression_instruction *ins = &prog->code[k];
+        double *rv = v[ins->dst], *rd = d[ins->dst];
+        const double *av = v[ins->args[0]], *ad = d[ins->args[0]];
+        const double *bv = v[ins->args[1]], *bd = d[ins->args[1]];
+        const double *cv = v[ins->args[2]];
+        double c = ins->constant;
+        switch (ins->op) {
+            case OP_CONST:
+                for (int i = 0; i < width; i++) { rv[i] = c; rd[i] = 0; }
+                break;
+            case OP_X:
+                for (int i = 0; i < width; i++) { rv[i] = x[i]; rd[i] = 1; }
+                break;
+            case OP_ADD:
+                for (int i = 0; i < width; i++) { rv[i] = av[i] + bv[i]; rd[i] = ad[i] + bd[i]; }
+                break;
+            case OP_SUB:
+                for (int i = 0; i < width; i++) { rv[i] = av[i] - bv[i]; rd[i] = ad[i] - bd[i]; }
+                break;
+            case OP_MUL:
+                for (int i = 0; i < width; i++) {
+                    double value = av[i] * bv[i];
+                    rd[i] = ad[i] * bv[i] + av[i] * bd[i];
+                    rv[i] = value;
+                }
+                break;
+            case OP_DIV:
+                for (int i = 0; i < width; i++) {
+                    double value = av[i] / bv[i];
+                    rd[i] = (ad[i] - value * bd[i]) / bv[i];
+                    rv[i] = value;
+                }
+                break;
+            case OP_NEG:
+                for (int i = 0; i < width; i++) { rv[i] = -av[i]; rd[i] = -ad[i]; }
+                break;
+            case OP_POWI: {
+                int power = (int) fabs(c);
+                for (int i = 0; i < width; i++) {
+                    double lower = 1; // a to the power |c| - 1
+                    for (int m = 1; m < power; m++) lower *= av[i];
+                    double value = lower * av[i];
+                    double deriv = power * lower * ad[i];
+                    rv[i] = (c > 0) ? value : 1 / value;
+                    rd[i] = (c > 0) ? deriv : -deriv / (value * value);
+                }
+                break;
+            }
+            case OP_POW:
+                for (int i = 0; i < width; i++) {
+                    double value = pow(av[i], bv[i]);
+                    // Only a varying exponent needs the log, and a^b log(a) goes to 0 with a^b
+                    double log_term = (bd[i] != 0 && value != 0) ? value * bd[i] * log(av[i]) : 0;
+                    // b a^(b - 1), taken from a^b except at a = 0, where it is not a^b / a
+                    double power_term = (av[i] != 0) ? value * bv[i] / av[i] : bv[i] * pow(av[i], bv[i] - 1);
+                    rd[i] = log_term + power_term * ad[i];
+                    rv[i] = value;
+                }
+                break;
+            case OP_EXP:
+                for (int i = 0; i < width; i++) { rv[i] = exp(av[i]); rd[i] = rv[i] * ad[i]; }
+                break;
+            case OP_LOG:
+                for (int i = 0; i < width; i++) { rd[i] = ad[i] / av[i]; rv[i] = log(av[i]); }
+                break;
+            case OP_SQRT:
+                for (int i = 0; i < width; i++) { rv[i] = sqrt(av[i]); rd[i] = 0.5 * ad[i] / rv[i]; }
+                break;
+            case OP_SIN:
+                for (int i = 0; i < width; i++) { rd[i] = cos(av[i]) * ad[i]; rv[i] = sin(av[i]); }
+                break;
+            case OP_COS:
+                for (int i = 0; i < width; i++) { rd[i] = -sin(av[i]) * ad[i]; rv[i] = cos(av[i]); }
+                break;
+            case OP_TANH:
+                for (int i = 0; i < width; i++) { rv[i] = tanh(av[i]); rd[i] = (1 - rv[i] * rv[i]) * ad[i]; }
+                break;
+            case OP_ABS:
+                for (int i = 0; i < width; i++) { rd[i] = (av[i] < 0) ? -ad[i] : ad[i]; rv[i] = fabs(av[i]); }
+                break;
+            case OP_LT:
+                for (int i = 0; i < width; i++) { rv[i] = av[i] < bv[i]; rd[i] = 0; }
+                break;
+            case OP_LE:
+                for (int i = 0; i < width; i++) { rv[i] = av[i] <= bv[i]; rd[i] = 0; }
+                break;
+            case OP_GT:
+                for (int i = 0; i < width; i++) { rv[i] = av[i] > bv[i]; rd[i] = 0; }
+                break;
+            case OP_GE:
+                for (int i = 0; i < width; i++) { rv[i] = av[i] >= bv[i]; rd[i] = 0; }
+                break;
+            case OP_SELECT:
+                for (int i = 0; i < width; i++) {
+                    int first = cv[i] != 0;
+                    rv[i] = first ? av[i] : bv[i];
+                    rd[i] = first ? ad[i] : bd[i];
+                }
+                break;
+        }
+    }
+    for (int i = 0; i < width; i++) energy[i] = v[0][i];
+    if (force != NULL) {
+        for (int i = 0; i < width; i++) force[i] = -d[0][i];
+    }
+}
+
+// Evaluates a program at n positions, storing the potential in energy and the force in force (if not NULL)
+void expression_eval(const expression_program *prog, const double *x, double *energy, double *force, long n) {
+    for (long start = 0; start < n; start += EXPRESSION_BLOCK) {
+        int width = (n - start < EXPRESSION_BLOCK) ? (int) (n - start) : EXPRESSION_BLOCK;
+        expression_block(prog, &x[start], &energy[start], (force != NULL) ? &force[start] : NULL, width);
+    }
+}
+
+#endif // EXPRESSION_H
@@ -0,0 +1,160 @@
+/*
+	Extrapolation.h
+	Header file for extrapolating the free energy difference to zero timestep. With the
+	EXTRAPOLATE option, a sweep runs the given list of timesteps concurrently for every
+	potential and kT, and the results at each potential and kT are fitted against the
+	timestep by weighted least squares, as F(dt) = F_0 + sum_k c_k * dt^p_k, for the powers
+	p_k of the EXTRAPOLATE_POWERS option (2 by default, the leading timestep bias of
+	configurational averages under the BAOAB methods). Each point is weighted by the inverse
+	square of its standard error over the replicas.
+
+	The standard error of F_0 follows from the covariance of the fit. If the residuals are
+	larger than the errors allow (chi squared per degree of freedom above 1), the error is
+	scaled up by the square root of chi squared per degree of freedom, so that an inadequate
+	model of the bias shows up as a larger error rather than a falsely precise value. If a
+	point has no spread over its replicas, as when both wells have the same shape, the fit
+	is unweighted and the error comes from the residuals alone.
+*/
+
+#ifndef EXTRAPOLATION_H
+#define EXTRAPOLATION_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "Parameters.h"
+#include "Sweep.h"
+
+/* Structure to store the fit of the results at one potential and kT */
+struct extrapolation {
+    double energy_difference; // Free energy difference extrapolated to zero timestep
+    double std_error;         // Standard error of the extrapolated difference
+    double chi_squared;       // Chi squared of the fit per degree of freedom, NAN if the fit is unweighted
+};
+
+typedef struct extrapolation extrapolation;
+
+
+// Reads the powers of the EXTRAPOLATE_POWERS option, returning how many there are
+int fit_powers(parameters *params, double powers[MAX_FIT_POWERS]) {
+    return read_list(params->extrapolate_powers, powers, MAX_FIT_POWERS);
+}
+
+/*
+    Inverts the symmetric positive definite matrix a of size n in place by Gauss-Jordan elimination,
+    returning 0 if it is singular, which happens when there are too few distinct timesteps
+*/
+int invert_matrix(int n, double a[n][n]) {
+    double inv[n][n];
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) inv[i][j] = (i == j);
+    }
+    for (int col = 0; col < n; col++) {
+        int pivot = col;
+        for (int i = col + 1; i < n; i++) {
+            if (fabs(a[i][col]) > fabs(a[pivot][col])) pivot = i;
+        }
+        if (a[pivot][col] == 0) return 0;
+        for (int j = 0; j < n; j++) {
+            double tmp = a[col][j]; a[col][j] = a[pivot][j]; a[pivot][j] = tmp;
+            tmp = inv[col][j]; inv[col][j] = inv[pivot][j]; inv[pivot][j] = tmp;
+        }
+        double scale = a[col][col];
+        for (int j = 0; j < n; j++) {
+            a[col][j] /= scale;
+            inv[col][j] /= scale;
+        }
+        for (int i = 0; i < n; i++) {
+            if (i == col) continue;
+            double factor = a[i][col];
+            for (int j = 0; j < n; j++) {
+                a[i][j] -= factor * a[col][j];
+                inv[i][j] -= factor * inv[col][j];
+            }
+        }
+    }
+    memcpy(a, inv, sizeof(inv));
+    return 1;
+}
+
+// Fits the differences at nosteps timesteps, with their standard errors, and extrapolates them to zero timestep
+extrapolation extrapolate(double *timesteps, double *diffs, double *std_errors, long nosteps, double *powers, \
+        int nopowers) {
+    int noterms = nopowers + 1; // The constant F_0 and one term for each power
+    int weighted = 1; // Indicates that every point has a standard error to weight it by
+    for (long i = 0; i < nosteps; i++) {
+        if (!(std_errors[i] > 0)) weighted = 0;
+    }
+    double normal[noterms][noterms]; // Normal matrix of the weighted fit, then its inverse
+    double rhs[noterms];
+    for (int k = 0; k < noterms; k++) {
+        rhs[k] = 0;
+        for (int j = 0; j < noterms; j++) normal[k][j] = 0;
+    }
+
+    for (long i = 0; i < nosteps; i++) {
+        double basis[noterms]; // Terms of the fit at this timestep
+        basis[0] = 1;
+        for (int k = 0; k < nopowers; k++) basis[k + 1] = pow(timesteps[i], powers[k]);
+        double weight = weighted ? 1 / (std_errors[i] * std_errors[i]) : 1;
+        for (int k = 0; k < noterms; k++) {
+            rhs[k] += weight * basis[k] * diffs[i];
+            for (int j = 0; j < noterms; j++) normal[k][j] += weight * basis[k] * basis[j];
+        }
+    }
+
+    extrapolation fit = {NAN, NAN, 0};
+    if (!invert_matrix(noterms, normal)) return fit;
+    double coeffs[MAX_FIT_POWERS + 1] = {0}; // Coefficients of the fit, F_0 first
+    for (int k = 0; k < noterms; k++) {
+        for (int j = 0; j < noterms; j++) coeffs[k] += normal[k][j] * rhs[j];
+    }
+
+    double chi_squared = 0;
+    for (long i = 0; i < nosteps; i++) {
+        double model = coeffs[0];
+        for (int k = 0; k < nopowers; k++) model += coeffs[k + 1] * pow(timesteps[i], powers[k]);
+        double weight = weighted ? 1 / (std_errors[i] * std_errors[i]) : 1;
+        chi_squared += weight * (diffs[i] - model) * (diffs[i] - model);
+    }
+    long dof = nosteps - noterms; // Degrees of freedom of the fit, at least 1 (see Parameters.h)
+    fit.energy_difference = coeffs[0];
+    fit.chi_squared = chi_squared / dof;
+    if (weighted) {
+        fit.std_error = sqrt(normal[0][0] * ((fit.chi_squared > 1) ? fit.chi_squared : 1));
+    } else {
+        fit.std_error = sqrt(normal[0][0] * fit.chi_squared);
+        fit.chi_squared = NAN;
+    }
+    return fit;
+}
+
+// Writes the differences of every potential and kT of a sweep extrapolated to zero timestep, and the exact differences
+void write_extrapolation_table(sweep *s, double *means, double *std_errors, double *exact, char *filename) {
+    FILE *table_file = fopen(filename, "w");
+    if (table_file == NULL) {
+        printf("Failed to open extrapolation file %s\n", filename);
+        exit(1);
+    }
+    double powers[MAX_FIT_POWERS];
+    int nopowers = fit_powers(&s->points[0], powers);
+
+    fprintf(table_file, "Potential Name, Dynamics Type, No of steps, Timesteps, kT, Zero timestep diff, Std error, " \
+            "Chi squared per dof, Exact diff\n");
+    for (long p = 0; p < s->nopotentials; p++) {
+        for (long i = 0; i < s->nokT; i++) {
+            long first = sweep_point(s, p, i, 0); // The timesteps of each potential and kT are consecutive points
+            double timesteps[s->nosteps];
+            for (long j = 0; j < s->nosteps; j++) timesteps[j] = s->points[first + j].timestep;
+            extrapolation fit = extrapolate(timesteps, &means[first], &std_errors[first], s->nosteps, powers, nopowers);
+            parameters *params = &s->points[first];
+            fprintf(table_file, "%s, %s, %ld, %ld, %lf, %g, %g, %g, %.12g\n", params->potential_name, \
+                    params->dynamics_type, params->tot_steps, s->nosteps, params->kT, fit.energy_difference, \
+                    fit.std_error, fit.chi_squared, exact[first * MAX_WELLS + 1]);
+        }
+    }
+    fclose(table_file);
+}
+
+#endif // EXTRAPOLATION_H
@@ -0,0 +1,169 @@
+/*
+	Histogram.h
+	Header file for counting how many times walkers visit each bin. The bin of a position
+	is computed directly from its distance to x_min, and positions outside [x_min, x_max)
+	are counted in separate underflow and overflow bins. Every replica fills its own
+	histogram, and the histograms are merged in replica order once the replicas finish.
+
+	Multi-dimensional walkers (see Configuration.h) can also fill a 2-D histogram of the
+	first two coordinates of every particle, whose axes are binned in the same way.
+*/
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "Parameters.h"
+
+/* Structure to store a histogram */
+struct histogram {
+    double x_min;     // Position of the left edge of the first bin
+    double x_max;     // Position of the right edge of the last bin
+    double inv_width; // One over the width of a bin
+    long nobins;      // Number of bins between x_min and x_max
+    long *counts;     // counts[0] is the underflow bin, counts[1..nobins] the bins, counts[nobins + 1] the overflow bin
+};
+
+typedef struct histogram histogram;
+
+
+// Allocates an empty histogram with the bins given in the parameters
+void init_histogram(histogram *h, parameters *params) {
+    h->x_min = params->x_min;
+    h->x_max = params->x_max;
+    h->inv_width = 1 / params->bin_width;
+    h->nobins = params->nobins;
+    h->counts = calloc(params->nobins + 2, sizeof(long));
+    if (h->counts == NULL) {
+        printf("Failed to allocate histogram\n");
+        exit(1);
+    }
+}
+
+void free_histogram(histogram *h) {
+    free(h->counts);
+}
+
+// Returns the index in counts of the bin containing x
+static inline long histogram_index(histogram *h, double x) {
+    double pos = (x - h->x_min) * h->inv_width; // Position of x in units of bins
+    if (pos < 0) return 0;
+    if (!(x < h->x_max)) return h->nobins + 1; // Also catches NaN
+    long j = (long) pos + 1;
+    return (j > h->nobins) ? h->nobins : j; // Guards against rounding just below x_max
+}
+
+// Adds a visit at x to the histogram
+static inline void histogram_add(histogram *h, double x) {
+    h->counts[histogram_index(h, x)]++;
+}
+
+// Adds a visit at every position in an array to the histogram
+void histogram_add_array(histogram *h, const double *x, long n) {
+    for (long i = 0; i < n; i++) h->counts[histogram_index(h, x[i])]++;
+}
+
+// Adds the counts of one histogram to another with the same bins
+void histogram_merge(histogram *total, histogram *shard) {
+    for (long j = 0; j < total->nobins + 2; j++) total->counts[j] += shard->counts[j];
+}
+
+/*
+    Writes the histogram with every "coarsen" neighbouring bins combined (1 keeps the original bins).
+    The underflow and overflow bins are written first as comment lines, followed by lines of the
+    position of the right edge of each bin and the number of visits.
+*/
+void write_histogram(histogram *h, long coarsen, char *filename) {
+    FILE *bins_file = fopen(filename, "w");
+    if (bins_file == NULL) {
+        printf("Failed to open bins file %s\n", filename);
+        exit(1);
+    }
+    double width = coarsen / h->inv_width; // Width of the written bins
+    fprintf(bins_file, "# underflow, %ld\n", h->counts[0]);
+    fprintf(bins_file, "# overflow, %ld\n", h->counts[h->nobins + 1]);
+    for (long j = 1; j <= h->nobins / coarsen; j++) {
+        long count = 0; // Number of visits to the written bin
+        for (long k = (j - 1) * coarsen + 1; k <= j * coarsen; k++) count += h->counts[k];
+        fprintf(bins_file, "%g, %ld\n", h->x_min + j * width, count);
+    }
+    fclose(bins_file);
+}
+
+
+/* Structure to store a 2-D histogram of the first two coordinates */
+struct histogram_2d {
+    histogram x_axis; // Bins of the first coordinate, without counts of their own
+    histogram y_axis; // Bins of the second coordinate, without counts of their own
+    long *counts;     // counts[jx * (y_axis.nobins + 2) + jy] for the indices jx and jy of each axis
+};
+
+typedef struct histogram_2d histogram_2d;
+
+
+// Allocates an empty 2-D histogram with the bins given in the parameters
+void init_histogram_2d(histogram_2d *h, parameters *params) {
+    h->x_axis.x_min = params->x_min;
+    h->x_axis.x_max = params->x_max;
+    h->x_axis.inv_width = 1 / params->bin_width;
+    h->x_axis.nobins = params->nobins;
+    h->x_axis.counts = NULL;
+    h->y_axis.x_min = params->y_min;
+    h->y_axis.x_max = params->y_max;
+    h->y_axis.inv_width = params->noybins / (params->y_max - params->y_min);
+    h->y_axis.nobins = params->noybins;
+    h->y_axis.counts = NULL;
+    h->counts = calloc((params->nobins + 2) * (params->noybins + 2), sizeof(long));
+    if (h->counts == NULL) {
+        printf("Failed to allocate 2-D histogram\n");
+        exit(1);
+    }
+}
+
+void free_histogram_2d(histogram_2d *h) {
+    free(h->counts);
+}
+
+// Adds a visit at every pair of positions (x[i], y[i]) to the histogram
+void histogram_2d_add_array(histogram_2d *h, const double *x, const double *y, long n) {
+    long stride = h->y_axis.nobins + 2; // Number of counts for each bin of x
+    for (long i = 0; i < n; i++) {
+        h->counts[histogram_index(&h->x_axis, x[i]) * stride + histogram_index(&h->y_axis, y[i])]++;
+    }
+}
+
+// Adds the counts of one 2-D histogram to another with the same bins
+void histogram_2d_merge(histogram_2d *total, histogram_2d *shard) {
+    long nocounts = (total->x_axis.nobins + 2) * (total->y_axis.nobins + 2);
+    for (long j = 0; j < nocounts; j++) total->counts[j] += shard->counts[j];
+}
+
+/*
+    Writes the 2-D histogram. The number of visits outside the bins is written first as a comment
+    line, followed by lines of the right and upper edges of each bin and the number of visits.
+*/
+void write_histogram_2d(histogram_2d *h, char *filename) {
+    FILE *bins_file = fopen(filename, "w");
+    if (bins_file == NULL) {
+        printf("Failed to open bins file %s\n", filename);
+        exit(1);
+    }
+    long nox = h->x_axis.nobins, noy = h->y_axis.nobins;
+    long outside = 0; // Number of visits outside the bins
+    for (long jx = 0; jx < nox + 2; jx++) {
+        for (long jy = 0; jy < noy + 2; jy++) {
+            if (jx == 0 || jx == nox + 1 || jy == 0 || jy == noy + 1) outside += h->counts[jx * (noy + 2) + jy];
+        }
+    }
+    fprintf(bins_file, "# outside, %ld\n", outside);
+    for (long jx = 1; jx <= nox; jx++) {
+        for (long jy = 1; jy <= noy; jy++) {
+            fprintf(bins_file, "%g, %g, %ld\n", h->x_axis.x_min + jx / h->x_axis.inv_width, \
+                    h->y_axis.x_min + jy / h->y_axis.inv_width, h->counts[jx * (noy + 2) + jy]);
+        }
+    }
+    fclose(bins_file);
+}
+
+#endif // HISTOGRAM_H
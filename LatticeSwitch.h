@@ -0,0 +1,92 @@
+/*
+	LatticeSwitch.h
+	Header file for the C API of the lattice switch library (liblattice_switch.so, built by
+	compile.sh from library.c), for running the method inside another program, such as the
+	Python bindings in data_analysis/lattice_switch.py. Only these functions are exported,
+	and their behaviour is kept stable between versions: LS_API_VERSION changes if it is not.
+
+	A run is created from the text of an input file, in the same format as for the program,
+	and holds every replica of every parameter point of its sweep. It advances the replicas
+	in steps chosen by the caller, and its estimates, per-replica differences and histogram
+	can be read at any point. The arrays returned by a run stay at the same address, and are
+	updated in place by ls_step, until the run is freed, so they can be mapped once without
+	copying. A run whose input has an error is not created, and the error is left for
+	ls_last_error. The TABULATED table and the EXPRESSION formula are shared by the process,
+	so while a run using either is live, a new run may not give a different TABLE, EXPRESSION
+	or MINIMA.
+*/
+
+#ifndef LATTICE_SWITCH_H
+#define LATTICE_SWITCH_H
+
+#include <stdint.h>
+
+#define LS_API_VERSION 2 // Version of the API, increased when it changes incompatibly
+
+#define LS_API __attribute__((visibility("default")))
+
+// Opaque handle of a run
+typedef struct ls_run ls_run;
+
+/* Structure to describe a parameter point of a run */
+struct ls_point_info {
+    char potential_name[256];
+    char dynamics_type[256];
+    double kT;
+    double step;    // Timestep, or width of the Monte-Carlo moves
+    long tot_steps; // Number of steps each replica runs for
+};
+
+typedef struct ls_point_info ls_point_info;
+
+LS_API int ls_api_version(void);
+
+/*
+    Creates a run from the text of an input file, with histograms of the positions if savebins is set, or
+    returns NULL if the input has an error
+*/
+LS_API ls_run *ls_create(const char *input_text, uint64_t seed, int savebins);
+
+// Creates a run from an input file, or returns NULL if it cannot be read or has an error
+LS_API ls_run *ls_create_from_file(const char *input_filename, uint64_t seed, int savebins);
+
+// Returns the error which stopped the last run from being created, or an empty string if it was created
+LS_API const char *ls_last_error(void);
+
+LS_API void ls_free(ls_run *run);
+
+LS_API long ls_nopoints(const ls_run *run);
+LS_API int ls_noreplicas(const ls_run *run);
+LS_API void ls_point(const ls_run *run, long point, ls_point_info *info);
+
+// Advances every unfinished replica by up to nosteps steps, returning the number of replicas still running
+LS_API long ls_step(ls_run *run, long nosteps);
+
+// Runs every replica to the end
+LS_API void ls_run_to_completion(ls_run *run);
+
+// Stores the mean free energy difference of a point over its replicas, and its standard error
+LS_API void ls_estimate(const ls_run *run, long point, double *mean, double *std_error);
+
+/*
+    Returns the exact free energy difference F_0 - F_k of a point between the first well and well k (1 for
+    two wells), from the integrals of the Boltzmann factor over the wells, or NAN if it has no such well
+*/
+LS_API double ls_exact_difference(const ls_run *run, long point, int well);
+
+// Returns the free energy difference of every replica, noreplicas for each point in turn, NAN until it has a sample
+LS_API const double *ls_replica_differences(const ls_run *run);
+
+// Returns the number of steps each replica has run, in the same order
+LS_API const long *ls_replica_steps(const ls_run *run);
+
+/*
+    Returns the histogram of every replica together, nobins + 2 counts with the underflow bin first and
+    the overflow bin last, and stores its number of bins and range, or NULL if the run saves no bins
+*/
+LS_API const long *ls_bins(const ls_run *run, long *nobins, double *x_min, double *x_max);
+
+// Evaluates the potential of a point, unshifted, at n positions
+LS_API void ls_potential(const ls_run *run, long point, const double *x, double *V, long n);
+
+#endif // LATTICE_SWITCH_H
@@ -9,40 +9,84 @@
 #define PARAMETERS_H
 
 #include "Potentials.h"
+#include "Tabulated.h"
+#include "Proposal.h"
+
+#define MAX_FIT_POWERS 4 // Number of powers of the timestep the timestep bias can be fitted with (see Extrapolation.h)
 
 /* Structure to store relevant parameters */
 struct parameters {
     /* Numerical parameters */
     char dynamics_type[256];  // Indicates which dynamics to move (either BAOAB limit, regular BAOAB or Monte-Carlo
-    char potential_name[256]; // Name of the potential (either KT, DIFF_WIDTH or QUARTIC)
+    char potential_name[256]; // Name of the potential (either KT, DIFF_WIDTH, QUARTIC, TRIPLE, TABULATED or EXPRESSION)
     long tot_steps;           // Total number of steps to run the simulation for
-    int start_well;           // Which well to start the walker in, 0 is left well, 1 is right well
+    int start_well;           // Which well to start the walker in, 0 is left well, 1 is right well (wells numbered from the left)
     int switch_regularity;    // How many dynamics steps between each switch attempt
+    int noreplicas;           // Number of independent replicas used to calculate the mean and standard error
+    int nothreads;            // Number of threads to run the replicas on (0 uses every available core)
+    long nowalkers;           // Number of walkers advanced together in each replica (see Ensemble.h)
+    double tolerance;         // Standard error of the mean at which replicas stop early, 0 to always run tot_steps
+    long block_steps;         // Initial number of steps in each block used to estimate the error (see Convergence.h)
+    long checkpoint_steps;    // Number of steps between checkpoints of each replica, 0 for none (see Checkpoint.h)
+    int binary_store;         // Indicates that results are stored as binary records rather than text (see ResultStore.h)
+    int estimators;           // Indicates that the lattice switch attempts also estimate the free energy difference (see Estimators.h)
+    long bias_steps;          // Number of burn-in steps over which an adaptive bias is built, 0 for no bias (see Bias.h)
+    double bias_height;       // Height of each deposit of the bias at zero bias, in units of kT
+    double bias_factor;       // Bias factor of the well-tempered deposits, above 1
+    long stream_decimation;   // Number of steps between streamed samples of each trajectory, 0 for no streaming (see Stream.h)
+    long stream_histogram;    // Number of steps between streamed snapshots of each histogram, 0 for none
+    long stream_block;        // Number of bytes of events in each compressed block of the stream
 
     /* Bin parameters */
     double x_min;     // Position of far left bin
     double x_max;     // Position of far right bin
     long nobins;      // Number of bins
     double bin_width; // Width of a bin
+    long coarsen;     // Number of bins combined into each bin of the additional coarse histogram (1 for none)
+    long noybins;     // Number of bins of the second coordinate in the 2-D histogram, 0 for none (see Histogram.h)
+    double y_min;     // Position of the lowest bin of the second coordinate
+    double y_max;     // Position of the highest bin of the second coordinate
+
+    /* Multi-dimensional walkers (see Configuration.h) */
+    int dim;          // Number of dimensions of each particle
+    long noparticles; // Number of particles of each walker
 
     /* Physical parameters */
     double kT;          // Boltzmann constant (k) multiplied by the temperature (T)
     double mass;        // Mass of particles
     double shift_value; // Amount the right minima has to be shifted to be level with the left minima
-    double minima[2];   // x-coordinates of the left and right minima, respectively
+    int nowells;        // Number of wells of the potential, more than 2 for the N-well mode
+    double minima[MAX_WELLS];         // x-coordinates of the minima of the wells, from left to right
+    double boundaries[MAX_WELLS - 1]; // Boundaries between neighbouring wells (0 for two wells)
+    double shifts[MAX_WELLS];         // Amount each well is shifted to be level with the left well
 
     /* BAOAB and BAOAB limit parameters */
-    double timestep; // Physical timestep size
-    double R[2];     // Array to store two normally distributed numbers, used in the BAOAB method (see Dynamics.h)
+    double timestep;    // Physical timestep size
+    double drift_const; // Coefficient of the force in the BAOAB limit step of ensembles and configurations, timestep / mass
+    double noise_const; // Coefficient of the noise in the BAOAB limit step, sqrt(kT * timestep / (2 * mass))
 
-    // // Specific to the regular BAOAB method
-    // double friction_param;
-    // double const1;
-    // double const2;
-    // double const3;
+    // Specific to the regular BAOAB method
+    double friction_param; // Friction coefficient
+    double half_timestep;  // Coefficient of the force in each B step, timestep / 2
+    double half_drift;     // Coefficient of the momentum in each A step, timestep / (2 * mass)
+    double ou_decay;       // Factor by which the O step damps the momentum, exp(-friction_param * timestep)
+    double ou_noise;       // Coefficient of the noise in the O step, sqrt(mass * kT * (1 - ou_decay^2))
 
     // Specific to the Monte-Carlo method
-    double jump_size; // Jump size in x
+    double jump_size;         // Jump size in x, the initial proposal width of both wells if they are adapted
+    long adapt_steps;         // Number of burn-in steps over which the proposal widths are tuned, 0 for none (see Proposal.h)
+    double target_acceptance; // Acceptance rate the proposal widths are tuned towards
+    int gaussian_proposal;    // Indicates that proposals are normally distributed rather than uniform
+    int tries;                // Number of proposals in each multiple-try move, 1 for the plain Metropolis method
+
+    /* Sweep parameters (see Sweep.h), each range being the minimum, increment and maximum */
+    double sweep_kT[3];         // Range of kT, unused if the increment is 0
+    double sweep_step[3];       // Range of the timestep (BAOAB limit) or jump size (Monte-Carlo), unused if the increment is 0
+    char sweep_potentials[256]; // Comma separated names of the potentials to sweep over, unused if empty
+    char kT_ladder[256];        // Comma separated values of kT to sweep over, in increasing order, replacing sweep_kT if not empty
+    long exchange_steps;        // Number of steps between exchanges across the kT sweep, 0 for no parallel tempering (see Tempering.h)
+    char extrapolate[256];        // Comma separated timesteps to extrapolate to zero timestep from, unused if empty (see Extrapolation.h)
+    char extrapolate_powers[256]; // Comma separated powers of the timestep in the fit of the timestep bias
 
     /* Function pointers to functions specific to the chosen potential */
     PotentialFun Poten;         // Potential function
@@ -90,13 +134,363 @@ void read_int(FILE *input_file, int *int_value) {
     }
 }
 
-// Reads an input file to store the parameters
-void store_parameters(parameters *params, char *input_filename) {
-    FILE *input_file = fopen(input_filename, "r");
-    if (input_file == NULL) {
-        printf("Failed to open input file \n");
+// Reads the comma separated values of a list, up to maxvalues of them, returning how many there are
+int read_list(char *list, double *values, int maxvalues) {
+    char copy[256]; // Copy of the list, which strtok modifies
+    strcpy(copy, list);
+    int novalues = 0;
+    for (char *value = strtok(copy, ","); value != NULL && novalues < maxvalues; value = strtok(NULL, ",")) {
+        values[novalues++] = atof(value);
+    }
+    return novalues;
+}
+
+// Reads the optional lines at the end of an input file, each of the form "NAME value"
+void read_options(FILE *input_file, parameters *params) {
+    char option_name[256]; // Name of the option on the current line
+    while (fscanf(input_file, "%255s", option_name) == 1) {
+        if (strcmp(option_name, "REPLICAS") == 0) {
+            read_int(input_file, &params->noreplicas);
+        } else if (strcmp(option_name, "THREADS") == 0) {
+            read_int(input_file, &params->nothreads);
+        } else if (strcmp(option_name, "WALKERS") == 0) {
+            read_long(input_file, &params->nowalkers);
+        } else if (strcmp(option_name, "TOLERANCE") == 0) {
+            read_double(input_file, &params->tolerance);
+        } else if (strcmp(option_name, "BLOCK_STEPS") == 0) {
+            read_long(input_file, &params->block_steps);
+        } else if (strcmp(option_name, "CHECKPOINT") == 0) {
+            read_long(input_file, &params->checkpoint_steps);
+        } else if (strcmp(option_name, "STORE") == 0) {
+            char store_format[256]; // Either TEXT or BINARY
+            if (fscanf(input_file, "%255s", store_format) != 1) {
+                printf("Failed to read parameter\n");
+                exit(1);
+            }
+            if (strcmp(store_format, "BINARY") == 0) {
+                params->binary_store = 1;
+            } else if (strcmp(store_format, "TEXT") == 0) {
+                params->binary_store = 0;
+            } else {
+                printf("Unknown store format %s\n", store_format);
+                exit(1);
+            }
+        } else if (strcmp(option_name, "ESTIMATORS") == 0) {
+            char estimators[256]; // Either OCCUPANCY or ALL
+            if (fscanf(input_file, "%255s", estimators) != 1) {
+                printf("Failed to read parameter\n");
+                exit(1);
+            }
+            if (strcmp(estimators, "ALL") == 0) {
+                params->estimators = 1;
+            } else if (strcmp(estimators, "OCCUPANCY") == 0) {
+                params->estimators = 0;
+            } else {
+                printf("Unknown estimators %s\n", estimators);
+                exit(1);
+            }
+        } else if (strcmp(option_name, "STREAM") == 0) {
+            read_long(input_file, &params->stream_decimation);
+        } else if (strcmp(option_name, "STREAM_HISTOGRAM") == 0) {
+            read_long(input_file, &params->stream_histogram);
+        } else if (strcmp(option_name, "STREAM_BLOCK") == 0) {
+            read_long(input_file, &params->stream_block);
+        } else if (strcmp(option_name, "ADAPT_STEPS") == 0) {
+            read_long(input_file, &params->adapt_steps);
+        } else if (strcmp(option_name, "TARGET_ACCEPTANCE") == 0) {
+            read_double(input_file, &params->target_acceptance);
+        } else if (strcmp(option_name, "PROPOSAL") == 0) {
+            char proposal_type[256]; // Either UNIFORM or GAUSSIAN
+            if (fscanf(input_file, "%255s", proposal_type) != 1) {
+                printf("Failed to read parameter\n");
+                exit(1);
+            }
+            if (strcmp(proposal_type, "GAUSSIAN") == 0) {
+                params->gaussian_proposal = 1;
+            } else if (strcmp(proposal_type, "UNIFORM") == 0) {
+                params->gaussian_proposal = 0;
+            } else {
+                printf("Unknown proposal %s\n", proposal_type);
+                exit(1);
+            }
+        } else if (strcmp(option_name, "KT_LADDER") == 0) {
+            if (fscanf(input_file, "%255s", params->kT_ladder) != 1) {
+                printf("Failed to read parameter\n");
+                exit(1);
+            }
+        } else if (strcmp(option_name, "EXTRAPOLATE") == 0) {
+            if (fscanf(input_file, "%255s", params->extrapolate) != 1) {
+                printf("Failed to read parameter\n");
+                exit(1);
+            }
+        } else if (strcmp(option_name, "EXTRAPOLATE_POWERS") == 0) {
+            if (fscanf(input_file, "%255s", params->extrapolate_powers) != 1) {
+                printf("Failed to read parameter\n");
+                exit(1);
+            }
+        } else if (strcmp(option_name, "TABLE") == 0) {
+            char table_filename[256]; // File of samples of the TABULATED potential (see Tabulated.h)
+            if (fscanf(input_file, "%255s", table_filename) != 1) {
+                printf("Failed to read parameter\n");
+                exit(1);
+            }
+            load_table(table_filename);
+        } else if (strcmp(option_name, "EXPRESSION") == 0) {
+            char formula[1024]; // The rest of the line, as the formula may contain spaces (see Expression.h)
+            if (fgets(formula, sizeof(formula), input_file) == NULL) {
+                printf("Failed to read parameter\n");
+                exit(1);
+            }
+            formula[strcspn(formula, "\r\n")] = '\0';
+            compile_expression(&EXPRESSION_PROGRAM, formula + strspn(formula, " \t"));
+        } else if (strcmp(option_name, "MINIMA") == 0) {
+            char minima[256]; // Comma separated minima of the EXPRESSION potential, from left to right
+            if (fscanf(input_file, "%255s", minima) != 1) {
+                printf("Failed to read parameter\n");
+                exit(1);
+            }
+            EXPRESSION_NOMINIMA = read_list(minima, EXPRESSION_MINIMA, MAX_WELLS);
+        } else if (strcmp(option_name, "TEMPERING") == 0) {
+            read_long(input_file, &params->exchange_steps);
+        } else if (strcmp(option_name, "BIAS") == 0) {
+            read_long(input_file, &params->bias_steps);
+        } else if (strcmp(option_name, "BIAS_HEIGHT") == 0) {
+            read_double(input_file, &params->bias_height);
+        } else if (strcmp(option_name, "BIAS_FACTOR") == 0) {
+            read_double(input_file, &params->bias_factor);
+        } else if (strcmp(option_name, "TRIES") == 0) {
+            read_int(input_file, &params->tries);
+        } else if (strcmp(option_name, "DIMENSIONS") == 0) {
+            read_int(input_file, &params->dim);
+        } else if (strcmp(option_name, "PARTICLES") == 0) {
+            read_long(input_file, &params->noparticles);
+        } else if (strcmp(option_name, "BINS_2D") == 0) {
+            read_long(input_file, &params->noybins);
+            read_double(input_file, &params->y_min);
+            read_double(input_file, &params->y_max);
+        } else if (strcmp(option_name, "COARSEN") == 0) {
+            read_long(input_file, &params->coarsen);
+        } else if (strcmp(option_name, "SWEEP_KT") == 0) {
+            for (int k = 0; k < 3; k++) read_double(input_file, &params->sweep_kT[k]);
+        } else if ((strcmp(option_name, "SWEEP_TIMESTEP") == 0) || (strcmp(option_name, "SWEEP_JUMP_SIZE") == 0)) {
+            for (int k = 0; k < 3; k++) read_double(input_file, &params->sweep_step[k]);
+        } else if (strcmp(option_name, "SWEEP_POTENTIALS") == 0) {
+            if (fscanf(input_file, "%255s", params->sweep_potentials) != 1) {
+                printf("Failed to read parameter\n");
+                exit(1);
+            }
+        } else {
+            printf("Unknown option %s\n", option_name);
+            exit(1);
+        }
+    }
+
+    if (params->noreplicas < 1) {
+        printf("Number of replicas must be at least 1\n");
         exit(1);
     }
+    if (params->nowalkers < 1) {
+        printf("Number of walkers must be at least 1\n");
+        exit(1);
+    }
+    if (params->tolerance < 0 || params->block_steps < 1) {
+        printf("Tolerance must not be negative and blocks must have at least 1 step\n");
+        exit(1);
+    }
+    if (params->checkpoint_steps < 0) {
+        printf("Checkpoint interval must not be negative\n");
+        exit(1);
+    }
+    int monte_carlo = (strcmp(params->dynamics_type, "MONTE-CARLO") == 0);
+    if (params->adapt_steps < 0 || params->adapt_steps >= params->tot_steps || \
+        params->target_acceptance <= 0 || params->target_acceptance >= 1) {
+        printf("Burn-in must be shorter than the run and the target acceptance between 0 and 1\n");
+        exit(1);
+    }
+    if (params->tries < 1 || params->tries > MAX_TRIES) {
+        printf("Number of tries must be between 1 and %d\n", MAX_TRIES);
+        exit(1);
+    }
+    if (!monte_carlo && (params->adapt_steps > 0 || params->gaussian_proposal || params->tries > 1)) {
+        printf("Proposal options are only for the Monte-Carlo method\n");
+        exit(1);
+    }
+    if (params->nowalkers > 1 && (params->gaussian_proposal || params->tries > 1)) {
+        printf("Gaussian and multiple-try proposals need a single walker per replica\n");
+        exit(1);
+    }
+    if (params->exchange_steps < 0) {
+        printf("Number of steps between exchanges must not be negative\n");
+        exit(1);
+    }
+    if (params->exchange_steps > 0 && (params->nowalkers > 1 || params->tolerance > 0 || \
+        params->checkpoint_steps > 0 || params->adapt_steps > 0)) {
+        printf("Parallel tempering needs a single walker per replica, and no tolerance, checkpoints or burn-in\n");
+        exit(1);
+    }
+    if (params->dim < 1 || params->noparticles < 1) {
+        printf("Walkers must have at least 1 dimension and 1 particle\n");
+        exit(1);
+    }
+    if (params->noybins < 0 || (params->noybins > 0 && (params->dim < 2 || params->y_max <= params->y_min))) {
+        printf("2-D histogram needs at least 2 dimensions and y_max above y_min\n");
+        exit(1);
+    }
+    if ((params->dim > 1 || params->noparticles > 1) && (params->nowalkers > 1 || params->exchange_steps > 0 || \
+        params->estimators || params->tolerance > 0 || params->checkpoint_steps > 0 || params->adapt_steps > 0 || \
+        params->binary_store || params->gaussian_proposal || params->tries > 1)) {
+        printf("Multi-dimensional walkers need a single walker per replica and text results, without tempering, " \
+               "switch estimators, tolerance, checkpoints or proposal options\n");
+        exit(1);
+    }
+    if (params->stream_decimation < 0 || params->stream_histogram < 0 || params->stream_block < 1024 || \
+        (params->stream_histogram > 0 && params->stream_decimation == 0)) {
+        printf("Streaming intervals must not be negative, blocks must have at least 1024 bytes, " \
+               "and histogram snapshots need STREAM\n");
+        exit(1);
+    }
+    if (params->stream_decimation > 0 && (params->nowalkers > 1 || params->exchange_steps > 0 || \
+        params->dim > 1 || params->noparticles > 1)) {
+        printf("Streaming needs a single walker of one particle per replica, without tempering\n");
+        exit(1);
+    }
+    if (params->coarsen < 1 || params->nobins % params->coarsen != 0) {
+        printf("Coarsening factor must divide the number of bins\n");
+        exit(1);
+    }
+    if (params->sweep_kT[1] < 0 || params->sweep_step[1] < 0) {
+        printf("Sweep increments must not be negative\n");
+        exit(1);
+    }
+    if (params->extrapolate[0] != '\0') {
+        double timesteps[64], powers[MAX_FIT_POWERS];
+        int notimesteps = read_list(params->extrapolate, timesteps, 64);
+        int nopowers = read_list(params->extrapolate_powers, powers, MAX_FIT_POWERS);
+        if (monte_carlo || params->sweep_step[1] != 0 || params->noreplicas < 2 || nopowers < 1 || \
+            notimesteps < nopowers + 2) {
+            printf("Extrapolation needs timestep dynamics without SWEEP_TIMESTEP, at least 2 replicas, " \
+                   "and more timesteps than powers plus 1\n");
+            exit(1);
+        }
+        for (int i = 0; i < notimesteps; i++) {
+            if (timesteps[i] <= 0) {
+                printf("Timesteps to extrapolate from must be positive\n");
+                exit(1);
+            }
+        }
+    }
+}
+
+// Sets the parameters which are derived from the others, called whenever those change
+void set_derived_parameters(parameters *params) {
+    params->bin_width = (params->x_max - params->x_min) / params->nobins;
+
+    if (strcmp(params->dynamics_type, "BAOAB_LIMIT") == 0) {
+        params->drift_const = params->timestep / params->mass;
+        params->noise_const = sqrt(0.5 * params->kT * params->timestep / params->mass);
+    } else if (strcmp(params->dynamics_type, "BAOAB_REGULAR") == 0) {
+        params->half_timestep = 0.5 * params->timestep;
+        params->half_drift = 0.5 * params->timestep / params->mass;
+        params->ou_decay = exp(-params->friction_param * params->timestep);
+        params->ou_noise = sqrt(params->mass * params->kT * (1 - params->ou_decay * params->ou_decay));
+    } else if (strcmp(params->dynamics_type, "MONTE-CARLO") != 0) {
+        printf("Unknown dynamics %s\n", params->dynamics_type);
+        exit(1);
+    }
+
+    well_layout wells; // Wells of the potential
+    PotentialFun func_arr[] = {0, 0, 0}; // Array for potential functions
+    Poten_selector(&wells, func_arr, params->potential_name); // Fills the wells and function arrays
+    if (func_arr[0] == 0 && strcmp(params->potential_name, "TABULATED") == 0) {
+        printf("The TABULATED potential needs a TABLE file\n");
+        exit(1);
+    } else if (func_arr[0] == 0 && strcmp(params->potential_name, "EXPRESSION") == 0) {
+        printf("The EXPRESSION potential needs an EXPRESSION and at least two MINIMA\n");
+        exit(1);
+    } else if (func_arr[0] == 0) {
+        printf("Unknown potential %s\n", params->potential_name);
+        exit(1);
+    }
+
+    params->Poten = func_arr[0];
+    params->Poten_shifted = func_arr[1];
+    params->Poten_deriv = func_arr[2];
+
+    params->nowells = wells.nowells;
+    for (int k = 0; k < wells.nowells; k++) {
+        params->minima[k] = wells.minima[k]; // x-coordinates of the minima of the wells
+        params->shifts[k] = wells.shifts[k];
+        if (k + 1 < wells.nowells) params->boundaries[k] = wells.boundaries[k];
+    }
+    params->shift_value = wells.shifts[1]; // The amount the right minima has been shifted upwards
+
+    if (params->start_well < 0 || params->start_well >= params->nowells) {
+        printf("Starting well must be one of the %d wells of %s\n", params->nowells, params->potential_name);
+        exit(1);
+    }
+    if (params->nowells > 2 && (params->nowalkers > 1 || params->exchange_steps > 0 || params->estimators || \
+        params->tolerance > 0 || params->adapt_steps > 0 || params->binary_store)) {
+        printf("Potentials with more than two wells need a single walker and text results, without tempering, " \
+               "switch estimators, tolerance or burn-in\n");
+        exit(1);
+    }
+    if (params->nowells > 2 && (params->dim > 1 || params->noparticles > 1)) {
+        printf("Multi-dimensional walkers need a two-well potential\n");
+        exit(1);
+    }
+    if (params->bias_steps < 0 || params->bias_steps >= params->tot_steps || params->bias_height <= 0 || \
+        params->bias_factor <= 1) {
+        printf("Bias must be built over fewer steps than the run, with a positive height and a bias factor above 1\n");
+        exit(1);
+    }
+    if (params->bias_steps > 0 && (params->nowalkers > 1 || params->exchange_steps > 0 || params->estimators || \
+        params->tolerance > 0 || params->adapt_steps > 0 || params->tries > 1 || params->nowells > 2 || \
+        params->dim > 1 || params->noparticles > 1)) {
+        printf("An adaptive bias needs a single walker of one particle in a two-well potential, without tempering, " \
+               "switch estimators, tolerance, burn-in or multiple tries\n");
+        exit(1);
+    }
+}
+
+// Sets the optional parameters to their default values
+void set_default_options(parameters *params) {
+    params->noreplicas = 10;
+    params->nothreads = 0;
+    params->nowalkers = 1;
+    params->coarsen = 1;
+    params->noybins = 0;
+    params->y_min = 0;
+    params->y_max = 0;
+    params->dim = 1;
+    params->noparticles = 1;
+    params->tolerance = 0;
+    params->block_steps = 1000;
+    params->checkpoint_steps = 0;
+    params->binary_store = 0;
+    params->estimators = 0;
+    params->stream_decimation = 0;
+    params->stream_histogram = 0;
+    params->stream_block = 1 << 20;
+    params->adapt_steps = 0;
+    params->target_acceptance = 0.5;
+    params->gaussian_proposal = 0;
+    params->tries = 1;
+    params->bias_steps = 0;
+    params->bias_height = 0.1;
+    params->bias_factor = 2;
+    for (int k = 0; k < 3; k++) {
+        params->sweep_kT[k] = 0;
+        params->sweep_step[k] = 0;
+    }
+    params->sweep_potentials[0] = '\0';
+    params->kT_ladder[0] = '\0';
+    params->exchange_steps = 0;
+    params->extrapolate[0] = '\0';
+    strcpy(params->extrapolate_powers, "2");
+}
+
+// Reads the parameters from an open input file, or any stream in the same format
+void read_parameters(parameters *params, FILE *input_file) {
     read_char(input_file, params->dynamics_type);
     read_char(input_file, params->potential_name);
     read_long(input_file, &params->tot_steps);
@@ -108,38 +502,33 @@ void store_parameters(parameters *params, char *input_filename) {
     read_double(input_file, &params->kT);
     read_double(input_file, &params->mass);
 
+    params->timestep = 0; // Only one of these is given, depending on the dynamics
+    params->jump_size = 0;
+    params->friction_param = 0;
 
     if (strcmp(params->dynamics_type, "BAOAB_LIMIT") == 0) {
         read_double(input_file, &params->timestep);
-
-    }
-        // else if (strcmp(params->dynamics_type, "BAOAB_REGULAR") == 0){
-        // 	read_double(input_file, &params->timestep);
-        // 	read_double(input_file, &params->friction_param);
-        // 	params->const1 = exp(-params->friction_param * params->timestep);
-        // 	params->const2 = (1 - params->const1) / params->friction_param;
-        // 	params->const3 = sqrt(params->kT * (1 - params->const1 * params->const1));
-        // }
-    else if (strcmp(params->dynamics_type, "MONTE-CARLO") == 0) {
+    } else if (strcmp(params->dynamics_type, "BAOAB_REGULAR") == 0) {
+        read_double(input_file, &params->timestep);
+        read_double(input_file, &params->friction_param);
+    } else if (strcmp(params->dynamics_type, "MONTE-CARLO") == 0) {
         read_double(input_file, &params->jump_size);
     }
 
+    set_default_options(params);
+    read_options(input_file, params);
+    set_derived_parameters(params);
+}
 
+// Reads an input file to store the parameters
+void store_parameters(parameters *params, char *input_filename) {
+    FILE *input_file = fopen(input_filename, "r");
+    if (input_file == NULL) {
+        printf("Failed to open input file \n");
+        exit(1);
+    }
+    read_parameters(params, input_file);
     fclose(input_file);
-
-    params->bin_width = (params->x_max - params->x_min) / params->nobins;
-
-    double poten_const_arr[] = {0, 0, 0}; // Array for potential specific constants
-    PotentialFun func_arr[] = {0, 0, 0}; // Array for potential functions
-    Poten_selector(poten_const_arr, func_arr, params->potential_name); // Fills the constant and function arrays
-
-    params->Poten = func_arr[0];
-    params->Poten_shifted = func_arr[1];
-    params->Poten_deriv = func_arr[2];
-
-    params->minima[0] = poten_const_arr[0]; // x-coordinates of the minima of the wells
-    params->minima[1] = poten_const_arr[1];
-    params->shift_value = poten_const_arr[2]; // The amount the right minima has been shifted upwards
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,73 @@
+/*
+	Philox.h
+	Header file for the Philox4x32-10 counter-based random number generator. Each block
+	of four 32-bit random numbers is a pure function of a 128-bit counter and a 64-bit
+	key, so a stream can be started at any point without generating the numbers before
+	it, and blocks for consecutive counters can be generated in parallel.
+
+	Reference: "Parallel Random Numbers: As Easy as 1, 2, 3" by John K. Salmon, Mark A.
+	Moraes, Ron O. Dror and David E. Shaw. SC '11, doi:10.1145/2063384.2063405
+*/
+
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <stdint.h>
+
+#define PHILOX_M0 0xD2511F53U // Multipliers of the rounds
+#define PHILOX_M1 0xCD9E8D57U
+#define PHILOX_W0 0x9E3779B9U // Key increments between rounds (golden ratio and sqrt(3) - 1)
+#define PHILOX_W1 0xBB67AE85U
+
+// One round of Philox, updating the counter words c0 to c3 with key words k0 and k1
+#define PHILOX_ROUND(c0, c1, c2, c3, k0, k1) \
+    { \
+        uint64_t prod0 = (uint64_t) PHILOX_M0 * c0; \
+        uint64_t prod1 = (uint64_t) PHILOX_M1 * c2; \
+        c0 = (uint32_t) (prod1 >> 32) ^ c1 ^ k0; \
+        c2 = (uint32_t) (prod0 >> 32) ^ c3 ^ k1; \
+        c1 = (uint32_t) prod1; \
+        c3 = (uint32_t) prod0; \
+        k0 += PHILOX_W0; \
+        k1 += PHILOX_W1; \
+    }
+
+// Fills out[0..3] with the block of random numbers for the given counter and key
+static inline void philox4x32_10(uint32_t out[4], const uint32_t ctr[4], const uint32_t key[2]) {
+    uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+    uint32_t k0 = key[0], k1 = key[1];
+    for (int round = 0; round < 10; round++) PHILOX_ROUND(c0, c1, c2, c3, k0, k1)
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+// Fills out[0..4*noblocks) with the blocks for counters {counter + i, stream}, i = 0..noblocks-1
+void philox4x32_10_blocks(uint32_t *out, long noblocks, uint64_t counter, uint64_t stream, const uint32_t key[2]) {
+    uint32_t s0 = (uint32_t) stream, s1 = (uint32_t) (stream >> 32);
+    uint32_t key0 = key[0], key1 = key[1];
+#pragma omp simd
+    for (long i = 0; i < noblocks; i++) {
+        uint64_t block_ctr = counter + (uint64_t) i;
+        uint32_t c0 = (uint32_t) block_ctr, c1 = (uint32_t) (block_ctr >> 32), c2 = s0, c3 = s1;
+        uint32_t k0 = key0, k1 = key1;
+        // The rounds are written out so that the loop body has no control flow and vectorises
+        PHILOX_ROUND(c0, c1, c2, c3, k0, k1)
+        PHILOX_ROUND(c0, c1, c2, c3, k0, k1)
+        PHILOX_ROUND(c0, c1, c2, c3, k0, k1)
+        PHILOX_ROUND(c0, c1, c2, c3, k0, k1)
+        PHILOX_ROUND(c0, c1, c2, c3, k0, k1)
+        PHILOX_ROUND(c0, c1, c2, c3, k0, k1)
+        PHILOX_ROUND(c0, c1, c2, c3, k0, k1)
+        PHILOX_ROUND(c0, c1, c2, c3, k0, k1)
+        PHILOX_ROUND(c0, c1, c2, c3, k0, k1)
+        PHILOX_ROUND(c0, c1, c2, c3, k0, k1)
+        out[4 * i] = c0;
+        out[4 * i + 1] = c1;
+        out[4 * i + 2] = c2;
+        out[4 * i + 3] = c3;
+    }
+}
+
+#endif // PHILOX_H
@@ -1,9 +1,19 @@
 /*
 	Potentials.h
 	Header file for defining the external potentials used in lattice switching. For
-	every potential, its function, its shifted function and its derivative is defined,
-	and finally a function for returning pointers to relevant functions and constants
-	for each potential.
+	every potential, a fused energy and force kernel and its minima and shift are defined,
+	from which its function, its shifted function and its derivative are generated, and
+	finally a function for returning pointers to relevant functions and constants for
+	each potential.
+
+	Potentials with more than two wells declare the minima of their wells, the boundaries
+	between neighbouring wells and the shift of each well as arrays, and are run in the
+	N-well mode (see simulate_wells in Simulation.h).
+
+	The TABULATED potential is read from the file given by the TABLE option instead, and
+	its wells are found from the table (see Tabulated.h). The EXPRESSION potential is the
+	formula of the EXPRESSION option, compiled when it is read (see Expression.h), with the
+	wells at the minima of the MINIMA option.
 */
 
 #ifndef POTENTIALS_H
@@ -12,136 +22,381 @@
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
+#include "Expression.h"
 
 
+#define MAX_WELLS 16 // Largest number of wells of a potential
+
 // Typedef for a function pointer
 typedef double (*PotentialFun)(double);
 
+/* Structure to store the wells of a potential, numbered from left to right */
+struct well_layout {
+    int nowells;                      // Number of wells
+    double minima[MAX_WELLS];         // x-coordinates of the minima
+    double boundaries[MAX_WELLS - 1]; // Boundaries between neighbouring wells, well k lies between boundaries k - 1 and k
+    double shifts[MAX_WELLS];         // Amount each well is shifted so that the minima are level
+};
+
+typedef struct well_layout well_layout;
+
+// Returns the well containing x by bisection over the boundaries, the boundary itself belonging to the well on its left
+static inline int boundary_well(double x, const double *boundaries, int nowells) {
+    int low = 0, high = nowells - 1;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (x > boundaries[mid]) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/*
+    Every potential is defined by a fused kernel POTEN_energy_and_force, returning the potential at x
+    and storing the force (minus the derivative) at x. The kernels are static inline so that code
+    instantiated for a particular potential calls them directly (see Simulation.h). The shifted
+    potential is the potential with POTEN_SHIFT added to the right well (x > 0), which levels the minima.
+*/
+
+// Typedef for a function pointer to a fused energy and force kernel
+typedef double (*EnergyForceFun)(double, double*);
+
 /* Potential function from Kinetic Theory notes */
 
-// External potential
-double KT_Poten(double x) {
+#define KT_LEFT_MIN -2.0 // Left minimum
+#define KT_RIGHT_MIN 2.4 // Right minimum
+#define KT_SHIFT 4.4     // Amount the right well is shifted
+
+// External potential and force
+static inline double KT_energy_and_force(double x, double *force) {
     double pot_val; // Value of the potential at x
     if (x <= -1) {
         pot_val = 5 * (x + 2) * (x + 2);
+        *force = -10 * (x + 2);
     } else if (x <= 1.2) {
         pot_val = 10 - 5 * x * x;
+        *force = 10 * x;
     } else {
         pot_val = 5 * (x - 2.4) * (x - 2.4) - 4.4;
+        *force = -10 * (x - 2.4);
     }
     return pot_val;
 }
 
-// External potential shifted
-double KT_Poten_shifted(double x) {
+
+/* A quartic potential function */
+
+#define QUARTIC_LEFT_MIN -1.220997215942    // Left minimum
+#define QUARTIC_RIGHT_MIN 1.5989977937      // Right minimum
+#define QUARTIC_SHIFT 2.8256360858458973    // Amount the right well is shifted
+
+// External potential and force
+static inline double QUARTIC_energy_and_force(double x, double *force) {
+    double y = x - 0.126000192586256; // Position relative to the centre of the quartic
+    double y2 = y * y;
+    *force = -(4 * y2 * y - 8 * y - 1);
+    return y2 * y2 - 4 * y2 - y + 2.618555980765;
+}
+
+
+/* Potential with differing well widths */
+
+#define DIFF_WIDTH_LEFT_MIN -2.0                // Left minimum
+#define DIFF_WIDTH_RIGHT_MIN 0.69282032302755092 // Right minimum, sqrt(0.48)
+#define DIFF_WIDTH_SHIFT 2.0                    // Amount the right well is shifted
+
+// External potential and force
+static inline double DIFF_WIDTH_energy_and_force(double x, double *force) {
     double pot_val; // Value of the potential at x
     if (x <= -1) {
         pot_val = 5 * (x + 2) * (x + 2);
+        *force = -10 * (x + 2);
     } else if (x <= 0) {
         pot_val = 10 - 5 * x * x;
-    } else if (x <= 1.2) {
-        pot_val = 14.4 - 5 * x * x;
+        *force = 10 * x;
+    } else if (x <= 0.3461) {
+        pot_val = -50 * x * x + 10;
+        *force = 100 * x;
     } else {
-        pot_val = 5 * (x - 2.4) * (x - 2.4);
+        pot_val = 50 * (x - DIFF_WIDTH_RIGHT_MIN) * (x - DIFF_WIDTH_RIGHT_MIN) - 2;
+        *force = -100 * (x - DIFF_WIDTH_RIGHT_MIN);
     }
     return pot_val;
 }
 
-// Derivative of potential function
-double KT_Poten_deriv(double x) {
+
+/*
+    Defines, for a potential with a fused kernel, the external potential, the potential shifted so
+    the minima are level, its derivative and POTEN_shifted_delta(x, well), the difference in the
+    shifted potential between the mirror position of x in the other well and x itself.
+*/
+#define POTENTIAL_FUNCTIONS(POTEN) \
+    double POTEN##_Poten(double x) { \
+        double force; \
+        return POTEN##_energy_and_force(x, &force); \
+    } \
+    double POTEN##_Poten_shifted(double x) { \
+        double force; \
+        return POTEN##_energy_and_force(x, &force) + ((x > 0) ? POTEN##_SHIFT : 0); \
+    } \
+    double POTEN##_Poten_deriv(double x) { \
+        double force; \
+        POTEN##_energy_and_force(x, &force); \
+        return -force; \
+    } \
+    static inline double POTEN##_shifted_delta(double x, int well) { \
+        double force; \
+        double oth_x = x + ((well == 0) ? POTEN##_RIGHT_MIN - POTEN##_LEFT_MIN : POTEN##_LEFT_MIN - POTEN##_RIGHT_MIN); \
+        return POTEN##_energy_and_force(oth_x, &force) + ((oth_x > 0) ? POTEN##_SHIFT : 0) - \
+            POTEN##_energy_and_force(x, &force) - ((x > 0) ? POTEN##_SHIFT : 0); \
+    }
+
+POTENTIAL_FUNCTIONS(KT)
+POTENTIAL_FUNCTIONS(QUARTIC)
+POTENTIAL_FUNCTIONS(DIFF_WIDTH)
+
+
+/* Potential with three wells of differing depths, made of harmonic wells joined by inverted parabolas */
+
+#define TRIPLE_NOWELLS 3
+static const double TRIPLE_MINIMA[TRIPLE_NOWELLS] = {-3.0, 1.2, 5.0};    // Minima of the wells
+static const double TRIPLE_BOUNDARIES[TRIPLE_NOWELLS - 1] = {-1.0, 3.2}; // Tops of the barriers
+static const double TRIPLE_SHIFTS[TRIPLE_NOWELLS] = {0, 2.1, 0.2};       // Amount each well is shifted
+
+// External potential and force
+static inline double TRIPLE_energy_and_force(double x, double *force) {
     double pot_val; // Value of the potential at x
-    if (x <= -1) {
-        pot_val = 10 * (x + 2);
-    } else if (x <= 1.2) {
-        pot_val = -10 * x;
+    if (x <= -2) {
+        pot_val = 5 * (x + 3) * (x + 3);
+        *force = -10 * (x + 3);
+    } else if (x <= 0.1) {
+        pot_val = 10 - 5 * (x + 1) * (x + 1);
+        *force = 10 * (x + 1);
+    } else if (x <= 2.2) {
+        pot_val = 5 * (x - 1.2) * (x - 1.2) - 2.1;
+        *force = -10 * (x - 1.2);
+    } else if (x <= 4.1) {
+        pot_val = 7.9 - 5 * (x - 3.2) * (x - 3.2);
+        *force = 10 * (x - 3.2);
     } else {
-        pot_val = 10 * (x - 2.4);
+        pot_val = 5 * (x - 5) * (x - 5) - 0.2;
+        *force = -10 * (x - 5);
     }
     return pot_val;
 }
 
 
-/* A quartic potential function */
+/*
+    Defines, for a potential with more than two wells, the external potential, the potential with
+    each well shifted so the minima are level and its derivative
+*/
+#define WELL_POTENTIAL_FUNCTIONS(POTEN) \
+    double POTEN##_Poten(double x) { \
+        double force; \
+        return POTEN##_energy_and_force(x, &force); \
+    } \
+    double POTEN##_Poten_shifted(double x) { \
+        double force; \
+        return POTEN##_energy_and_force(x, &force) + \
+            POTEN##_SHIFTS[boundary_well(x, POTEN##_BOUNDARIES, POTEN##_NOWELLS)]; \
+    } \
+    double POTEN##_Poten_deriv(double x) { \
+        double force; \
+        POTEN##_energy_and_force(x, &force); \
+        return -force; \
+    }
+
+WELL_POTENTIAL_FUNCTIONS(TRIPLE)
+
+
+/*
+    Potential tabulated from a file, as a cubic in each of nointervals intervals of equal width, so
+    the interval of x is found in O(1) and one lookup of four coefficients gives the energy and force.
+    Beyond the table, the potential continues with the slope at its end and a harmonic wall. There is
+    one table per process, loaded by load_table (see Tabulated.h) when the TABLE option is read.
+*/
+struct tabulated_potential {
+    double x_min;          // Position of the first node
+    double inv_width;      // One over the width of an interval
+    long nointervals;      // Number of intervals
+    double (*coeffs)[4];   // Coefficients of the cubic in the fraction t of each interval, V = c0 + t (c1 + t (c2 + t c3))
+    double x_ends[2];      // Positions of the ends of the table
+    double end_energy[2];  // Potential at the ends of the table
+    double end_slope[2];   // Derivative of the potential at the ends of the table
+    double wall_stiffness; // Stiffness of the harmonic walls beyond the ends of the table
+    well_layout wells;     // Wells found in the table
+    char filename[256];    // File the table was loaded from, empty if none has been
+};
 
-// External potential
-double QUARTIC_Poten(double x) {
-    double x_0 = -0.126000192586256;
-    return pow(x + x_0, 4) - 4 * (x + x_0) * (x + x_0) - (x + x_0) + 2.618555980765;
+typedef struct tabulated_potential tabulated_potential;
+
+static tabulated_potential TABULATED_TABLE; // The table of this process
+
+// Potential and force beyond the ends of the table
+static double tabulated_wall(double x, double *force) {
+    const tabulated_potential *tab = &TABULATED_TABLE;
+    int end = (x >= tab->x_ends[1]); // Right end, otherwise left
+    double dx = x - tab->x_ends[end];
+    *force = -(tab->end_slope[end] + tab->wall_stiffness * dx);
+    return tab->end_energy[end] + tab->end_slope[end] * dx + 0.5 * tab->wall_stiffness * dx * dx;
 }
 
-// External potential shifted
-double QUARTIC_Poten_shifted(double x) {
-    double pot_val; // Value of the potential at x
-    double x_0 = -0.126000192586256;
-    if (x < 0) {
-        pot_val = pow(x + x_0, 4) - 4 * (x + x_0) * (x + x_0) - (x + x_0) + 2.618555980765;
-    } else {
-        pot_val = pow(x + x_0, 4) - 4 * (x + x_0) * (x + x_0) - (x + x_0) + 5.444192066610897;
-    }
-    return pot_val;
+// External potential and force
+static inline double TABULATED_energy_and_force(double x, double *force) {
+    const tabulated_potential *tab = &TABULATED_TABLE;
+    double s = (x - tab->x_min) * tab->inv_width; // Position in units of intervals
+    if (!(s >= 0 && s < tab->nointervals)) return tabulated_wall(x, force);
+    long j = (long) s;
+    double t = s - j;
+    const double *c = tab->coeffs[j];
+    *force = -(c[1] + t * (2 * c[2] + 3 * t * c[3])) * tab->inv_width;
+    return c[0] + t * (c[1] + t * (c[2] + t * c[3]));
 }
 
-// Derivative of potential function
-double QUARTIC_Poten_deriv(double x) {
-    double x_0 = -0.126000192586256;
-    return 4 * pow(x + x_0, 3) - 8 * (x + x_0) - 1;
+// The same kernel, instantiated in the N-well mode when the table has more than two wells
+#define TABULATED_WELLS_energy_and_force TABULATED_energy_and_force
+
+
+/*
+    Potential given by the formula of the EXPRESSION option, compiled into a program which gives the
+    force along with the potential (see Expression.h). The wells are filled from the minima of the
+    MINIMA option by fill_expression_wells.
+*/
+static expression_program EXPRESSION_PROGRAM; // Program of the formula, empty until one is compiled
+static double EXPRESSION_MINIMA[MAX_WELLS];   // Minima given by the MINIMA option
+static int EXPRESSION_NOMINIMA;               // Number of minima given
+static well_layout EXPRESSION_LAYOUT;         // Wells of the formula
+
+// External potential and force
+static inline double EXPRESSION_energy_and_force(double x, double *force) {
+    double energy;
+    expression_block(&EXPRESSION_PROGRAM, &x, &energy, force, 1);
+    return energy;
 }
 
+// The same kernel, instantiated in the N-well mode when there are more than two minima
+#define EXPRESSION_WELLS_energy_and_force EXPRESSION_energy_and_force
 
-/* Potential with differing well widths */
 
-// External potential
-double DIFF_WIDTH_Poten(double x) {
-    double pot_val; // Value of the potential at x
-    if (x <= -1) {
-        pot_val = 5 * (x + 2) * (x + 2);
-    } else if (x <= 0) {
-        pot_val = 10 - 5 * x * x;
-    } else if (x <= 0.3461) {
-        pot_val = -50 * x * x + 10;
-    } else {
-        pot_val = 50 * (x - sqrt(0.48)) * (x - sqrt(0.48)) - 2;
+/*
+    Defines, for a potential whose wells are only known at run time, the external potential, the
+    potential with each well shifted so the minima are level, its derivative and, for two wells, the
+    difference in the shifted potential made by a lattice switch
+*/
+#define LAYOUT_POTENTIAL_FUNCTIONS(POTEN, LAYOUT) \
+    double POTEN##_Poten(double x) { \
+        double force; \
+        return POTEN##_energy_and_force(x, &force); \
+    } \
+    double POTEN##_Poten_shifted(double x) { \
+        double force; \
+        return POTEN##_energy_and_force(x, &force) + \
+            (LAYOUT).shifts[boundary_well(x, (LAYOUT).boundaries, (LAYOUT).nowells)]; \
+    } \
+    double POTEN##_Poten_deriv(double x) { \
+        double force; \
+        POTEN##_energy_and_force(x, &force); \
+        return -force; \
+    } \
+    static inline double POTEN##_shifted_delta(double x, int well) { \
+        double force; \
+        const well_layout *wells = &(LAYOUT); \
+        double oth_x = x + ((well == 0) ? wells->minima[1] - wells->minima[0] : wells->minima[0] - wells->minima[1]); \
+        return POTEN##_energy_and_force(oth_x, &force) + ((oth_x > 0) ? wells->shifts[1] : 0) - \
+            POTEN##_energy_and_force(x, &force) - ((x > 0) ? wells->shifts[1] : 0); \
     }
-    return pot_val;
-}
 
-// External potential shifted
-double DIFF_WIDTH_Poten_shifted(double x) {
-    double pot_val; // Value of the potential at x
-    if (x <= -1) {
-        pot_val = 5 * (x + 2) * (x + 2);
-    } else if (x <= 0) {
-        pot_val = 10 - 5 * x * x;
-    } else if (x <= 0.3461) {
-        pot_val = -50 * x * x + 12;
-    } else {
-        pot_val = 50 * (x - sqrt(0.48)) * (x - sqrt(0.48));
+LAYOUT_POTENTIAL_FUNCTIONS(TABULATED, TABULATED_TABLE.wells)
+LAYOUT_POTENTIAL_FUNCTIONS(EXPRESSION, EXPRESSION_LAYOUT)
+
+
+// Fills the layout of a potential's wells from its arrays of minima, boundaries and shifts
+void fill_well_layout(well_layout *wells, int nowells, const double *minima, const double *boundaries, \
+        const double *shifts) {
+    wells->nowells = nowells;
+    for (int k = 0; k < nowells; k++) {
+        wells->minima[k] = minima[k];
+        wells->shifts[k] = shifts[k];
+        if (k + 1 < nowells) wells->boundaries[k] = boundaries[k];
     }
-    return pot_val;
 }
 
-// Derivative of potential function
-double DIFF_WIDTH_Poten_deriv(double x) {
-    double pot_val; // Value of the potential at x
-    if (x <= -1) {
-        pot_val = 10 * (x + 2);
-    } else if (x <= 0) {
-        pot_val = -10 * x;
-    } else if (x <= 0.3461) {
-        pot_val = -100 * x;
-    } else {
-        pot_val = 100 * (x - sqrt(0.48));
+// Fills the layout of a two-well potential, whose wells are divided at x = 0
+void fill_two_well_layout(well_layout *wells, double left_min, double right_min, double shift) {
+    double minima[2] = {left_min, right_min};
+    double boundaries[1] = {0};
+    double shifts[2] = {0, shift};
+    fill_well_layout(wells, 2, minima, boundaries, shifts);
+}
+
+/*
+    Fills the wells of the EXPRESSION potential. Each given minimum is refined by Newton's method on the
+    exact derivative, and the shift of each well levels it with the first. With two wells they are
+    divided at x = 0, as for every two-well potential, and with more the boundaries are the highest
+    points between neighbouring minima, found on a fine grid.
+*/
+void fill_expression_wells(void) {
+    int nowells = EXPRESSION_NOMINIMA;
+    double minima[MAX_WELLS], shifts[MAX_WELLS], boundaries[MAX_WELLS - 1];
+    for (int k = 0; k < nowells; k++) {
+        double x = EXPRESSION_MINIMA[k], force, step = 1e-5;
+        for (int iter = 0; iter < 100; iter++) {
+            double force_left, force_right;
+            EXPRESSION_energy_and_force(x, &force);
+            EXPRESSION_energy_and_force(x - step, &force_left);
+            EXPRESSION_energy_and_force(x + step, &force_right);
+            double curvature = (force_left - force_right) / (2 * step);
+            if (!(curvature > 0)) break;
+            double move = force / curvature;
+            x += move;
+            if (fabs(move) < 1e-14 * (1 + fabs(x))) break;
+        }
+        EXPRESSION_energy_and_force(x, &force);
+        if (!(fabs(force) < 1e-8) || fabs(x - EXPRESSION_MINIMA[k]) > 0.5) {
+            printf("No minimum of the expression near %g\n", EXPRESSION_MINIMA[k]);
+            exit(1);
+        }
+        minima[k] = x;
     }
-    return pot_val;
+    for (int k = 0; k < nowells; k++) {
+        double force;
+        shifts[k] = EXPRESSION_energy_and_force(minima[0], &force) - EXPRESSION_energy_and_force(minima[k], &force);
+        if (k + 1 < nowells && !(minima[k + 1] > minima[k])) {
+            printf("Minima of the expression must be in increasing order\n");
+            exit(1);
+        }
+    }
+
+    if (nowells == 2) {
+        if (!(minima[0] < 0 && minima[1] > 0)) {
+            printf("The two minima of the expression must lie on either side of x = 0\n");
+            exit(1);
+        }
+        fill_two_well_layout(&EXPRESSION_LAYOUT, minima[0], minima[1], shifts[1]);
+        return;
+    }
+    for (int k = 0; k + 1 < nowells; k++) {
+        double top = -INFINITY;
+        for (int j = 1; j < 4096; j++) {
+            double x = minima[k] + (minima[k + 1] - minima[k]) * j / 4096, force;
+            double energy = EXPRESSION_energy_and_force(x, &force);
+            if (energy > top) {
+                top = energy;
+                boundaries[k] = x;
+            }
+        }
+    }
+    fill_well_layout(&EXPRESSION_LAYOUT, nowells, minima, boundaries, shifts);
 }
 
-// Returns potential specific constant values and function pointers
-void Poten_selector(double const_arr[], PotentialFun func_arr[], char name[]) {
+// Returns the wells of a potential and its function pointers
+void Poten_selector(well_layout *wells, PotentialFun func_arr[], char name[]) {
     // Function from kinetic theory notes
     if (strcmp(name, "KT") == 0) {
-        const_arr[0] = -2; // Left minimum
-        const_arr[1] = 2.4; // Right minimum
-        const_arr[2] = 4.4; // Amount the right well is shifted
+        fill_two_well_layout(wells, KT_LEFT_MIN, KT_RIGHT_MIN, KT_SHIFT);
 
         // Function pointers
         func_arr[0] = &KT_Poten;
@@ -150,9 +405,7 @@ void Poten_selector(double const_arr[], PotentialFun func_arr[], char name[]) {
     }
         // Quartic function
     else if (strcmp(name, "QUARTIC") == 0) {
-        const_arr[0] = -1.220997215942; // Left minimum
-        const_arr[1] = 1.5989977937; // Right minimum
-        const_arr[2] = 2.8256360858458973; // Amount the right well is shifted
+        fill_two_well_layout(wells, QUARTIC_LEFT_MIN, QUARTIC_RIGHT_MIN, QUARTIC_SHIFT);
 
         // Function pointers
         func_arr[0] = &QUARTIC_Poten;
@@ -161,15 +414,41 @@ void Poten_selector(double const_arr[], PotentialFun func_arr[], char name[]) {
     }
         // Potential function with differing well widths
     else if (strcmp(name, "DIFF_WIDTH") == 0) {
-        const_arr[0] = -2; // Left minimum
-        const_arr[1] = sqrt(0.48); // Right minimum
-        const_arr[2] = 2; // Amount the right well is shifted
+        fill_two_well_layout(wells, DIFF_WIDTH_LEFT_MIN, DIFF_WIDTH_RIGHT_MIN, DIFF_WIDTH_SHIFT);
 
         // Function pointers
         func_arr[0] = &DIFF_WIDTH_Poten;
         func_arr[1] = &DIFF_WIDTH_Poten_shifted;
         func_arr[2] = &DIFF_WIDTH_Poten_deriv;
     }
+        // Potential function with three wells
+    else if (strcmp(name, "TRIPLE") == 0) {
+        fill_well_layout(wells, TRIPLE_NOWELLS, TRIPLE_MINIMA, TRIPLE_BOUNDARIES, TRIPLE_SHIFTS);
+
+        // Function pointers
+        func_arr[0] = &TRIPLE_Poten;
+        func_arr[1] = &TRIPLE_Poten_shifted;
+        func_arr[2] = &TRIPLE_Poten_deriv;
+    }
+        // Potential tabulated from the file of the TABLE option
+    else if (strcmp(name, "TABULATED") == 0 && TABULATED_TABLE.filename[0] != '\0') {
+        *wells = TABULATED_TABLE.wells;
+
+        // Function pointers
+        func_arr[0] = &TABULATED_Poten;
+        func_arr[1] = &TABULATED_Poten_shifted;
+        func_arr[2] = &TABULATED_Poten_deriv;
+    }
+        // Potential given by the formula of the EXPRESSION option
+    else if (strcmp(name, "EXPRESSION") == 0 && EXPRESSION_PROGRAM.noinstructions > 0 && EXPRESSION_NOMINIMA >= 2) {
+        fill_expression_wells();
+        *wells = EXPRESSION_LAYOUT;
+
+        // Function pointers
+        func_arr[0] = &EXPRESSION_Poten;
+        func_arr[1] = &EXPRESSION_Poten_shifted;
+        func_arr[2] = &EXPRESSION_Poten_deriv;
+    }
 }
 
 
@@ -0,0 +1,76 @@
+/*
+	Proposal.h
+	Header file for the proposals of the Monte-Carlo dynamics. Each well has its own proposal
+	width, used for moves from positions on that side of the barrier, so that moves out of a
+	narrow well and a wide well can both be accepted at a reasonable rate. As the width depends
+	on where a move starts, acceptance includes the Hastings ratio of the proposal densities.
+
+	With the ADAPT_STEPS option, the widths are tuned during a burn-in of that many steps: every
+	ADAPT_INTERVAL steps, the width of each well is scaled by exp(gain * (acceptance - target)),
+	with a gain decreasing as the burn-in goes on. The widths are then frozen and the burn-in is
+	discarded, so the samples used come from a fixed Markov chain with the correct distribution.
+*/
+
+#ifndef PROPOSAL_H
+#define PROPOSAL_H
+
+#include <math.h>
+
+#define ADAPT_INTERVAL 100 // Number of steps between adjustments of the widths during the burn-in
+#define MAX_TRIES 16       // Largest number of tries in a multiple-try move
+
+/* Structure to store the proposal widths of each well and how often their moves are accepted */
+struct proposal_state {
+    double jump_size[2]; // Proposal width for moves from the left and right well
+    long attempts[2];    // Number of moves attempted from each well
+    long accepts[2];     // Number of moves accepted from each well
+};
+
+typedef struct proposal_state proposal_state;
+
+
+// Sets both widths to jump_size and clears the counts
+void init_proposal(proposal_state *prop, double jump_size) {
+    prop->jump_size[0] = jump_size;
+    prop->jump_size[1] = jump_size;
+    for (int well = 0; well < 2; well++) {
+        prop->attempts[well] = 0;
+        prop->accepts[well] = 0;
+    }
+}
+
+// Returns the well whose width is used for moves from x
+static inline int proposal_well(double x) {
+    return x > 0;
+}
+
+// Returns the acceptance rate of moves from a well, or 0 if none were attempted
+double proposal_acceptance(proposal_state *prop, int well) {
+    return (prop->attempts[well] > 0) ? (double) prop->accepts[well] / prop->attempts[well] : 0;
+}
+
+/*
+    Scales the width of each well towards the target acceptance rate, using the moves since the last
+    adjustment, which is adjustment number round of the burn-in. The counts are then cleared.
+*/
+void adapt_proposal(proposal_state *prop, double target_acceptance, long round) {
+    double gain = 1 / sqrt((double) round + 1); // Decreases so that the widths settle
+    for (int well = 0; well < 2; well++) {
+        if (prop->attempts[well] > 0) {
+            prop->jump_size[well] *= exp(gain * (proposal_acceptance(prop, well) - target_acceptance));
+        }
+        prop->attempts[well] = 0;
+        prop->accepts[well] = 0;
+    }
+}
+
+/*
+    Returns the density of proposing a displacement d with width j, up to a constant factor shared
+    by every width: uniform on (-j, j), or normal with standard deviation j
+*/
+static inline double proposal_density(double d, double j, int gaussian) {
+    if (gaussian) return exp(-0.5 * d * d / (j * j)) / j;
+    return (fabs(d) < j) ? 1 / j : 0;
+}
+
+#endif // PROPOSAL_H
@@ -1,6 +1,9 @@
 /*
 	Random.h
-	Header file for methods using random numbers, specifically normally distributed numbers
+	Header file for methods using random numbers. Random numbers are drawn from explicit
+	streams built on the Philox counter-based generator (see Philox.h). A stream is
+	identified by (seed, stream, counter), so every replica can own an independent stream
+	and any stream can be restarted at any position.
 */
 
 #ifndef RANDOM_H
@@ -8,13 +11,110 @@
 
 #define PI 3.14159265358979323846264338327
 
-#include "mt19937ar.h"
+#include <stdint.h>
+#include <math.h>
+#include "Philox.h"
+
+#define RNG_BUFFER_SIZE 256 // Number of 32-bit random words generated at a time (a multiple of 4)
+
+/* Structure to store the state of a random number stream */
+struct rng_stream {
+    uint32_t key[2];                  // Key of the generator, given by the seed
+    uint64_t stream;                  // Stream number, the upper half of the counter
+    uint64_t counter;                 // Next block (of four words) to be generated in this stream
+    uint32_t buffer[RNG_BUFFER_SIZE]; // Generated random words
+    int pos;                          // Position of the next unused word in the buffer
+    int has_spare;                    // Indicates if spare holds an unused normally distributed number
+    double spare;                     // Second normally distributed number from the last Box-Muller transform
+};
+
+typedef struct rng_stream rng_stream;
+
+
+// Starts a stream with the given seed and stream number at the given block of the stream
+void rng_init(rng_stream *rng, uint64_t seed, uint64_t stream, uint64_t counter) {
+    rng->key[0] = (uint32_t) seed;
+    rng->key[1] = (uint32_t) (seed >> 32);
+    rng->stream = stream;
+    rng->counter = counter;
+    rng->pos = RNG_BUFFER_SIZE; // Buffer is empty
+    rng->has_spare = 0;
+    rng->spare = 0;
+}
+
+// Generates the next buffer of random words
+void rng_refill(rng_stream *rng) {
+    philox4x32_10_blocks(rng->buffer, RNG_BUFFER_SIZE / 4, rng->counter, rng->stream, rng->key);
+    rng->counter += RNG_BUFFER_SIZE / 4;
+    rng->pos = 0;
+}
+
+// Returns a random number on [0,0xffffffff]-interval
+static inline uint32_t rng_int32(rng_stream *rng) {
+    if (rng->pos == RNG_BUFFER_SIZE) rng_refill(rng);
+    return rng->buffer[rng->pos++];
+}
+
+// Converts a random word to a double on (0,1)-real-interval
+static inline double word_to_uniform(uint32_t word) {
+    return ((double) word + 0.5) * (1.0 / 4294967296.0);
+}
+
+// Returns a random number uniformly distributed on (0,1)
+static inline double rng_uniform(rng_stream *rng) {
+    return word_to_uniform(rng_int32(rng));
+}
 
 // Returns a random normally distributed number, mean 0, standard deviation 1
-double box_muller_rand(){
-	double r1 = genrand_real3();
-	double r2 = genrand_real3();
-	return sqrt(-2 * log(r1)) * cos(2 * PI * r2);
+double rng_normal(rng_stream *rng) {
+    if (rng->has_spare) {
+        rng->has_spare = 0;
+        return rng->spare;
+    }
+    // Box-Muller transform, keeping the second variate for the next call
+    double r = sqrt(-2 * log(rng_uniform(rng)));
+    double theta = 2 * PI * rng_uniform(rng);
+    rng->spare = r * sin(theta);
+    rng->has_spare = 1;
+    return r * cos(theta);
+}
+
+// Fills an array with random numbers uniformly distributed on (0,1)
+void rng_fill_uniform(rng_stream *rng, double *arr, long n) {
+    long i = 0;
+    while (i < n) {
+        if (rng->pos == RNG_BUFFER_SIZE) rng_refill(rng);
+        long chunk = RNG_BUFFER_SIZE - rng->pos; // Number of words to convert from the current buffer
+        if (chunk > n - i) chunk = n - i;
+        const uint32_t *words = rng->buffer + rng->pos;
+        double *out = arr + i;
+#pragma omp simd
+        for (long j = 0; j < chunk; j++) out[j] = word_to_uniform(words[j]);
+        rng->pos += chunk;
+        i += chunk;
+    }
+}
+
+// Fills an array with normally distributed numbers, using both variates of every Box-Muller transform
+void rng_fill_normal(rng_stream *rng, double *arr, long n) {
+    long start = 0;
+    if (n > 0 && rng->has_spare) {
+        arr[0] = rng_normal(rng);
+        start = 1;
+    }
+    long nopairs = (n - start) / 2;
+
+    // Uniform pairs are transformed in place
+    double *pairs = arr + start;
+    rng_fill_uniform(rng, pairs, 2 * nopairs);
+    for (long k = 0; k < nopairs; k++) {
+        double r = sqrt(-2 * log(pairs[2 * k]));
+        double theta = 2 * PI * pairs[2 * k + 1];
+        pairs[2 * k] = r * cos(theta);
+        pairs[2 * k + 1] = r * sin(theta);
+    }
+
+    if (start + 2 * nopairs < n) arr[n - 1] = rng_normal(rng);
 }
 
-#endif
\ No newline at end of file
+#endif
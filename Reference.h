@@ -0,0 +1,187 @@
+/*
+	Reference.h
+	Header file for the exact free energy differences of a sweep, which are written next to
+	the estimates so that every run checks itself. The free energy of a well is -kT log Z,
+	with Z the integral of the Boltzmann factor exp(-V/kT) of the unshifted potential over
+	the well, so the exact difference of well k is F_0 - F_k = -kT log(Z_0 / Z_k), as
+	data_analysis/exact_sol.py computes with scipy for one kT at a time.
+
+	The integrals are found by adaptive Gauss-Kronrod quadrature (7 Gauss and 15 Kronrod
+	points), bisecting each interval until its Kronrod and Gauss estimates agree. Every kT
+	of a potential is integrated together, in batches of REFERENCE_BATCH: the potential is
+	evaluated once at each node and its Boltzmann factor taken at every kT of the batch, and
+	an interval is bisected until all of them agree. Each well is divided into
+	REFERENCE_PANELS panels, and the panels of every potential, well and batch are run
+	concurrently, then summed in order so the results do not depend on the number of threads.
+
+	Well k lies between boundaries k - 1 and k (x = 0 for two wells). The outer wells are
+	cut where the potential rises REFERENCE_TAIL times the largest kT above their minimum,
+	beyond which the Boltzmann factor is negligible. Each well's factor is taken relative to
+	its own minimum, so it stays near 1 however deep the wells are. Walkers of several
+	particles or dimensions estimate the difference per particle, which is the same, as the
+	particles switch independently and the extra dimensions are the same in both wells
+	(see Configuration.h).
+*/
+
+#ifndef REFERENCE_H
+#define REFERENCE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "Parameters.h"
+#include "Sweep.h"
+
+#define REFERENCE_PANELS 32       // Panels each well is divided into, integrated concurrently
+#define REFERENCE_BATCH 64        // Largest number of kT integrated together
+#define REFERENCE_TOLERANCE 1e-10 // Relative error at which the integral over an interval has converged
+#define REFERENCE_FLOOR 1e-16     // Error per unit length at which it has converged, for Boltzmann factors near 0
+#define REFERENCE_MAX_DEPTH 48    // Largest number of bisections of a panel
+#define REFERENCE_TAIL 60         // Rise of the potential above the outer minima, in units of kT, where the wells are cut
+
+// Nodes of the 15 point Kronrod rule on [-1, 1], the centre last; the odd ones are the nodes of the 7 point Gauss rule
+static const double KRONROD_NODES[8] = {
+    0.991455371120812639206854697526329, 0.949107912342758524526189684047851, 0.864864423359769072789712788640926,
+    0.741531185599394439863864773280788, 0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+    0.207784955007898467600689403773245, 0.0};
+static const double KRONROD_WEIGHTS[8] = {
+    0.022935322010529224963732008058970, 0.063092092629978553290700663189204, 0.104790010322250183839876322541518,
+    0.140653259715525918745189590510238, 0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+    0.204432940075298892414161999234649, 0.209482141084727828012999174891714};
+static const double GAUSS_WEIGHTS[8] = {
+    0, 0.129484966168869693270611432679082, 0, 0.279705391489276667901467771423780,
+    0, 0.381830050505118944950369775488975, 0, 0.417959183673469387755102040816327};
+
+
+// Stores the Kronrod estimate of the integral over [a, b] of the Boltzmann factor at each inverse kT, and its error
+static void gauss_kronrod(PotentialFun Poten, double a, double b, double v_ref, const double *beta, int nobeta, \
+        double *integral, double *error) {
+    double centre = 0.5 * (a + b), half = 0.5 * (b - a);
+    double gauss[nobeta];
+    for (int j = 0; j < nobeta; j++) {
+        integral[j] = 0;
+        gauss[j] = 0;
+    }
+    for (int i = 0; i < 15; i++) {
+        int node = (i < 8) ? i : 14 - i; // The nodes after the centre mirror those before it
+        double x = centre + ((i < 7) ? -half : half) * KRONROD_NODES[node];
+        double energy = (*Poten)(x) - v_ref;
+        for (int j = 0; j < nobeta; j++) {
+            double factor = exp(-beta[j] * energy);
+            integral[j] += KRONROD_WEIGHTS[node] * factor;
+            gauss[j] += GAUSS_WEIGHTS[node] * factor;
+        }
+    }
+    for (int j = 0; j < nobeta; j++) {
+        integral[j] *= half;
+        error[j] = fabs(integral[j] - gauss[j] * half);
+    }
+}
+
+// Adds the integral over [a, b], given its estimate, to sum, bisecting the interval until every kT has converged
+static void adapt_interval(PotentialFun Poten, double a, double b, double v_ref, const double *beta, int nobeta, \
+        const double *integral, const double *error, int depth, double *sum) {
+    int converged = 1;
+    for (int j = 0; j < nobeta; j++) {
+        if (error[j] > REFERENCE_TOLERANCE * fabs(integral[j]) && error[j] > REFERENCE_FLOOR * (b - a)) converged = 0;
+    }
+    if (converged || depth == REFERENCE_MAX_DEPTH) {
+        for (int j = 0; j < nobeta; j++) sum[j] += integral[j];
+        return;
+    }
+    double mid = 0.5 * (a + b);
+    double left[nobeta], left_error[nobeta], right[nobeta], right_error[nobeta];
+    gauss_kronrod(Poten, a, mid, v_ref, beta, nobeta, left, left_error);
+    gauss_kronrod(Poten, mid, b, v_ref, beta, nobeta, right, right_error);
+    adapt_interval(Poten, a, mid, v_ref, beta, nobeta, left, left_error, depth + 1, sum);
+    adapt_interval(Poten, mid, b, v_ref, beta, nobeta, right, right_error, depth + 1, sum);
+}
+
+// Returns where the potential has risen height above its value at the minimum, going in direction (-1 or 1)
+static double reference_cut(parameters *params, double minimum, double direction, double height) {
+    double v_min = (*params->Poten)(minimum);
+    for (double distance = 0.125; distance < 1e12; distance *= 2) {
+        double x = minimum + direction * distance;
+        if ((*params->Poten)(x) - v_min > height) return x;
+    }
+    printf("The %s potential does not confine the walker, so it has no exact free energy difference\n", \
+           params->potential_name);
+    exit(1);
+}
+
+/*
+    Fills exact with the exact free energy differences F_0 - F_k of every point of a sweep, MAX_WELLS for each
+    point in turn, from the integrals of every potential over every kT of the sweep
+*/
+void exact_differences(sweep *s, double *exact, int nothreads) {
+    long nobatches = (s->nokT + REFERENCE_BATCH - 1) / REFERENCE_BATCH;
+    long nopanels = MAX_WELLS * REFERENCE_PANELS; // Panels of each potential and batch, some unused with fewer wells
+    long notasks = s->nopotentials * nobatches * nopanels;
+    double (*edges)[MAX_WELLS + 1] = malloc(sizeof(double[MAX_WELLS + 1]) * s->nopotentials); // Ends of each well
+    double (*v_ref)[MAX_WELLS] = malloc(sizeof(double[MAX_WELLS]) * s->nopotentials); // Potential at each minimum
+    double (*sums)[REFERENCE_BATCH] = calloc(notasks, sizeof(double[REFERENCE_BATCH])); // Integral of each panel
+    if (edges == NULL || v_ref == NULL || sums == NULL) {
+        printf("Failed to allocate the exact free energy differences\n");
+        exit(1);
+    }
+
+    for (long p = 0; p < s->nopotentials; p++) {
+        parameters *params = &s->points[sweep_point(s, p, 0, 0)];
+        double max_kT = 0;
+        for (long i = 0; i < s->nokT; i++) {
+            if (s->points[sweep_point(s, p, i, 0)].kT > max_kT) max_kT = s->points[sweep_point(s, p, i, 0)].kT;
+        }
+        int nowells = params->nowells;
+        edges[p][0] = reference_cut(params, params->minima[0], -1, REFERENCE_TAIL * max_kT);
+        for (int k = 0; k + 1 < nowells; k++) edges[p][k + 1] = params->boundaries[k];
+        edges[p][nowells] = reference_cut(params, params->minima[nowells - 1], 1, REFERENCE_TAIL * max_kT);
+        for (int k = 0; k < nowells; k++) v_ref[p][k] = (*params->Poten)(params->minima[k]);
+    }
+
+#pragma omp parallel for schedule(dynamic) num_threads(nothreads)
+    for (long task = 0; task < notasks; task++) {
+        long p = task / (nobatches * nopanels);
+        long batch = (task / nopanels) % nobatches;
+        int well = (int) (task % nopanels) / REFERENCE_PANELS;
+        int panel = (int) (task % REFERENCE_PANELS);
+        parameters *params = &s->points[sweep_point(s, p, 0, 0)];
+        if (well >= params->nowells) continue;
+
+        int nobeta = 0;
+        double beta[REFERENCE_BATCH]; // Inverse kT of the batch
+        for (long i = batch * REFERENCE_BATCH; i < s->nokT && nobeta < REFERENCE_BATCH; i++) {
+            beta[nobeta++] = 1 / s->points[sweep_point(s, p, i, 0)].kT;
+        }
+        double width = (edges[p][well + 1] - edges[p][well]) / REFERENCE_PANELS;
+        double a = edges[p][well] + panel * width;
+        double b = (panel + 1 == REFERENCE_PANELS) ? edges[p][well + 1] : a + width;
+        double integral[REFERENCE_BATCH], error[REFERENCE_BATCH];
+        gauss_kronrod(params->Poten, a, b, v_ref[p][well], beta, nobeta, integral, error);
+        adapt_interval(params->Poten, a, b, v_ref[p][well], beta, nobeta, integral, error, 0, sums[task]);
+    }
+
+    for (long p = 0; p < s->nopotentials; p++) {
+        for (long i = 0; i < s->nokT; i++) {
+            parameters *params = &s->points[sweep_point(s, p, i, 0)];
+            double log_z[MAX_WELLS]; // log Z of each well
+            for (int k = 0; k < params->nowells; k++) {
+                // Sums the panels in order, so the integral does not depend on the number of threads
+                long first = (p * nobatches + i / REFERENCE_BATCH) * nopanels + k * REFERENCE_PANELS;
+                double z = 0;
+                for (int panel = 0; panel < REFERENCE_PANELS; panel++) z += sums[first + panel][i % REFERENCE_BATCH];
+                log_z[k] = log(z) - v_ref[p][k] / params->kT;
+            }
+            for (long j = 0; j < s->nosteps; j++) {
+                long point = sweep_point(s, p, i, j);
+                for (int k = 0; k < MAX_WELLS; k++) {
+                    exact[point * MAX_WELLS + k] = (k < params->nowells) ? params->kT * (log_z[k] - log_z[0]) : NAN;
+                }
+            }
+        }
+    }
+    free(edges);
+    free(v_ref);
+    free(sums);
+}
+
+#endif // REFERENCE_H
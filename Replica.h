@@ -0,0 +1,246 @@
+/*
+	Replica.h
+	Header file for running a replica of a parameter point, a single walker or an ensemble
+	of walkers, from its burn-in to its estimate of the free energy difference. Shared by
+	the program (main.c) and the library (library.c).
+*/
+
+#ifndef REPLICA_H
+#define REPLICA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "Parameters.h"
+#include "Walker.h"
+#include "Simulation.h"
+#include "Ensemble.h"
+#include "Histogram.h"
+#include "Convergence.h"
+#include "Checkpoint.h"
+#include "Configuration.h"
+
+// Advances a replica, which is either the walker w or the ensemble e (if not NULL), over steps first_step to end_step - 1
+void advance_replica(SimulationFun simulation, histogram *bins, walker *w, ensemble *e, parameters *params, \
+        long first_step, long end_step) {
+    if (e != NULL) {
+        simulate_ensemble(bins, e, params, first_step, end_step);
+    } else {
+        (*simulation)(bins, w, params, first_step, end_step); // Performs the lattice switching method
+    }
+}
+
+// Returns the number of timesteps spent in the left well, summed over the walkers of the replica
+long replica_no_left(walker *w, ensemble *e) {
+    return (e != NULL) ? ensemble_no_left(e) : w->no_left;
+}
+
+// Returns the counters of the replica
+counters *replica_counters(walker *w, ensemble *e) {
+    return (e != NULL) ? &e->count : &w->count;
+}
+
+// Returns the record of the lattice switch attempts of the replica, or NULL if they are not recorded
+switch_record *replica_switches(walker *w, ensemble *e) {
+    return (e != NULL) ? e->switches : w->switches;
+}
+
+// Returns the proposal widths and acceptance counts of the replica
+proposal_state *replica_proposal(walker *w, ensemble *e) {
+    return (e != NULL) ? &e->prop : &w->prop;
+}
+
+// Discards the steps run so far as burn-in, clearing the samples in the left well, the histogram and the recorded lattice switch attempts
+void discard_burn_in(histogram *bins, walker *w, ensemble *e, replica_progress *progress) {
+    if (e != NULL) {
+        for (long i = 0; i < e->nowalkers; i++) e->no_left[i] = 0;
+    } else {
+        w->no_left = 0;
+    }
+    if (bins != NULL) {
+        for (long j = 0; j < bins->nobins + 2; j++) bins->counts[j] = 0;
+    }
+    switch_record *switches = replica_switches(w, e);
+    if (switches != NULL) memset(switches, 0, sizeof(switch_record));
+    progress->burn_in = progress->stepno;
+    progress->block_start = progress->stepno;
+    progress->block_left = 0;
+}
+
+// Tunes the proposal widths of a Monte-Carlo replica over the burn-in steps, then freezes them and discards the burn-in (see Proposal.h)
+void burn_in_replica(SimulationFun simulation, histogram *bins, walker *w, ensemble *e, parameters *params, \
+        replica_progress *progress) {
+    proposal_state *prop = replica_proposal(w, e);
+    stream_tap *tap = (w != NULL) ? w->tap : NULL; // The burn-in is not streamed
+    if (w != NULL) w->tap = NULL;
+    for (long round = 0; progress->stepno < params->adapt_steps; round++) {
+        long round_end = progress->stepno + ADAPT_INTERVAL;
+        if (round_end > params->adapt_steps) round_end = params->adapt_steps;
+        advance_replica(simulation, bins, w, e, params, progress->stepno, round_end);
+        progress->stepno = round_end;
+        adapt_proposal(prop, params->target_acceptance, round);
+    }
+    if (w != NULL) w->tap = tap;
+    discard_burn_in(bins, w, e, progress);
+}
+
+// Builds the adaptive bias of a walker over the burn-in steps, then freezes it and discards the burn-in (see Bias.h)
+void build_bias(SimulationFun simulation, histogram *bins, walker *w, parameters *params, replica_progress *progress) {
+    stream_tap *tap = w->tap; // The burn-in is not streamed
+    w->tap = NULL;
+    advance_replica(simulation, bins, w, NULL, params, progress->stepno, params->bias_steps);
+    w->tap = tap;
+    progress->stepno = params->bias_steps;
+    freeze_bias(w->bias);
+    discard_burn_in(bins, w, NULL, progress);
+}
+
+// Sets the result of a replica from the samples taken so far, and marks it as done
+void finish_replica(walker *w, ensemble *e, parameters *params, replica_progress *progress) {
+    long nowalkers = (e != NULL) ? e->nowalkers : 1;
+    long no_left = replica_no_left(w, e); // Timesteps in the left well, summed over walkers
+    long tot_samples = (progress->stepno - progress->burn_in) * nowalkers;
+    progress->result.steps = progress->stepno;
+    progress->result.energy_difference = -params->kT * log((double) (no_left) / (tot_samples - no_left)) \
+                                         + params->shift_value;
+    if (params->nowells > 2) {
+        // Free energy of the left well relative to each well, from the timesteps spent in them
+        for (int k = 0; k < params->nowells; k++) {
+            progress->result.well_differences[k] = -params->kT * log((double) w->no_in_well[0] / w->no_in_well[k]) \
+                                                   + params->shifts[k];
+        }
+        progress->result.energy_difference = progress->result.well_differences[1];
+    }
+    if (w != NULL && w->bias != NULL) {
+        // Reweights the samples of the biased walker to the unbiased potential
+        bias_potential *b = w->bias;
+        progress->result.energy_difference = -params->kT * log(b->weight_left / (b->weight_total - b->weight_left)) \
+                                             + params->shift_value;
+    }
+    progress->result.count = *replica_counters(w, e);
+    proposal_state *prop = replica_proposal(w, e);
+    for (int well = 0; well < 2; well++) {
+        progress->result.jump_size[well] = prop->jump_size[well];
+        progress->result.acceptance[well] = proposal_acceptance(prop, well);
+    }
+    switch_record *switches = replica_switches(w, e);
+    if (switches != NULL) switch_estimates(switches, params, progress->result.estimates);
+    progress->done = 1;
+}
+
+/*
+    Calculates the free energy different between states in the two wells of a given potential function,
+    using the walker w or the ensemble e (if not NULL), continuing from the given progress. The positions
+    are added to bins, unless bins is NULL. If a tolerance is given, the replica stops once the error of
+    the mean of all replicas is expected to be below it. If ckpt is not NULL, the state of the replica is
+    saved every ckpt->steps steps, and once it finishes. If the walker streams its trajectory, a snapshot of
+    the histogram is also streamed every params->stream_histogram steps.
+*/
+replica_result calc_energy_difference(SimulationFun simulation, histogram *bins, walker *w, ensemble *e, \
+        parameters *params, replica_progress *progress, checkpoint *ckpt) {
+    long nowalkers = (e != NULL) ? e->nowalkers : 1;
+    // Each replica needs an error sqrt(noreplicas) times larger than the error of the mean
+    double target_error = params->tolerance * sqrt((double) params->noreplicas);
+
+    if (params->adapt_steps > 0 && progress->burn_in == 0) {
+        burn_in_replica(simulation, bins, w, e, params, progress);
+    }
+    if (params->bias_steps > 0 && progress->burn_in == 0) {
+        build_bias(simulation, bins, w, params, progress);
+    }
+
+    while (!progress->done && progress->stepno < params->tot_steps) {
+        // Runs up to the end of the current block or the next checkpoint, whichever comes first
+        long segment_end = params->tot_steps;
+        long block_end = progress->block_start + progress->blocks.block_steps;
+        if (params->tolerance > 0 && block_end < segment_end) segment_end = block_end;
+        if (ckpt != NULL) {
+            long next_checkpoint = (progress->stepno / ckpt->steps + 1) * ckpt->steps;
+            if (next_checkpoint < segment_end) segment_end = next_checkpoint;
+        }
+        int snapshots = (w != NULL && w->tap != NULL && bins != NULL && params->stream_histogram > 0);
+        if (snapshots) {
+            long next_snapshot = (progress->stepno / params->stream_histogram + 1) * params->stream_histogram;
+            if (next_snapshot < segment_end) segment_end = next_snapshot;
+        }
+
+        advance_replica(simulation, bins, w, e, params, progress->stepno, segment_end);
+        progress->stepno = segment_end;
+
+        if (snapshots && progress->stepno % params->stream_histogram == 0) {
+            stream_histogram(w->tap, progress->stepno, bins);
+        }
+
+        if (params->tolerance > 0 && progress->stepno == block_end) {
+            long left = replica_no_left(w, e);
+            block_average_add(&progress->blocks, (double) (left - progress->block_left), \
+                              (double) ((block_end - progress->block_start) * nowalkers));
+            progress->block_start = block_end;
+            progress->block_left = left;
+            if (block_average_error(&progress->blocks, params, &progress->result.tau) < target_error) break;
+        }
+
+        if (ckpt != NULL && progress->stepno % ckpt->steps == 0 && progress->stepno < params->tot_steps) {
+            double io_start = COUNTERS ? counter_time() : 0;
+            write_checkpoint(ckpt->filename, &ckpt->header, progress, w, e, bins);
+            if (COUNTERS) replica_counters(w, e)->io_seconds += counter_time() - io_start;
+        }
+    }
+
+    if (!progress->done) {
+        finish_replica(w, e, params, progress);
+        if (ckpt != NULL) write_checkpoint(ckpt->filename, &ckpt->header, progress, w, e, bins);
+    }
+    return progress->result;
+}
+
+// Runs one replica of a parameter point on the given random stream, resuming from its checkpoint if restart is set
+// A single walker streams its trajectory through tap, unless it is NULL
+replica_result run_replica(SimulationFun simulation, histogram *bins, uint64_t seed, uint64_t stream, \
+        parameters *params, checkpoint *ckpt, int restart, stream_tap *tap) {
+    replica_result result;
+    replica_progress progress; // How far the replica has got
+    init_replica_progress(&progress, params);
+    if (params->nowalkers > 1) {
+        ensemble e; // State of the walkers for this replica
+        init_ensemble(&e, seed, stream, params);
+        if (restart) read_checkpoint(ckpt->filename, &ckpt->header, &progress, NULL, &e, bins);
+        result = calc_energy_difference(simulation, bins, NULL, &e, params, &progress, ckpt);
+        free_ensemble(&e);
+    } else {
+        walker w; // State of the walker for this replica
+        init_walker(&w, seed, stream, params);
+        w.tap = tap;
+        if (restart) read_checkpoint(ckpt->filename, &ckpt->header, &progress, &w, NULL, bins);
+        result = calc_energy_difference(simulation, bins, &w, NULL, params, &progress, ckpt);
+        free_walker(&w);
+    }
+    return result;
+}
+
+// Runs one replica of a parameter point with a multi-dimensional walker, giving the free energy difference per particle
+replica_result run_configuration(ConfigurationFun simulation, histogram *bins, histogram_2d *bins_2d, uint64_t seed, \
+        uint64_t stream, parameters *params) {
+    replica_result result;
+    configuration c; // State of the particles for this replica
+    init_configuration(&c, seed, stream, params);
+    (*simulation)(bins, bins_2d, &c, params, 1, params->tot_steps);
+
+    long tot_samples = params->tot_steps * c.noparticles; // Particle timesteps, as in calc_energy_difference
+    result.energy_difference = -params->kT * log((double) (c.no_left) / (tot_samples - c.no_left)) \
+                               + params->shift_value;
+    result.steps = params->tot_steps;
+    result.tau = 0;
+    result.count = c.count;
+    for (int well = 0; well < 2; well++) {
+        result.jump_size[well] = params->jump_size;
+        result.acceptance[well] = 0;
+    }
+    result.exchange_acceptance = 0;
+    for (int k = 0; k < NOESTIMATORS; k++) result.estimates[k] = NAN;
+    free_configuration(&c);
+    return result;
+}
+
+#endif // REPLICA_H
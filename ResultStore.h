@@ -0,0 +1,294 @@
+/*
+	ResultStore.h
+	Header file for storing results as binary records instead of lines of text. Each record
+	holds the parameters of a point, the seed, the estimate of every replica, the exact
+	difference of every well (see Reference.h) and optionally the histogram, with every value at full precision. The records of a run are appended to
+	the store with a single write while holding a lock on the file, so many jobs can share one
+	store without interleaving. The store is read back by mapping it into memory, see also
+	data_analysis/result_store.py.
+
+	Layout: a record is a store_record, followed by noreplicas store_replica structures and
+	histogram_length counts (int64_t), all in the byte order of the machine that wrote them.
+*/
+
+#ifndef RESULTSTORE_H
+#define RESULTSTORE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Parameters.h"
+#include "Walker.h"
+#include "Histogram.h"
+
+#define STORE_MAGIC "LSRES006" // Identifies records and their format version
+#define STORE_NAME_LENGTH 64   // Size of the name fields of a record, including the terminating zero
+
+/* Structure at the start of every record, made only of 8 byte fields so it has no padding */
+struct store_record {
+    char magic[8];
+    int64_t record_size;       // Size of the whole record in bytes
+    uint64_t seed;             // Seed of the simulation
+    char dynamics_type[STORE_NAME_LENGTH];
+    char potential_name[STORE_NAME_LENGTH];
+    int64_t tot_steps;
+    int64_t start_well;
+    int64_t switch_regularity;
+    int64_t noreplicas;
+    int64_t nowalkers;
+    int64_t block_steps;
+    double kT;
+    double mass;
+    double timestep;
+    double jump_size;
+    double friction_param;
+    double tolerance;
+    int64_t adapt_steps;       // Proposals of the Monte-Carlo method
+    double target_acceptance;
+    int64_t gaussian_proposal;
+    int64_t tries;
+    int64_t exchange_steps;    // Steps between exchanges of parallel tempering, 0 for none
+    int64_t estimators;        // Indicates that the replicas have estimates from the lattice switch attempts
+    double shift_value;
+    double minima[2];
+    double x_min;              // Bins of the histogram
+    double x_max;
+    int64_t nobins;
+    double energy_difference;  // Mean free energy difference of the replicas
+    double std_error;          // Standard error of the mean
+    double exact_differences[MAX_WELLS]; // Exact F_0 - F_k of each well k, NAN beyond the wells of the potential
+    int64_t steps;             // Number of steps used, summed over the replicas
+    int64_t histogram_length;  // Number of histogram counts, including the underflow and overflow bins, 0 if none
+};
+
+typedef struct store_record store_record;
+
+/* Structure to store the result of one replica in a record */
+struct store_replica {
+    double energy_difference;
+    double tau;
+    int64_t steps;
+    double jump_size[2];  // Proposal width of each well used for the samples (Monte-Carlo method)
+    double acceptance[2]; // Acceptance rate of moves from each well after the burn-in (Monte-Carlo method)
+    double exchange_acceptance; // Acceptance rate of exchanges with the next temperature (parallel tempering)
+    double estimates[NOESTIMATORS]; // Left and right exponential averages and Bennett acceptance ratio (NAN if not recorded)
+};
+
+typedef struct store_replica store_replica;
+
+/* Structure to store a result store mapped into memory for reading */
+struct result_store {
+    char *data;    // Contents of the store
+    size_t size;   // Size of the store in bytes
+    size_t offset; // Offset of the next record
+};
+
+typedef struct result_store result_store;
+
+
+// Returns the size of a record with the given number of replicas and histogram counts
+size_t store_record_size(long noreplicas, long histogram_length) {
+    return sizeof(store_record) + sizeof(store_replica) * noreplicas + sizeof(int64_t) * histogram_length;
+}
+
+// Checks that the names of every point fit in a record, so a run is refused before it starts rather than cut short
+void check_store_names(parameters *points, long nopoints) {
+    for (long point = 0; point < nopoints; point++) {
+        if (strlen(points[point].dynamics_type) >= STORE_NAME_LENGTH || \
+            strlen(points[point].potential_name) >= STORE_NAME_LENGTH) {
+            printf("Names of dynamics and potentials in a binary store must be shorter than %d characters\n", \
+                   STORE_NAME_LENGTH);
+            exit(1);
+        }
+    }
+}
+
+/*
+    Fills a record at buffer with the parameters of a point, the results of its replicas, their mean and
+    standard error, the exact differences of its wells and the histogram bins (unless NULL), returning a
+    pointer past the end of the record
+*/
+char *fill_store_record(char *buffer, uint64_t seed, parameters *params, replica_result *results, \
+        double mean_energy_diff, double std_error, long steps, double *exact, histogram *bins) {
+    long histogram_length = (bins != NULL) ? bins->nobins + 2 : 0;
+    store_record record;
+    memset(&record, 0, sizeof(store_record)); // Also pads the names with zeros
+    memcpy(record.magic, STORE_MAGIC, 8);
+    record.record_size = (int64_t) store_record_size(params->noreplicas, histogram_length);
+    record.seed = seed;
+    check_store_names(params, 1);
+    memcpy(record.dynamics_type, params->dynamics_type, strlen(params->dynamics_type));
+    memcpy(record.potential_name, params->potential_name, strlen(params->potential_name));
+    record.tot_steps = params->tot_steps;
+    record.start_well = params->start_well;
+    record.switch_regularity = params->switch_regularity;
+    record.noreplicas = params->noreplicas;
+    record.nowalkers = params->nowalkers;
+    record.block_steps = params->block_steps;
+    record.kT = params->kT;
+    record.mass = params->mass;
+    record.timestep = params->timestep;
+    record.jump_size = params->jump_size;
+    record.friction_param = params->friction_param;
+    record.tolerance = params->tolerance;
+    record.adapt_steps = params->adapt_steps;
+    record.target_acceptance = params->target_acceptance;
+    record.gaussian_proposal = params->gaussian_proposal;
+    record.tries = params->tries;
+    record.exchange_steps = params->exchange_steps;
+    record.estimators = params->estimators;
+    record.shift_value = params->shift_value;
+    record.minima[0] = params->minima[0];
+    record.minima[1] = params->minima[1];
+    record.x_min = params->x_min;
+    record.x_max = params->x_max;
+    record.nobins = params->nobins;
+    record.energy_difference = mean_energy_diff;
+    record.std_error = std_error;
+    for (int k = 0; k < MAX_WELLS; k++) record.exact_differences[k] = exact[k];
+    record.steps = steps;
+    record.histogram_length = histogram_length;
+
+    memcpy(buffer, &record, sizeof(store_record));
+    buffer += sizeof(store_record);
+    for (int i = 0; i < params->noreplicas; i++) {
+        store_replica replica = {results[i].energy_difference, results[i].tau, results[i].steps, \
+                                 {results[i].jump_size[0], results[i].jump_size[1]}, \
+                                 {results[i].acceptance[0], results[i].acceptance[1]}, \
+                                 results[i].exchange_acceptance, \
+                                 {results[i].estimates[0], results[i].estimates[1], results[i].estimates[2]}};
+        memcpy(buffer, &replica, sizeof(store_replica));
+        buffer += sizeof(store_replica);
+    }
+    for (long j = 0; j < histogram_length; j++) {
+        int64_t count = bins->counts[j];
+        memcpy(buffer, &count, sizeof(int64_t));
+        buffer += sizeof(int64_t);
+    }
+    return buffer;
+}
+
+/*
+    Appends size bytes to a store as a single write, holding an exclusive lock on the file so that
+    concurrent writers cannot interleave, and makes sure the data is on disk before returning
+*/
+void append_to_store(char *filename, char *data, size_t size) {
+    int fd = open(filename, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        printf("Failed to open results file %s\n", filename);
+        exit(1);
+    }
+
+    struct flock lock; // Lock on the whole file
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    while (fcntl(fd, F_SETLKW, &lock) != 0) {
+        if (errno != EINTR) {
+            printf("Failed to lock results file %s\n", filename);
+            exit(1);
+        }
+    }
+
+    size_t written = 0;
+    while (written < size) {
+        ssize_t n = write(fd, data + written, size - written);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            printf("Failed to write results file %s\n", filename);
+            exit(1);
+        }
+        written += (size_t) n;
+    }
+    if (fsync(fd) != 0) {
+        printf("Failed to write results file %s\n", filename);
+        exit(1);
+    }
+
+    lock.l_type = F_UNLCK;
+    fcntl(fd, F_SETLK, &lock);
+    close(fd);
+}
+
+/*
+    Appends one record for every point of a run to a store. results holds the replicas of every point
+    in turn, exact the MAX_WELLS exact differences of every point in turn, and bins (unless NULL) is the
+    histogram of a run of a single point.
+*/
+void write_store_records(parameters *points, long nopoints, uint64_t seed, replica_result *results, \
+        double *means, double *std_errors, long *steps, double *exact, histogram *bins, char *filename) {
+    size_t size = 0;
+    for (long point = 0; point < nopoints; point++) {
+        size += store_record_size(points[point].noreplicas, (bins != NULL) ? bins->nobins + 2 : 0);
+    }
+    char *buffer = malloc(size);
+    if (buffer == NULL) {
+        printf("Failed to allocate results\n");
+        exit(1);
+    }
+
+    char *end = buffer;
+    long first_replica = 0;
+    for (long point = 0; point < nopoints; point++) {
+        end = fill_store_record(end, seed, &points[point], &results[first_replica], means[point], std_errors[point], \
+                                steps[point], &exact[point * MAX_WELLS], bins);
+        first_replica += points[point].noreplicas;
+    }
+    append_to_store(filename, buffer, size);
+    free(buffer);
+}
+
+// Maps a store into memory for reading, returning 0 if it cannot be opened
+int open_result_store(result_store *store, char *filename) {
+    store->data = NULL;
+    store->size = 0;
+    store->offset = 0;
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        return 0;
+    }
+    store->size = (size_t) file_stat.st_size;
+    if (store->size > 0) {
+        store->data = mmap(NULL, store->size, PROT_READ, MAP_SHARED, fd, 0);
+        if (store->data == MAP_FAILED) {
+            store->data = NULL;
+            close(fd);
+            return 0;
+        }
+    }
+    close(fd); // The mapping stays valid
+    return 1;
+}
+
+void close_result_store(result_store *store) {
+    if (store->data != NULL) munmap(store->data, store->size);
+}
+
+/*
+    Returns the next record of a store, pointing replicas and counts at its replica results and
+    histogram counts, or NULL after the last complete record. The pointers are into the mapping,
+    so nothing is copied. Records are aligned to 8 bytes, as every field is 8 bytes long.
+*/
+store_record *result_store_next(result_store *store, store_replica **replicas, int64_t **counts) {
+    if (store->size - store->offset < sizeof(store_record)) return NULL;
+    store_record *record = (store_record *) (store->data + store->offset);
+    if (memcmp(record->magic, STORE_MAGIC, 8) != 0 || record->record_size < (int64_t) sizeof(store_record) || \
+        (size_t) record->record_size > store->size - store->offset) {
+        return NULL;
+    }
+    *replicas = (store_replica *) (store->data + store->offset + sizeof(store_record));
+    *counts = (int64_t *) ((char *) *replicas + sizeof(store_replica) * record->noreplicas);
+    store->offset += (size_t) record->record_size;
+    return record;
+}
+
+#endif // RESULTSTORE_H
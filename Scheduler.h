@@ -0,0 +1,114 @@
+/*
+	Scheduler.h
+	Header file for a work-stealing scheduler over a range of independent tasks, numbered
+	0 to notasks - 1. Each thread starts with an equal contiguous share of the tasks and
+	takes them from the front. A thread that runs out steals the back half of another
+	thread's remaining tasks, so uneven tasks (e.g. low and high temperatures, or different
+	dynamics) keep every thread busy until the end.
+*/
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/* Structure to store the tasks remaining for one thread */
+struct task_queue {
+    long begin;    // First remaining task
+    long end;      // One past the last remaining task
+#ifdef _OPENMP
+    omp_lock_t lock;
+#endif
+    char pad[64];  // Keeps the queues of different threads on different cache lines
+};
+
+typedef struct task_queue task_queue;
+
+/* Structure to store the queues of every thread */
+struct scheduler {
+    int nothreads;      // Number of threads taking tasks
+    task_queue *queues; // Queue of each thread
+};
+
+typedef struct scheduler scheduler;
+
+
+// Divides notasks tasks evenly between nothreads threads
+void init_scheduler(scheduler *s, long notasks, int nothreads) {
+    s->nothreads = nothreads;
+    s->queues = malloc(sizeof(task_queue) * nothreads);
+    if (s->queues == NULL) {
+        printf("Failed to allocate scheduler\n");
+        exit(1);
+    }
+    for (int t = 0; t < nothreads; t++) {
+        s->queues[t].begin = notasks * t / nothreads;
+        s->queues[t].end = notasks * (t + 1) / nothreads;
+#ifdef _OPENMP
+        omp_init_lock(&s->queues[t].lock);
+#endif
+    }
+}
+
+void free_scheduler(scheduler *s) {
+#ifdef _OPENMP
+    for (int t = 0; t < s->nothreads; t++) omp_destroy_lock(&s->queues[t].lock);
+#endif
+    free(s->queues);
+}
+
+static inline void lock_queue(task_queue *q) {
+#ifdef _OPENMP
+    omp_set_lock(&q->lock);
+#endif
+}
+
+static inline void unlock_queue(task_queue *q) {
+#ifdef _OPENMP
+    omp_unset_lock(&q->lock);
+#endif
+}
+
+// Stores the next task for a thread in task, returning 0 once there are no tasks left anywhere
+int scheduler_next(scheduler *s, int thread, long *task) {
+    task_queue *own = &s->queues[thread];
+
+    lock_queue(own);
+    if (own->begin < own->end) {
+        *task = own->begin++;
+        unlock_queue(own);
+        return 1;
+    }
+    unlock_queue(own);
+
+    // Own queue is empty, so steals from the other threads in turn
+    for (int offset = 1; offset < s->nothreads; offset++) {
+        task_queue *victim = &s->queues[(thread + offset) % s->nothreads];
+        long stolen_begin = 0, stolen_end = 0; // Range of tasks taken from the victim
+
+        lock_queue(victim);
+        long remaining = victim->end - victim->begin;
+        if (remaining > 0) {
+            stolen_end = victim->end;
+            stolen_begin = victim->end - (remaining + 1) / 2;
+            victim->end = stolen_begin;
+        }
+        unlock_queue(victim);
+
+        if (stolen_end > stolen_begin) {
+            *task = stolen_begin;
+            lock_queue(own);
+            own->begin = stolen_begin + 1;
+            own->end = stolen_end;
+            unlock_queue(own);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#endif // SCHEDULER_H
@@ -0,0 +1,303 @@
+/*
+	Simulation.h
+	Header file for the lattice switch procedure on a single walker. The step loop is
+	written once, taking the dynamics step and the fused energy and force kernel of the
+	potential as arguments, and is instantiated for every pair of dynamics and potential.
+	Each instance calls its dynamics and potential directly, so the compiler can inline
+	the whole step, and the pair is selected once at startup.
+*/
+
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include "Parameters.h"
+#include "Walker.h"
+#include "Dynamics.h"
+#include "Histogram.h"
+#include "MiscFunctions.h"
+
+// Typedef for a function pointer to an instantiated simulation
+typedef void (*SimulationFun)(histogram*, walker*, parameters*, long, long);
+
+// Returns the x-position of a particle in space given its displacement from the current well minima
+static inline double x_pos(double displacement, int well, parameters *params) {
+    return displacement + params->minima[well];
+}
+
+// Returns the displacement from the current well minima given its x position in space
+static inline double well_dis(double x_position, int well, parameters *params) {
+    return x_position - params->minima[well];
+}
+
+// Returns the potential at x shifted so that the minima are level, given the unshifted potential
+static inline double shifted_energy(double energy, double x, parameters *params) {
+    return (x > 0) ? energy + params->shift_value : energy;
+}
+
+/*
+    Attempts a lattice switch from the walker's position in its current well. The position is translated
+    by the distance between the minima and the momentum is kept, so the map preserves phase space volume
+    and the kinetic energy cancels from the acceptance.
+*/
+static inline __attribute__((always_inline)) void lattice_switch(walker *w, parameters *params, \
+        EnergyForceFun energy_and_force) {
+    double dis = well_dis(w->x, w->cur_well, params); // Displacement from the current well
+    int oth_well = (w->cur_well + 1) % 2; // Other well
+    double oth_x = x_pos(dis, oth_well, params); // Position with the same displacement in the other well
+    double oth_force;
+    double oth_energy = energy_and_force(oth_x, &oth_force);
+    double oth_bias = (w->bias != NULL) ? bias_energy_force(w->bias, oth_x, &oth_force) : 0;
+    // Difference in potential (and bias), using the potential already known at the current position
+    double diff_poten = shifted_energy(oth_energy, oth_x, params) + oth_bias \
+                        - shifted_energy(w->energy, w->x, params) - w->bias_energy;
+    if (w->switches != NULL) switch_record_add(w->switches, w->cur_well, diff_poten / params->kT);
+    // Attempts a Monte-Carlo lattice switch
+    COUNTER_ADD(w->count, switch_attempts, 1);
+    if (rng_uniform(&w->rng) < min(1, exp(-diff_poten / params->kT))) {
+        COUNTER_ADD(w->count, switch_accepts, 1);
+        w->cur_well = oth_well;
+        w->x = oth_x;
+        w->energy = oth_energy;
+        w->force = oth_force;
+        w->bias_energy = oth_bias;
+    }
+}
+
+/*
+    Performs the lattice switching method on a walker for steps first_step to end_step - 1, a run being
+    steps 1 to tot_steps - 1. The positions of the walker are added to bins, unless bins is NULL. A walker
+    with an adaptive bias deposits bias at every step until it is frozen, and is reweighted after that.
+*/
+static inline __attribute__((always_inline)) void simulate(histogram *bins, walker *w, parameters *params, \
+        long first_step, long end_step, DynamicsFun dynamics, EnergyForceFun energy_and_force) {
+    w->energy = energy_and_force(w->x, &w->force);
+    apply_bias(w);
+
+    for (long stepno = first_step; stepno < end_step; stepno++) {
+        int timed = timed_step(stepno); // Whether the phases of this step are timed
+        double phase_start = timed ? counter_time() : 0;
+
+        if (bins != NULL) {
+            histogram_add(bins, w->x);
+            end_phase(timed, &phase_start, &w->count.bins_seconds);
+        }
+
+        if (w->cur_well == 0) {
+            // Indicates that the particle was in the left well
+            w->no_left++;
+        }
+
+        if (w->bias != NULL) {
+            if (w->bias->adapting) {
+                // Builds the bias, then brings the force and bias at the walker's position up to date with it
+                bias_deposit(w->bias, w->x);
+                w->energy = energy_and_force(w->x, &w->force);
+                apply_bias(w);
+            } else {
+                bias_sample(w->bias, w->bias_energy, w->cur_well, params->kT);
+            }
+        }
+
+        if (w->tap != NULL && stepno % w->tap->decimation == 0) {
+            stream_position(w->tap, STREAM_SAMPLE, stepno, w->x, w->cur_well);
+        }
+
+        if (isnan(w->x) || (w->x == INFINITY) || (w->x == -INFINITY)) {
+            printf("Infinite x value reached\n");
+            COUNTER_ADD(w->count, nonfinite, 1);
+        }
+
+        // Perform dynamics step
+        dynamics(w, params, energy_and_force);
+
+        // Recalibrate the wells if a particle has managed to cross over the barrier
+        if ((w->cur_well == 0) && (w->x > 0)) {
+            w->cur_well = 1;
+            COUNTER_ADD(w->count, crossings, 1);
+        } else if ((w->cur_well == 1) && (w->x < 0)) {
+            w->cur_well = 0;
+            COUNTER_ADD(w->count, crossings, 1);
+        }
+        end_phase(timed, &phase_start, &w->count.dynamics_seconds);
+
+        // Attempts a lattice switch
+        if (stepno % params->switch_regularity == 0) {
+            int well_before = w->cur_well;
+            lattice_switch(w, params, energy_and_force);
+            if (w->tap != NULL && w->cur_well != well_before) {
+                stream_position(w->tap, STREAM_SWITCH, stepno, w->x, w->cur_well);
+            }
+            end_phase(timed, &phase_start, &w->count.switch_seconds);
+        }
+    }
+}
+
+
+/* N-well mode, for potentials with more than two wells */
+
+// Returns the well containing x
+static inline int find_well(double x, parameters *params) {
+    return boundary_well(x, params->boundaries, params->nowells);
+}
+
+// Returns whether x lies in the given well
+static inline int in_well(double x, int well, parameters *params) {
+    return (well == 0 || x > params->boundaries[well - 1]) && \
+           (well == params->nowells - 1 || x <= params->boundaries[well]);
+}
+
+/*
+    Attempts a lattice switch to one of the other wells, chosen uniformly so that the proposal is symmetric.
+    A switch whose position would fall outside the target well is rejected, which keeps the map between
+    the wells reversible, and the shift of every well is applied by position as in the shifted potential.
+*/
+static inline __attribute__((always_inline)) void lattice_switch_wells(walker *w, parameters *params, \
+        EnergyForceFun energy_and_force) {
+    int nowells = params->nowells;
+    int oth_well = (w->cur_well + 1 + (int) (rng_uniform(&w->rng) * (nowells - 1))) % nowells; // Target well
+    double oth_x = x_pos(well_dis(w->x, w->cur_well, params), oth_well, params);
+    COUNTER_ADD(w->count, switch_attempts, 1);
+    if (!in_well(oth_x, oth_well, params)) return;
+
+    double oth_force;
+    double oth_energy = energy_and_force(oth_x, &oth_force);
+    double diff_poten = oth_energy + params->shifts[oth_well] - w->energy - params->shifts[w->cur_well];
+    if (rng_uniform(&w->rng) < min(1, exp(-diff_poten / params->kT))) {
+        COUNTER_ADD(w->count, switch_accepts, 1);
+        w->cur_well = oth_well;
+        w->x = oth_x;
+        w->energy = oth_energy;
+        w->force = oth_force;
+    }
+}
+
+/*
+    Performs the lattice switching method on a walker for a potential with more than two wells, as in
+    simulate. The timesteps spent in each well are counted in no_in_well. After each dynamics step the
+    walker is checked against the boundaries of its own well, and its well is only searched for once
+    it has crossed one of them.
+*/
+static inline __attribute__((always_inline)) void simulate_wells(histogram *bins, walker *w, parameters *params, \
+        long first_step, long end_step, DynamicsFun dynamics, EnergyForceFun energy_and_force) {
+    w->energy = energy_and_force(w->x, &w->force);
+
+    for (long stepno = first_step; stepno < end_step; stepno++) {
+        int timed = timed_step(stepno); // Whether the phases of this step are timed
+        double phase_start = timed ? counter_time() : 0;
+
+        if (bins != NULL) {
+            histogram_add(bins, w->x);
+            end_phase(timed, &phase_start, &w->count.bins_seconds);
+        }
+
+        w->no_in_well[w->cur_well]++;
+
+        if (w->tap != NULL && stepno % w->tap->decimation == 0) {
+            stream_position(w->tap, STREAM_SAMPLE, stepno, w->x, w->cur_well);
+        }
+
+        if (isnan(w->x) || (w->x == INFINITY) || (w->x == -INFINITY)) {
+            printf("Infinite x value reached\n");
+            COUNTER_ADD(w->count, nonfinite, 1);
+        }
+
+        // Perform dynamics step
+        dynamics(w, params, energy_and_force);
+
+        // Recalibrate the well if the particle has crossed a barrier
+        if (!in_well(w->x, w->cur_well, params)) {
+            w->cur_well = find_well(w->x, params);
+            COUNTER_ADD(w->count, crossings, 1);
+        }
+        end_phase(timed, &phase_start, &w->count.dynamics_seconds);
+
+        // Attempts a lattice switch
+        if (stepno % params->switch_regularity == 0) {
+            int well_before = w->cur_well;
+            lattice_switch_wells(w, params, energy_and_force);
+            if (w->tap != NULL && w->cur_well != well_before) {
+                stream_position(w->tap, STREAM_SWITCH, stepno, w->x, w->cur_well);
+            }
+            end_phase(timed, &phase_start, &w->count.switch_seconds);
+        }
+    }
+}
+
+
+// Instantiates the simulation for one pair of dynamics and potential
+#define SIMULATION(DYNAMICS, POTEN) \
+    void DYNAMICS##_##POTEN##_simulate(histogram *bins, walker *w, parameters *params, long first_step, \
+            long end_step) { \
+        simulate(bins, w, params, first_step, end_step, &DYNAMICS, &POTEN##_energy_and_force); \
+    }
+
+SIMULATION(BAOAB_limit, KT)
+SIMULATION(BAOAB_limit, QUARTIC)
+SIMULATION(BAOAB_limit, DIFF_WIDTH)
+SIMULATION(BAOAB_regular, KT)
+SIMULATION(BAOAB_regular, QUARTIC)
+SIMULATION(BAOAB_regular, DIFF_WIDTH)
+SIMULATION(Monte_Carlo_step, KT)
+SIMULATION(Monte_Carlo_step, QUARTIC)
+SIMULATION(Monte_Carlo_step, DIFF_WIDTH)
+SIMULATION(BAOAB_limit, TABULATED)
+SIMULATION(BAOAB_regular, TABULATED)
+SIMULATION(Monte_Carlo_step, TABULATED)
+SIMULATION(BAOAB_limit, EXPRESSION)
+SIMULATION(BAOAB_regular, EXPRESSION)
+SIMULATION(Monte_Carlo_step, EXPRESSION)
+
+// Instantiates the N-well simulation for one pair of dynamics and potential
+#define SIMULATION_WELLS(DYNAMICS, POTEN) \
+    void DYNAMICS##_##POTEN##_simulate(histogram *bins, walker *w, parameters *params, long first_step, \
+            long end_step) { \
+        simulate_wells(bins, w, params, first_step, end_step, &DYNAMICS, &POTEN##_energy_and_force); \
+    }
+
+SIMULATION_WELLS(BAOAB_limit, TRIPLE)
+SIMULATION_WELLS(BAOAB_regular, TRIPLE)
+SIMULATION_WELLS(Monte_Carlo_step, TRIPLE)
+SIMULATION_WELLS(BAOAB_limit, TABULATED_WELLS)
+SIMULATION_WELLS(BAOAB_regular, TABULATED_WELLS)
+SIMULATION_WELLS(Monte_Carlo_step, TABULATED_WELLS)
+SIMULATION_WELLS(BAOAB_limit, EXPRESSION_WELLS)
+SIMULATION_WELLS(BAOAB_regular, EXPRESSION_WELLS)
+SIMULATION_WELLS(Monte_Carlo_step, EXPRESSION_WELLS)
+
+// Returns the simulation instantiated for the chosen dynamics and potential
+SimulationFun Simulation_selector(char dynamics_type[], char potential_name[]) {
+    SimulationFun sim_fun = NULL; // Simulation for the chosen dynamics and potential
+    int baoab = (strcmp(dynamics_type, "BAOAB_LIMIT") == 0);
+    int regular = (strcmp(dynamics_type, "BAOAB_REGULAR") == 0); // Otherwise Monte-Carlo
+    if (strcmp(potential_name, "KT") == 0) {
+        sim_fun = baoab ? &BAOAB_limit_KT_simulate : (regular ? &BAOAB_regular_KT_simulate : \
+                                                                &Monte_Carlo_step_KT_simulate);
+    } else if (strcmp(potential_name, "QUARTIC") == 0) {
+        sim_fun = baoab ? &BAOAB_limit_QUARTIC_simulate : (regular ? &BAOAB_regular_QUARTIC_simulate : \
+                                                                     &Monte_Carlo_step_QUARTIC_simulate);
+    } else if (strcmp(potential_name, "DIFF_WIDTH") == 0) {
+        sim_fun = baoab ? &BAOAB_limit_DIFF_WIDTH_simulate : (regular ? &BAOAB_regular_DIFF_WIDTH_simulate : \
+                                                                        &Monte_Carlo_step_DIFF_WIDTH_simulate);
+    } else if (strcmp(potential_name, "TRIPLE") == 0) {
+        sim_fun = baoab ? &BAOAB_limit_TRIPLE_simulate : (regular ? &BAOAB_regular_TRIPLE_simulate : \
+                                                                    &Monte_Carlo_step_TRIPLE_simulate);
+    } else if (strcmp(potential_name, "TABULATED") == 0 && TABULATED_TABLE.wells.nowells > 2) {
+        sim_fun = baoab ? &BAOAB_limit_TABULATED_WELLS_simulate : (regular ? &BAOAB_regular_TABULATED_WELLS_simulate : \
+                                                                             &Monte_Carlo_step_TABULATED_WELLS_simulate);
+    } else if (strcmp(potential_name, "TABULATED") == 0) {
+        sim_fun = baoab ? &BAOAB_limit_TABULATED_simulate : (regular ? &BAOAB_regular_TABULATED_simulate : \
+                                                                       &Monte_Carlo_step_TABULATED_simulate);
+    } else if (strcmp(potential_name, "EXPRESSION") == 0 && EXPRESSION_LAYOUT.nowells > 2) {
+        sim_fun = baoab ? &BAOAB_limit_EXPRESSION_WELLS_simulate : (regular ? &BAOAB_regular_EXPRESSION_WELLS_simulate : \
+                                                                              &Monte_Carlo_step_EXPRESSION_WELLS_simulate);
+    } else if (strcmp(potential_name, "EXPRESSION") == 0) {
+        sim_fun = baoab ? &BAOAB_limit_EXPRESSION_simulate : (regular ? &BAOAB_regular_EXPRESSION_simulate : \
+                                                                        &Monte_Carlo_step_EXPRESSION_simulate);
+    }
+    return sim_fun;
+}
+
+#endif // SIMULATION_H
@@ -0,0 +1,310 @@
+/*
+	Stream.h
+	Header file for streaming decimated trajectories, lattice switch events and histogram
+	snapshots to <datastore>.stream while the replicas run. Every thread running replicas
+	has its own single-producer ring buffer of events, which a background writer thread
+	drains without locks, packs into blocks, compresses with zlib and appends to the file.
+	The step loop only copies an event into its ring, so it never waits for the disk: if a
+	ring is full the event is dropped and counted, and the number of dropped events is
+	reported at the end. Streaming does not touch the random streams, so the results are
+	the same with and without it. Burn-in steps are not streamed, as they are discarded.
+
+	A run resumed with RESTART appends to the stream written before it stopped, after cutting
+	off any block the stopped run left half written, so the steps run after the last
+	checkpoint appear twice, once from each run, with the same task and step.
+
+	Layout: the file starts with STREAM_MAGIC, followed by blocks, each an int64_t of the
+	size of the block before compression, an int64_t of its compressed size and the zlib
+	data. A block is a sequence of whole events, each a stream_event_header, followed by the
+	position (double) and well (int64_t) for samples and switches, or by nocounts histogram
+	counts (int64_t) for snapshots, all in the byte order of the machine that wrote them.
+	See data_analysis/stream_reader.py.
+*/
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "Parameters.h"
+#include "Histogram.h"
+
+#define STREAM_MAGIC "LSSTRM01"  // Identifies stream files and their format version
+#define STREAM_RING_SIZE 65536   // Number of events each ring holds, a power of 2
+#define STREAM_IDLE_NS 1000000   // Time the writer sleeps when every ring is empty
+
+// Types of event
+#define STREAM_SAMPLE 0    // Position and well of a walker, every "decimation" steps
+#define STREAM_SWITCH 1    // Accepted lattice switch, with the position and well after it
+#define STREAM_HISTOGRAM 2 // Snapshot of the histogram of a replica
+
+/* Structure at the start of every event in a block */
+struct stream_event_header {
+    int32_t type;     // Type of event
+    int32_t task;     // Task (replica of a point) the event belongs to
+    int64_t step;     // Step at which the event happened
+    int64_t nocounts; // Number of histogram counts following a snapshot, 0 otherwise
+};
+
+typedef struct stream_event_header stream_event_header;
+
+/* Structure to store an event in a ring */
+struct stream_event {
+    stream_event_header header;
+    double x;        // Position of the walker
+    int64_t well;    // Well of the walker
+    int64_t *counts; // Copy of the histogram counts of a snapshot, freed by the writer
+};
+
+typedef struct stream_event stream_event;
+
+/* Structure to store the events of one thread, produced by that thread and consumed by the writer */
+struct stream_ring {
+    unsigned long head;    // Number of events pushed, written only by the producer
+    char pad_head[56];     // Keeps head and tail on different cache lines
+    unsigned long tail;    // Number of events popped, written only by the writer
+    char pad_tail[56];
+    long dropped;          // Number of events dropped because the ring was full, written only by the producer
+    stream_event *events;  // STREAM_RING_SIZE events
+};
+
+typedef struct stream_ring stream_ring;
+
+/* Structure to store what a replica streams and where */
+struct stream_tap {
+    stream_ring *ring; // Ring of the thread running the replica
+    int task;          // Task of the replica
+    long decimation;   // Number of steps between samples of the trajectory
+};
+
+typedef struct stream_tap stream_tap;
+
+/* Structure to store the background writer */
+struct stream_writer {
+    FILE *file;            // Stream file
+    char *filename;
+    int norings;           // Number of rings, one for each thread running replicas
+    stream_ring *rings;
+    long block_size;       // Number of bytes of events collected before a block is compressed
+    char *block;           // Events of the current block
+    long block_capacity;   // Number of bytes allocated for the block, larger than block_size for large snapshots
+    long block_used;       // Number of bytes used in the current block
+    int stop;              // Set once the replicas have finished, so the writer drains the rings and exits
+    pthread_t thread;
+};
+
+typedef struct stream_writer stream_writer;
+
+
+/* Producer side, called from the step loop */
+
+// Copies an event into a ring, or drops it if the ring is full, so the caller never waits
+static inline void stream_push(stream_ring *ring, stream_event *event) {
+    unsigned long head = ring->head;
+    unsigned long tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (head - tail == STREAM_RING_SIZE) {
+        ring->dropped++;
+        free(event->counts);
+        return;
+    }
+    ring->events[head & (STREAM_RING_SIZE - 1)] = *event;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE); // Publishes the event to the writer
+}
+
+// Streams the position and well of a walker, as a sample or a switch
+static inline void stream_position(stream_tap *tap, int32_t type, long step, double x, int well) {
+    stream_event event = {{type, tap->task, step, 0}, x, well, NULL};
+    stream_push(tap->ring, &event);
+}
+
+// Streams a snapshot of a histogram
+void stream_histogram(stream_tap *tap, long step, histogram *bins) {
+    long nocounts = bins->nobins + 2;
+    int64_t *counts = malloc(sizeof(int64_t) * nocounts);
+    if (counts == NULL) {
+        tap->ring->dropped++;
+        return;
+    }
+    for (long j = 0; j < nocounts; j++) counts[j] = bins->counts[j];
+    stream_event event = {{STREAM_HISTOGRAM, tap->task, step, nocounts}, 0, 0, counts};
+    stream_push(tap->ring, &event);
+}
+
+
+/* Writer side */
+
+// Compresses the current block and appends it to the file
+static void flush_stream_block(stream_writer *s) {
+    if (s->block_used == 0) return;
+    uLongf compressed_size = compressBound(s->block_used);
+    Bytef *compressed = malloc(compressed_size);
+    if (compressed == NULL || compress2(compressed, &compressed_size, (Bytef *) s->block, s->block_used, \
+                                        Z_BEST_SPEED) != Z_OK) {
+        printf("Failed to compress stream block\n");
+        exit(1);
+    }
+    int64_t sizes[2] = {s->block_used, (int64_t) compressed_size};
+    if (fwrite(sizes, sizeof(sizes), 1, s->file) != 1 || fwrite(compressed, compressed_size, 1, s->file) != 1) {
+        printf("Failed to write stream %s\n", s->filename);
+        exit(1);
+    }
+    free(compressed);
+    s->block_used = 0;
+}
+
+// Makes room for an event of size bytes in the current block, flushing it first if the event would not fit
+static void reserve_stream_block(stream_writer *s, long size) {
+    if (s->block_used + size > s->block_size) flush_stream_block(s);
+    if (size > s->block_capacity) {
+        // Snapshots larger than a block get a block of their own
+        s->block = realloc(s->block, size);
+        if (s->block == NULL) {
+            printf("Failed to allocate stream block\n");
+            exit(1);
+        }
+        s->block_capacity = size;
+    }
+}
+
+// Appends data to the current block, which has room for it
+static inline void append_stream_block(stream_writer *s, const void *data, long size) {
+    memcpy(s->block + s->block_used, data, size);
+    s->block_used += size;
+}
+
+// Encodes an event into the current block, so that no event is split between blocks
+static void write_stream_event(stream_writer *s, stream_event *event) {
+    if (event->header.type == STREAM_HISTOGRAM) {
+        long counts_size = sizeof(int64_t) * event->header.nocounts;
+        reserve_stream_block(s, sizeof(stream_event_header) + counts_size);
+        append_stream_block(s, &event->header, sizeof(stream_event_header));
+        append_stream_block(s, event->counts, counts_size);
+        free(event->counts);
+    } else {
+        reserve_stream_block(s, sizeof(stream_event_header) + sizeof(double) + sizeof(int64_t));
+        append_stream_block(s, &event->header, sizeof(stream_event_header));
+        append_stream_block(s, &event->x, sizeof(double));
+        append_stream_block(s, &event->well, sizeof(int64_t));
+    }
+}
+
+// Drains every ring until the replicas have finished and the rings are empty
+static void *run_stream_writer(void *arg) {
+    stream_writer *s = arg;
+    for (;;) {
+        int stopping = __atomic_load_n(&s->stop, __ATOMIC_ACQUIRE); // Read before draining, so no event is missed
+        long nopopped = 0;
+        for (int r = 0; r < s->norings; r++) {
+            stream_ring *ring = &s->rings[r];
+            unsigned long tail = ring->tail;
+            unsigned long head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+            for (; tail != head; tail++, nopopped++) {
+                write_stream_event(s, &ring->events[tail & (STREAM_RING_SIZE - 1)]);
+            }
+            __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE); // Frees the slots for the producer
+        }
+        if (stopping && nopopped == 0) break;
+        if (nopopped == 0) {
+            struct timespec idle = {0, STREAM_IDLE_NS};
+            nanosleep(&idle, NULL);
+        }
+    }
+    flush_stream_block(s);
+    return NULL;
+}
+
+/*
+    Returns the length of the complete blocks of a stream file, from its magic up to the end of the last
+    block whose data were written in full, or 0 if not even the magic was
+*/
+static long complete_stream_length(FILE *file, char *filename) {
+    char magic[8];
+    if (fseek(file, 0, SEEK_END) != 0) return 0;
+    long file_length = ftell(file);
+    rewind(file);
+    if (fread(magic, 8, 1, file) != 1) return 0;
+    if (memcmp(magic, STREAM_MAGIC, 8) != 0) {
+        printf("%s is not a stream file of this version\n", filename);
+        exit(1);
+    }
+    long length = 8;
+    int64_t sizes[2]; // Size of a block before compression, and its compressed size
+    while (fread(sizes, sizeof(sizes), 1, file) == 1 && sizes[1] >= 0 && \
+           sizes[1] <= file_length - length - (long) sizeof(sizes)) {
+        length += sizeof(sizes) + sizes[1];
+        if (fseek(file, length, SEEK_SET) != 0) break;
+    }
+    return length;
+}
+
+/*
+    Opens the stream file and starts the writer, with one ring for each of norings threads. On a restart the
+    blocks already written are kept, and a block cut short when the previous run stopped is removed.
+*/
+void init_stream_writer(stream_writer *s, char *filename, int norings, parameters *params, int restart) {
+    s->filename = filename;
+    s->file = restart ? fopen(filename, "r+b") : NULL;
+    if (s->file != NULL) {
+        long length = complete_stream_length(s->file, filename);
+        if (fflush(s->file) != 0 || ftruncate(fileno(s->file), length) != 0 || fseek(s->file, length, SEEK_SET) != 0) {
+            printf("Failed to truncate stream %s\n", filename);
+            exit(1);
+        }
+    } else {
+        s->file = fopen(filename, "wb"); // A new stream, or a restart of a run which had not opened one
+    }
+    if (s->file == NULL) {
+        printf("Failed to open stream %s\n", filename);
+        exit(1);
+    }
+    if (ftell(s->file) == 0 && fwrite(STREAM_MAGIC, 8, 1, s->file) != 1) {
+        printf("Failed to write stream %s\n", filename);
+        exit(1);
+    }
+    s->norings = norings;
+    s->rings = calloc(norings, sizeof(stream_ring));
+    s->block_size = params->stream_block;
+    s->block = malloc(s->block_size);
+    s->block_capacity = s->block_size;
+    if (s->rings == NULL || s->block == NULL) {
+        printf("Failed to allocate stream writer\n");
+        exit(1);
+    }
+    for (int r = 0; r < norings; r++) {
+        s->rings[r].events = malloc(sizeof(stream_event) * STREAM_RING_SIZE);
+        if (s->rings[r].events == NULL) {
+            printf("Failed to allocate stream writer\n");
+            exit(1);
+        }
+    }
+    s->block_used = 0;
+    s->stop = 0;
+    if (pthread_create(&s->thread, NULL, &run_stream_writer, s) != 0) {
+        printf("Failed to start stream writer\n");
+        exit(1);
+    }
+}
+
+// Waits for the writer to write every remaining event, then closes the stream file
+void stop_stream_writer(stream_writer *s) {
+    __atomic_store_n(&s->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(s->thread, NULL);
+    fclose(s->file);
+
+    long dropped = 0; // Number of events dropped over every ring
+    for (int r = 0; r < s->norings; r++) {
+        dropped += s->rings[r].dropped;
+        free(s->rings[r].events);
+    }
+    if (dropped > 0) printf("%ld stream events dropped because the writer fell behind\n", dropped);
+    free(s->rings);
+    free(s->block);
+}
+
+#endif // STREAM_H
@@ -0,0 +1,194 @@
+/*
+	Sweep.h
+	Header file for running a sweep over parameter points in a single process. The input
+	file can give ranges of kT and of the timestep (or jump size), and a list of potentials,
+	with the SWEEP_KT, SWEEP_TIMESTEP (or SWEEP_JUMP_SIZE) and SWEEP_POTENTIALS options, and
+	a list of kT with the KT_LADDER option, and a list of timesteps with the EXTRAPOLATE option
+	(see Extrapolation.h). The points are ordered by potential, then kT, then timestep, as in
+	run_dir/job_creator.sh.
+	Without these options the sweep is the single point given by the input file.
+*/
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "Parameters.h"
+#include "Walker.h"
+
+/* Structure to store the parameter points of a sweep */
+struct sweep {
+    long nopoints;      // Number of parameter points
+    long nopotentials;  // Number of potentials
+    long nokT;          // Number of values of kT
+    long nosteps;       // Number of values of the timestep (or jump size)
+    parameters *points; // Parameters of each point
+};
+
+typedef struct sweep sweep;
+
+
+// Returns the number of values in a range from its minimum to its maximum inclusive, or 1 if it is unused
+long range_length(double range[3]) {
+    if (range[1] == 0) return 1;
+    return (long) floor((range[2] - range[0]) / range[1] + 1e-9) + 1;
+}
+
+// Returns a pointer to the timestep or jump size of the parameters, whichever the dynamics uses
+double *step_parameter(parameters *params) {
+    if (strcmp(params->dynamics_type, "MONTE-CARLO") == 0) return &params->jump_size;
+    return &params->timestep;
+}
+
+// Returns the index of the point with the given indices of the potential, kT and timestep (or jump size)
+long sweep_point(sweep *s, long potential, long kT, long step) {
+    return (potential * s->nokT + kT) * s->nosteps + step;
+}
+
+// Fills a sweep with every combination of the ranges given in the parameters
+void init_sweep(sweep *s, parameters *params) {
+    char potential_names[64][256]; // Names of the potentials to sweep over
+    int nopotentials = 0;
+
+    if (params->sweep_potentials[0] == '\0') {
+        strcpy(potential_names[nopotentials++], params->potential_name);
+    } else {
+        char names[256]; // Copy of the list, which strtok modifies
+        strcpy(names, params->sweep_potentials);
+        for (char *name = strtok(names, ","); name != NULL && nopotentials < 64; name = strtok(NULL, ",")) {
+            strcpy(potential_names[nopotentials++], name);
+        }
+    }
+
+    double kT_values[64]; // Values of kT given as a list
+    long nokT = range_length(params->sweep_kT);
+    if (params->kT_ladder[0] != '\0') nokT = read_list(params->kT_ladder, kT_values, 64);
+    double step_values[64]; // Timesteps given as a list
+    long nosteps = range_length(params->sweep_step);
+    if (params->extrapolate[0] != '\0') nosteps = read_list(params->extrapolate, step_values, 64);
+    s->nopotentials = nopotentials;
+    s->nokT = nokT;
+    s->nosteps = nosteps;
+    s->nopoints = nopotentials * nokT * nosteps;
+    s->points = malloc(sizeof(parameters) * s->nopoints);
+    if (s->points == NULL) {
+        printf("Failed to allocate sweep of %ld points\n", s->nopoints);
+        exit(1);
+    }
+
+    long point = 0;
+    for (int p = 0; p < nopotentials; p++) {
+        for (long i = 0; i < nokT; i++) {
+            for (long j = 0; j < nosteps; j++) {
+                parameters *point_params = &s->points[point++];
+                *point_params = *params;
+                strcpy(point_params->potential_name, potential_names[p]);
+                if (params->kT_ladder[0] != '\0') {
+                    point_params->kT = kT_values[i];
+                } else if (params->sweep_kT[1] != 0) {
+                    point_params->kT = params->sweep_kT[0] + i * params->sweep_kT[1];
+                }
+                if (params->extrapolate[0] != '\0') {
+                    point_params->timestep = step_values[j];
+                } else if (params->sweep_step[1] != 0) {
+                    *step_parameter(point_params) = params->sweep_step[0] + j * params->sweep_step[1];
+                }
+                set_derived_parameters(point_params);
+                if (point_params->nowells != s->points[0].nowells) {
+                    printf("Potentials of a sweep must have the same number of wells\n");
+                    exit(1);
+                }
+            }
+        }
+    }
+}
+
+void free_sweep(sweep *s) {
+    free(s->points);
+}
+
+// Writes the mean over the replicas of a value of each replica and its standard error, preceded by a comma
+void fprint_mean_error(FILE *datastore_file, double *values, int noreplicas) {
+    double mean = 0, std_error = 0;
+    for (int i = 0; i < noreplicas; i++) mean += values[i];
+    mean /= noreplicas;
+    for (int i = 0; i < noreplicas; i++) std_error += (values[i] - mean) * (values[i] - mean);
+    fprintf(datastore_file, ", %g, %g", mean, sqrt(std_error) / noreplicas);
+}
+
+// Writes the mean and standard error of a point, also listing the parameters associated with it
+// With a tolerance, the number of steps used by all the replicas together is added at the end
+// With parallel tempering, the mean acceptance of exchanges with the next temperature over the replicas is added
+// With adapted proposals, the mean tuned width and acceptance rate of each well over the replicas are added at the end
+// With all estimators, the means and standard errors of the estimates from the lattice switch attempts are added
+// With more than two wells, the means and standard errors of F_0 - F_k for the wells after the first two are added
+// The exact difference of the point (see Reference.h) is added last, and the exact F_0 - F_k of the further wells
+void fprint_result(FILE *datastore_file, parameters *params, double mean_energy_diff, double std_error, long steps, \
+        replica_result *point_results, double *exact) {
+    fprintf(datastore_file, "%s, %s, %ld, %lf, %lf, %g, %g", params->potential_name, params->dynamics_type,
+            params->tot_steps, *step_parameter(params), params->kT, mean_energy_diff, std_error);
+    if (params->tolerance > 0) fprintf(datastore_file, ", %ld", steps);
+    if (params->exchange_steps > 0) {
+        double exchange_acceptance = 0; // Mean over the replicas
+        for (int i = 0; i < params->noreplicas; i++) {
+            exchange_acceptance += point_results[i].exchange_acceptance / params->noreplicas;
+        }
+        fprintf(datastore_file, ", %g", exchange_acceptance);
+    }
+    if (params->adapt_steps > 0) {
+        double jump_size[2] = {0, 0}, acceptance[2] = {0, 0}; // Means over the replicas
+        for (int i = 0; i < params->noreplicas; i++) {
+            for (int well = 0; well < 2; well++) {
+                jump_size[well] += point_results[i].jump_size[well] / params->noreplicas;
+                acceptance[well] += point_results[i].acceptance[well] / params->noreplicas;
+            }
+        }
+        fprintf(datastore_file, ", %g, %g, %g, %g", jump_size[0], jump_size[1], acceptance[0], acceptance[1]);
+    }
+    double values[params->noreplicas]; // Value of each replica, for the extra means
+    if (params->estimators) {
+        for (int k = 0; k < NOESTIMATORS; k++) {
+            for (int i = 0; i < params->noreplicas; i++) values[i] = point_results[i].estimates[k];
+            fprint_mean_error(datastore_file, values, params->noreplicas);
+        }
+    }
+    for (int k = 2; k < params->nowells; k++) {
+        for (int i = 0; i < params->noreplicas; i++) values[i] = point_results[i].well_differences[k];
+        fprint_mean_error(datastore_file, values, params->noreplicas);
+    }
+    for (int k = 1; k < params->nowells; k++) fprintf(datastore_file, ", %.12g", exact[k]);
+    fprintf(datastore_file, "\n");
+}
+
+// Writes a table of the results of every point of a sweep, in the format of data_analysis/combiner.py
+void write_sweep_table(sweep *s, double *means, double *std_errors, long *steps, replica_result *results, \
+        double *exact, char *filename) {
+    FILE *table_file = fopen(filename, "w");
+    if (table_file == NULL) {
+        printf("Failed to open results file %s\n", filename);
+        exit(1);
+    }
+    fprintf(table_file, "Potential Name, Dynamics Type, No of steps, Timestep, kT, Free energy diff, Std error");
+    if (s->points[0].tolerance > 0) fprintf(table_file, ", Steps used");
+    if (s->points[0].exchange_steps > 0) fprintf(table_file, ", Exchange acceptance");
+    if (s->points[0].adapt_steps > 0) {
+        fprintf(table_file, ", Left jump size, Right jump size, Left acceptance, Right acceptance");
+    }
+    if (s->points[0].estimators) {
+        fprintf(table_file, ", Left EXP diff, Left EXP error, Right EXP diff, Right EXP error, BAR diff, BAR error");
+    }
+    for (int k = 2; k < s->points[0].nowells; k++) fprintf(table_file, ", Free energy diff %d, Std error %d", k, k);
+    fprintf(table_file, ", Exact diff");
+    for (int k = 2; k < s->points[0].nowells; k++) fprintf(table_file, ", Exact diff %d", k);
+    fprintf(table_file, "\n");
+    for (long point = 0; point < s->nopoints; point++) {
+        fprint_result(table_file, &s->points[point], means[point], std_errors[point], steps[point], \
+                      &results[point * s->points[point].noreplicas], &exact[point * MAX_WELLS]);
+    }
+    fclose(table_file);
+}
+
+#endif // SWEEP_H
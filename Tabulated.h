@@ -0,0 +1,269 @@
+/*
+	Tabulated.h
+	Header file for loading the TABULATED potential from a file of samples (x, V(x)), given
+	with the TABLE option. A text file has one sample per line, with lines starting with #
+	ignored. A binary file starts with TABLE_MAGIC, followed by the number of samples
+	(int64_t) and the samples as pairs of doubles, in the byte order of the machine. The
+	samples must be in increasing order of x, but need not be evenly spaced.
+
+	A natural cubic spline is fitted through the samples and tabulated on intervals of equal
+	width, at least as fine as the closest samples, as the values and derivatives of the
+	spline at the nodes (cubic Hermite form). The table matches the spline in value and slope
+	at every node, and is exact within intervals that lie inside one interval of the samples.
+	An interval with a sample inside it, where the third derivative of the spline jumps, is
+	only approximated, with an error of order width^3 times the jump, which resampling on at
+	least TABLE_MIN_INTERVALS intervals keeps small. Each interval stores the
+	four coefficients of its cubic in one aligned block, so the kernel in Potentials.h costs
+	one multiply to find the interval and one load of the coefficients.
+
+	The wells are the local minima of the table, and the shift of each well is the potential
+	at the first minimum minus the potential at its own. With two wells they are divided at
+	x = 0, as for every two-well potential, so the minima must lie on either side of it. With
+	more wells, the boundaries are the highest maxima between neighbouring minima and the
+	potential is run in the N-well mode.
+*/
+
+#ifndef TABULATED_H
+#define TABULATED_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "Potentials.h"
+
+#define TABLE_MAGIC "LSTAB001"      // Identifies binary table files and their format version
+#define TABLE_MIN_INTERVALS 1024    // Smallest number of intervals of the table
+#define TABLE_MAX_INTERVALS 1048576 // Largest number of intervals of the table
+#define TABLE_MAX_SAMPLES 1048576   // Largest number of samples in a table file
+
+
+// Reads the samples of a table file into x and V, returning how many there are
+static long read_table_samples(char *filename, double *x, double *V) {
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) {
+        printf("Failed to open table %s\n", filename);
+        exit(1);
+    }
+    long nosamples = 0;
+    char magic[8];
+    if (fread(magic, 8, 1, file) == 1 && memcmp(magic, TABLE_MAGIC, 8) == 0) {
+        int64_t count;
+        if (fread(&count, sizeof(count), 1, file) != 1 || count < 0 || count > TABLE_MAX_SAMPLES) {
+            printf("Failed to read table %s\n", filename);
+            exit(1);
+        }
+        for (nosamples = 0; nosamples < count; nosamples++) {
+            double sample[2];
+            if (fread(sample, sizeof(sample), 1, file) != 1) {
+                printf("Failed to read table %s\n", filename);
+                exit(1);
+            }
+            x[nosamples] = sample[0];
+            V[nosamples] = sample[1];
+        }
+    } else {
+        rewind(file);
+        char line[1024];
+        while (fgets(line, sizeof(line), file) != NULL) {
+            if (line[strspn(line, " \t")] == '#') continue;
+            if (nosamples == TABLE_MAX_SAMPLES) {
+                printf("Table %s has more than %d samples\n", filename, TABLE_MAX_SAMPLES);
+                exit(1);
+            }
+            if (sscanf(line, "%lf %lf", &x[nosamples], &V[nosamples]) == 2) nosamples++;
+        }
+    }
+    fclose(file);
+    return nosamples;
+}
+
+// Fills M with the second derivatives of the natural cubic spline through the samples
+static void fit_spline(const double *x, const double *V, long n, double *M) {
+    double *diag = malloc(sizeof(double) * n); // Eliminated diagonal of the tridiagonal system
+    if (diag == NULL) {
+        printf("Failed to allocate spline of %ld samples\n", n);
+        exit(1);
+    }
+    M[0] = 0;
+    M[n - 1] = 0;
+    diag[0] = 1;
+    for (long i = 1; i < n - 1; i++) {
+        double h0 = x[i] - x[i - 1], h1 = x[i + 1] - x[i];
+        double rhs = 6 * ((V[i + 1] - V[i]) / h1 - (V[i] - V[i - 1]) / h0);
+        double lower = (i > 1) ? h0 : 0; // Coupling to M[i - 1], which is fixed at 0 for the first row
+        diag[i] = 2 * (h0 + h1) - lower * lower / diag[i - 1];
+        M[i] = rhs - lower * M[i - 1] / diag[i - 1];
+    }
+    for (long i = n - 2; i >= 1; i--) {
+        double upper = (i < n - 2) ? x[i + 1] - x[i] : 0; // Coupling to M[i + 1]
+        M[i] = (M[i] - upper * M[i + 1]) / diag[i];
+    }
+    free(diag);
+}
+
+// Returns the spline at xv in interval i, storing its derivative in deriv
+static double spline_at(const double *x, const double *V, const double *M, long i, double xv, double *deriv) {
+    double h = x[i + 1] - x[i];
+    double a = x[i + 1] - xv, b = xv - x[i]; // Distances to the ends of the interval
+    double lin0 = V[i] / h - M[i] * h / 6, lin1 = V[i + 1] / h - M[i + 1] * h / 6;
+    *deriv = (-M[i] * a * a + M[i + 1] * b * b) / (2 * h) - lin0 + lin1;
+    return (M[i] * a * a * a + M[i + 1] * b * b * b) / (6 * h) + lin0 * a + lin1 * b;
+}
+
+// Returns the derivative of the cubic of interval j with respect to the fraction t, divided by the width
+static inline double table_slope(const tabulated_potential *tab, long j, double t) {
+    const double *c = tab->coeffs[j];
+    return c[1] + t * (2 * c[2] + 3 * t * c[3]);
+}
+
+// Returns the position in interval j where the slope changes sign, which it does between t = 0 and t = 1
+static double table_turning_point(const tabulated_potential *tab, long j) {
+    double low = 0, high = 1;
+    int rising = table_slope(tab, j, 1) > table_slope(tab, j, 0);
+    for (int k = 0; k < 60; k++) {
+        double mid = 0.5 * (low + high);
+        if ((table_slope(tab, j, mid) < 0) == rising) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    return tab->x_min + (j + 0.5 * (low + high)) / tab->inv_width;
+}
+
+// Finds the wells of the table from its minima and maxima
+static void find_table_wells(tabulated_potential *tab, char *filename) {
+    double minima[MAX_WELLS], maxima[MAX_WELLS * 4], maxima_energy[MAX_WELLS * 4];
+    int nominima = 0, nomaxima = 0;
+    for (long j = 0; j < tab->nointervals; j++) {
+        // Slopes at the nodes are taken from the table, so a minimum on a node is found in only one interval
+        double start = tab->coeffs[j][1];
+        double end = (j + 1 < tab->nointervals) ? tab->coeffs[j + 1][1] : table_slope(tab, j, 1);
+        if (start < 0 && end >= 0) {
+            if (nominima == MAX_WELLS) {
+                printf("Table %s has more than %d wells\n", filename, MAX_WELLS);
+                exit(1);
+            }
+            minima[nominima++] = table_turning_point(tab, j);
+        } else if (start > 0 && end <= 0 && nominima > 0 && nomaxima < MAX_WELLS * 4) {
+            // Only maxima after the first minimum can separate wells
+            maxima[nomaxima] = table_turning_point(tab, j);
+            maxima_energy[nomaxima] = TABULATED_Poten(maxima[nomaxima]);
+            nomaxima++;
+        }
+    }
+    if (nominima < 2) {
+        printf("Table %s needs at least two wells\n", filename);
+        exit(1);
+    }
+
+    double shifts[MAX_WELLS];
+    for (int k = 0; k < nominima; k++) shifts[k] = TABULATED_Poten(minima[0]) - TABULATED_Poten(minima[k]);
+    if (nominima == 2) {
+        if (!(minima[0] < 0 && minima[1] > 0)) {
+            printf("The two wells of table %s must lie on either side of x = 0\n", filename);
+            exit(1);
+        }
+        fill_two_well_layout(&tab->wells, minima[0], minima[1], shifts[1]);
+        return;
+    }
+
+    double boundaries[MAX_WELLS - 1];
+    for (int k = 0; k + 1 < nominima; k++) {
+        // The highest maximum between neighbouring minima
+        boundaries[k] = NAN;
+        double top = -INFINITY;
+        for (int m = 0; m < nomaxima; m++) {
+            if (maxima[m] > minima[k] && maxima[m] < minima[k + 1] && maxima_energy[m] > top) {
+                boundaries[k] = maxima[m];
+                top = maxima_energy[m];
+            }
+        }
+    }
+    fill_well_layout(&tab->wells, nominima, minima, boundaries, shifts);
+}
+
+// Loads the TABULATED potential from a table file, once for each file
+void load_table(char *filename) {
+    tabulated_potential *tab = &TABULATED_TABLE;
+    if (strcmp(tab->filename, filename) == 0) return;
+
+    double *x = malloc(sizeof(double) * TABLE_MAX_SAMPLES), *V = malloc(sizeof(double) * TABLE_MAX_SAMPLES);
+    if (x == NULL || V == NULL) {
+        printf("Failed to allocate table\n");
+        exit(1);
+    }
+    long nosamples = read_table_samples(filename, x, V);
+    if (nosamples < 4) {
+        printf("Table %s needs at least 4 samples\n", filename);
+        exit(1);
+    }
+    double min_spacing = INFINITY; // Closest spacing of the samples, which the intervals must resolve
+    for (long i = 0; i + 1 < nosamples; i++) {
+        if (!(x[i + 1] > x[i]) || !isfinite(V[i]) || !isfinite(V[i + 1])) {
+            printf("Samples of table %s must have increasing x and finite potentials\n", filename);
+            exit(1);
+        }
+        if (x[i + 1] - x[i] < min_spacing) min_spacing = x[i + 1] - x[i];
+    }
+
+    double *M = malloc(sizeof(double) * nosamples); // Second derivatives of the spline at the samples
+    if (M == NULL) {
+        printf("Failed to allocate table\n");
+        exit(1);
+    }
+    fit_spline(x, V, nosamples, M);
+
+    double range = x[nosamples - 1] - x[0];
+    long nointervals = (long) ceil(range / min_spacing - 1e-9);
+    if (nointervals < TABLE_MIN_INTERVALS) nointervals = TABLE_MIN_INTERVALS;
+    if (nointervals > TABLE_MAX_INTERVALS) nointervals = TABLE_MAX_INTERVALS;
+    double width = range / nointervals;
+
+    void *coeffs;
+    if (posix_memalign(&coeffs, 64, sizeof(double[4]) * nointervals) != 0) {
+        printf("Failed to allocate table of %ld intervals\n", nointervals);
+        exit(1);
+    }
+    free(tab->coeffs); // Only once the new table is allocated, so the table always has coefficients
+    tab->coeffs = coeffs;
+    tab->x_min = x[0];
+    tab->inv_width = 1 / width;
+    tab->nointervals = nointervals;
+
+    // Values and derivatives of the spline at consecutive nodes give the cubic of each interval
+    long i = 0; // Interval of the samples containing the node
+    double deriv0, value0 = spline_at(x, V, M, 0, x[0], &deriv0);
+    for (long j = 0; j < nointervals; j++) {
+        double node = (j + 1 == nointervals) ? x[nosamples - 1] : x[0] + (j + 1) * width;
+        while (i < nosamples - 2 && node > x[i + 1]) i++;
+        double deriv1, value1 = spline_at(x, V, M, i, node, &deriv1);
+        double m0 = deriv0 * width, m1 = deriv1 * width; // Derivatives with respect to the fraction of the interval
+        tab->coeffs[j][0] = value0;
+        tab->coeffs[j][1] = m0;
+        tab->coeffs[j][2] = 3 * (value1 - value0) - 2 * m0 - m1;
+        tab->coeffs[j][3] = 2 * (value0 - value1) + m0 + m1;
+        value0 = value1;
+        deriv0 = deriv1;
+    }
+
+    // Walls beyond the ends, as stiff as the stiffest part of the table
+    tab->wall_stiffness = 1;
+    for (long k = 0; k < nosamples; k++) {
+        if (fabs(M[k]) > tab->wall_stiffness) tab->wall_stiffness = fabs(M[k]);
+    }
+    tab->x_ends[0] = x[0];
+    tab->x_ends[1] = x[nosamples - 1];
+    tab->end_energy[0] = spline_at(x, V, M, 0, x[0], &tab->end_slope[0]);
+    tab->end_energy[1] = spline_at(x, V, M, nosamples - 2, x[nosamples - 1], &tab->end_slope[1]);
+
+    find_table_wells(tab, filename);
+    snprintf(tab->filename, sizeof(tab->filename), "%s", filename);
+    free(x);
+    free(V);
+    free(M);
+}
+
+#endif // TABULATED_H
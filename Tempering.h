@@ -0,0 +1,152 @@
+/*
+	Tempering.h
+	Header file for parallel tempering (replica exchange) across a ladder of temperatures.
+	Each replica of a ladder runs one walker at every kT of the sweep, all with the same
+	potential and timestep (or jump size). Every exchange_steps steps, exchanges of the
+	walkers' positions are attempted between neighbouring temperatures, alternating between
+	the even and the odd pairs. Each temperature keeps its own lattice switch, well counts
+	and random stream, so each still gives its own free energy estimate, while low
+	temperatures sample with the help of the high temperatures.
+
+	An exchange of the positions x_i and x_j at inverse temperatures b_i and b_j is accepted
+	with probability min(1, exp((b_i - b_j) (V_i - V_j))), where V is the potential with the
+	right well shifted, as sampled by the lattice switch. Momenta of the regular BAOAB method
+	are exchanged with the positions and scaled by sqrt(kT_new / kT_old).
+
+	Reference: "Parallel tempering: theory, applications, and new perspectives" by D. J. Earl
+	and M. W. Deem, Phys. Chem. Chem. Phys. 7, 3910 (2005).
+*/
+
+#ifndef TEMPERING_H
+#define TEMPERING_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "Parameters.h"
+#include "Walker.h"
+#include "Simulation.h"
+#include "Sweep.h"
+#include "Random.h"
+
+#define TEMPERING_STREAM (1ULL << 63) // Marks the random streams used for exchanges, distinct from the walkers' streams
+
+/* Structure to store the walkers of one replica of a temperature ladder */
+struct ladder {
+    long nokT;               // Number of temperatures
+    parameters **points;     // Parameters at each temperature, in increasing kT
+    walker *walkers;         // Walker at each temperature
+    long *attempts;          // Number of exchanges attempted between each temperature and the next
+    long *accepts;           // Number of exchanges accepted between each temperature and the next
+    rng_stream rng;          // Random number stream for the exchanges
+};
+
+typedef struct ladder ladder;
+
+
+// Fills a ladder from the points of a sweep, with one walker per temperature on its own random stream
+void init_ladder(ladder *l, sweep *s, long potential, long step, int replica, uint64_t seed) {
+    l->nokT = s->nokT;
+    l->points = malloc(sizeof(parameters *) * l->nokT);
+    l->walkers = malloc(sizeof(walker) * l->nokT);
+    l->attempts = calloc(l->nokT, sizeof(long));
+    l->accepts = calloc(l->nokT, sizeof(long));
+    if (l->points == NULL || l->walkers == NULL || l->attempts == NULL || l->accepts == NULL) {
+        printf("Failed to allocate ladder of %ld temperatures\n", l->nokT);
+        exit(1);
+    }
+    for (long k = 0; k < l->nokT; k++) {
+        long point = sweep_point(s, potential, k, step);
+        l->points[k] = &s->points[point];
+        init_walker(&l->walkers[k], seed, ((uint64_t) point << 32) | (uint64_t) replica, l->points[k]);
+    }
+    long ladder_index = potential * s->nosteps + step;
+    rng_init(&l->rng, seed, TEMPERING_STREAM | ((uint64_t) ladder_index << 32) | (uint64_t) replica, 0);
+}
+
+void free_ladder(ladder *l) {
+    for (long k = 0; k < l->nokT; k++) free_walker(&l->walkers[k]);
+    free(l->points);
+    free(l->walkers);
+    free(l->attempts);
+    free(l->accepts);
+}
+
+// Exchanges the positions (and momenta) of the walkers at temperatures i and j
+void exchange_walkers(ladder *l, long i, long j) {
+    walker *a = &l->walkers[i], *b = &l->walkers[j];
+    double x = a->x, energy = a->energy, force = a->force, p = a->p;
+    int cur_well = a->cur_well;
+    double scale = sqrt(l->points[i]->kT / l->points[j]->kT); // Scales momenta to the new temperature
+
+    a->x = b->x;
+    a->energy = b->energy;
+    a->force = b->force;
+    a->cur_well = b->cur_well;
+    a->p = b->p * scale;
+
+    b->x = x;
+    b->energy = energy;
+    b->force = force;
+    b->cur_well = cur_well;
+    b->p = p / scale;
+}
+
+// Attempts exchanges between neighbouring temperatures, between the even pairs in even rounds and the odd pairs in odd rounds
+void attempt_exchanges(ladder *l, long round) {
+    for (long i = round % 2; i + 1 < l->nokT; i += 2) {
+        walker *a = &l->walkers[i], *b = &l->walkers[i + 1];
+        double beta_difference = 1 / l->points[i]->kT - 1 / l->points[i + 1]->kT;
+        double energy_difference = shifted_energy(a->energy, a->x, l->points[i]) \
+                                   - shifted_energy(b->energy, b->x, l->points[i + 1]);
+        l->attempts[i]++;
+        if (rng_uniform(&l->rng) < min(1, exp(beta_difference * energy_difference))) {
+            l->accepts[i]++;
+            exchange_walkers(l, i, i + 1);
+        }
+    }
+}
+
+/*
+    Runs one replica of a temperature ladder, storing the result of each temperature in the results
+    of its point. simulations holds the simulation of every point of the sweep.
+*/
+void run_ladder(sweep *s, SimulationFun *simulations, replica_result *results, long potential, long step, \
+        int replica, uint64_t seed) {
+    ladder l; // Walkers of this replica
+    init_ladder(&l, s, potential, step, replica, seed);
+    long tot_steps = l.points[0]->tot_steps;
+    long exchange_steps = l.points[0]->exchange_steps;
+
+    long round = 0; // Number of exchange rounds so far
+    for (long stepno = 1; stepno < tot_steps; round++) {
+        long segment_end = stepno + exchange_steps;
+        if (segment_end > tot_steps) segment_end = tot_steps;
+        for (long k = 0; k < l.nokT; k++) {
+            long point = sweep_point(s, potential, k, step);
+            (*simulations[point])(NULL, &l.walkers[k], l.points[k], stepno, segment_end);
+        }
+        stepno = segment_end;
+        if (stepno < tot_steps) attempt_exchanges(&l, round);
+    }
+
+    for (long k = 0; k < l.nokT; k++) {
+        parameters *params = l.points[k];
+        walker *w = &l.walkers[k];
+        replica_result *result = &results[sweep_point(s, potential, k, step) * params->noreplicas + replica];
+        result->energy_difference = -params->kT * log((double) (w->no_left) / (tot_steps - w->no_left)) \
+                                    + params->shift_value;
+        result->steps = tot_steps;
+        result->tau = 0;
+        result->count = w->count;
+        for (int well = 0; well < 2; well++) {
+            result->jump_size[well] = w->prop.jump_size[well];
+            result->acceptance[well] = proposal_acceptance(&w->prop, well);
+        }
+        result->exchange_acceptance = (l.attempts[k] > 0) ? (double) l.accepts[k] / l.attempts[k] : 0;
+        if (w->switches != NULL) switch_estimates(w->switches, params, result->estimates);
+    }
+    free_ladder(&l);
+}
+
+#endif // TEMPERING_H
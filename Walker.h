@@ -0,0 +1,115 @@
+/*
+	Walker.h
+	Header file for the state of a single random walker. Every replica of the lattice
+	switch procedure owns one walker, including its own random number stream, so that
+	replicas can be run concurrently without sharing any mutable state.
+*/
+
+#ifndef WALKER_H
+#define WALKER_H
+
+#include "Parameters.h"
+#include "Random.h"
+#include "Convergence.h"
+#include "Counters.h"
+#include "Proposal.h"
+#include "Estimators.h"
+#include "Stream.h"
+#include "Bias.h"
+
+/* Structure to store the state of a walker */
+struct walker {
+    double x;        // Position of the walker
+    double p;        // Momentum of the walker, used in the regular BAOAB method
+    double energy;   // Potential at x
+    double force;    // Force at x, including the force of the bias
+    double bias_energy; // Bias at x, 0 without a bias
+    int cur_well;    // Which well the walker is in (0 is left well, 1 is right well)
+    long no_left;    // Number of timesteps that the walker has spent in the left well
+    long no_in_well[MAX_WELLS]; // Number of timesteps that the walker has spent in each well, in the N-well mode
+    double R[2];     // Two normally distributed numbers, used in the BAOAB method (see Dynamics.h)
+    rng_stream rng;  // Random number stream of this walker
+    counters count;  // Counters of events in the step loop (see Counters.h)
+    proposal_state prop; // Proposal widths and acceptance of each well, used in the Monte-Carlo method
+    switch_record *switches; // Energy differences of the lattice switch attempts, NULL unless they are recorded
+    stream_tap *tap;         // Where the trajectory is streamed, NULL unless it is (see Stream.h)
+    bias_potential *bias;    // Adaptive bias added to the potential, NULL unless there is one (see Bias.h)
+};
+
+typedef struct walker walker;
+
+/* Structure to store the results of one replica */
+struct replica_result {
+    double energy_difference; // Estimate of the free energy difference
+    double well_differences[MAX_WELLS]; // Estimates of F_0 - F_k for each well k, in the N-well mode
+    long steps;               // Number of steps the replica ran for
+    double tau;               // Integrated autocorrelation time of the well indicator in steps (0 if not estimated)
+    counters count;           // Counters of events in the step loop (see Counters.h)
+    double jump_size[2];      // Proposal width of each well used for the samples (Monte-Carlo method)
+    double acceptance[2];     // Acceptance rate of moves from each well after the burn-in (Monte-Carlo method)
+    double exchange_acceptance; // Acceptance rate of exchanges with the next temperature (parallel tempering)
+    double estimates[NOESTIMATORS]; // Estimates from the lattice switch attempts (see Estimators.h)
+};
+
+typedef struct replica_result replica_result;
+
+/* Structure to store how far a replica has progressed, so that it can be checkpointed and resumed */
+struct replica_progress {
+    long stepno;          // Next step to perform
+    long block_start;     // Step at which the current block started
+    long block_left;      // Number of samples in the left well when the current block started
+    long burn_in;         // Number of steps discarded as burn-in, 0 until the burn-in is done
+    block_average blocks; // Block averages of the fraction of samples in the left well
+    int done;             // Indicates that the replica has finished and result is set
+    replica_result result;
+};
+
+typedef struct replica_progress replica_progress;
+
+void init_replica_progress(replica_progress *progress, parameters *params) {
+    progress->stepno = 1;
+    progress->block_start = 1;
+    progress->block_left = 0;
+    progress->burn_in = 0;
+    init_block_average(&progress->blocks, params->block_steps);
+    progress->done = 0;
+    progress->result.tau = 0;
+    progress->result.exchange_acceptance = 0;
+    for (int k = 0; k < NOESTIMATORS; k++) progress->result.estimates[k] = NAN;
+}
+
+
+// Places a walker at the bottom of the starting well, with a random stream determined by the seed and stream number
+void init_walker(walker *w, uint64_t seed, uint64_t stream, parameters *params) {
+    rng_init(&w->rng, seed, stream, 0); // Every replica has an independent random stream
+
+    w->x = params->minima[params->start_well];
+    w->energy = (*params->Poten)(w->x);
+    w->force = -(*params->Poten_deriv)(w->x);
+    w->cur_well = params->start_well;
+    w->no_left = 0;
+    for (int k = 0; k < MAX_WELLS; k++) w->no_in_well[k] = 0;
+    w->R[0] = 0;
+    w->R[1] = 0;
+    w->p = 0;
+    init_counters(&w->count);
+    init_proposal(&w->prop, params->jump_size);
+    w->switches = params->estimators ? new_switch_record() : NULL;
+    w->tap = NULL;
+    w->bias = (params->bias_steps > 0) ? new_bias(params) : NULL;
+    w->bias_energy = 0;
+    if (strcmp(params->dynamics_type, "BAOAB_LIMIT") == 0) {
+        // Stores the current value of R and the value at the next timestep
+        w->R[0] = rng_normal(&w->rng);
+        w->R[1] = rng_normal(&w->rng);
+    } else if (strcmp(params->dynamics_type, "BAOAB_REGULAR") == 0) {
+        w->p = sqrt(params->mass * params->kT) * rng_normal(&w->rng); // Drawn from the Maxwell-Boltzmann distribution
+    }
+}
+
+void free_walker(walker *w) {
+    free(w->switches);
+    free(w->bias);
+}
+
+#endif // WALKER_H
@@ -0,0 +1,175 @@
+/*
+	bench.c
+	Throughput benchmark of the step loop. Times the lattice switching method for every
+	combination of dynamics and potential, with and without binning, for several switch
+	regularities and for a single walker and an ensemble of walkers. For each case it reports
+	the time per step, the steps per second, the integrated autocorrelation time of the well
+	indicator and the effective samples per second, and writes them to a CSV file so that
+	different builds can be compared.
+
+	Usage: ./Lattice_Switch_1D_bench [output file] [walker steps per case] [seed]
+*/
+
+#define _POSIX_C_SOURCE 200809L // For clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+#include <string.h>
+#include "Parameters.h"
+#include "Walker.h"
+#include "Simulation.h"
+#include "Ensemble.h"
+#include "Histogram.h"
+#include "Convergence.h"
+
+#define BENCH_ENSEMBLE_WALKERS 256 // Number of walkers in the ensemble cases
+
+/* Structure to store the measurements of one benchmark case */
+struct bench_result {
+    double seconds;     // Wall time of the step loop
+    double ns_per_step; // Wall time per step of a single walker
+    double steps_per_s; // Steps of a single walker per second
+    double tau;         // Integrated autocorrelation time of the well indicator in steps (0 if not resolved)
+    double ess_per_s;   // Effective (independent) samples of the well indicator per second
+};
+
+typedef struct bench_result bench_result;
+
+
+// Returns the wall time in seconds from an arbitrary starting point
+double wall_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+// Fills the parameters of a benchmark case, with the bins and physical parameters of run_dir
+void bench_parameters(parameters *params, char *dynamics_type, char *potential_name, int switch_regularity, \
+        long nowalkers, long tot_steps) {
+    strcpy(params->dynamics_type, dynamics_type);
+    strcpy(params->potential_name, potential_name);
+    params->tot_steps = tot_steps;
+    params->start_well = 0;
+    params->switch_regularity = switch_regularity;
+    params->x_min = -4;
+    params->x_max = 4;
+    params->nobins = 1000;
+    params->kT = 1;
+    params->mass = 1;
+    params->timestep = 0.01;
+    params->jump_size = 0.5;
+    params->friction_param = 1;
+    set_default_options(params);
+    params->nowalkers = nowalkers;
+    params->block_steps = (tot_steps > MAX_BLOCKS) ? tot_steps / MAX_BLOCKS : 1; // So every case fills the blocks
+    set_derived_parameters(params);
+}
+
+/*
+    Runs one case in blocks, timing only the step loop. The well indicator of every block is
+    accumulated to estimate the autocorrelation time, from which the effective samples follow.
+*/
+bench_result run_case(parameters *params, int savebins, uint64_t seed, uint64_t stream) {
+    bench_result result;
+    histogram bins;
+    histogram *case_bins = NULL;
+    if (savebins) {
+        init_histogram(&bins, params);
+        case_bins = &bins;
+    }
+
+    walker w;
+    ensemble e;
+    SimulationFun simulation = Simulation_selector(params->dynamics_type, params->potential_name);
+    if (params->nowalkers > 1) {
+        init_ensemble(&e, seed, stream, params);
+    } else {
+        init_walker(&w, seed, stream, params);
+    }
+
+    block_average b; // Block averages of the fraction of samples in the left well
+    init_block_average(&b, params->block_steps);
+    double seconds = 0;
+    long stepno = 1;
+    while (stepno < params->tot_steps) {
+        long block_end = stepno + b.block_steps;
+        if (block_end > params->tot_steps) block_end = params->tot_steps;
+        long left_before = (params->nowalkers > 1) ? ensemble_no_left(&e) : w.no_left;
+
+        double start = wall_time();
+        if (params->nowalkers > 1) {
+            simulate_ensemble(case_bins, &e, params, stepno, block_end);
+        } else {
+            (*simulation)(case_bins, &w, params, stepno, block_end);
+        }
+        seconds += wall_time() - start;
+
+        long left_after = (params->nowalkers > 1) ? ensemble_no_left(&e) : w.no_left;
+        if (block_end - stepno == b.block_steps) {
+            block_average_add(&b, (double) (left_after - left_before), (double) (b.block_steps * params->nowalkers));
+        }
+        stepno = block_end;
+    }
+
+    double walker_steps = (double) (params->tot_steps - 1) * params->nowalkers; // Steps of single walkers
+    block_average_error(&b, params, &result.tau);
+    result.seconds = seconds;
+    result.ns_per_step = 1e9 * seconds / walker_steps;
+    result.steps_per_s = walker_steps / seconds;
+    // Every 2 tau steps of a walker give one independent sample
+    result.ess_per_s = (result.tau > 0) ? walker_steps / (2 * result.tau) / seconds : 0;
+
+    if (params->nowalkers > 1) free_ensemble(&e);
+    if (savebins) free_histogram(&bins);
+    return result;
+}
+
+int main(int argc, char **argv) {
+    char *output_filename = (argc > 1) ? argv[1] : "bench_results.csv"; // Name of the file to write results to
+    long walker_steps = (argc > 2) ? atol(argv[2]) : 4000000; // Number of walker steps in each case
+    uint64_t seed = (argc > 3) ? (uint64_t) strtoull(argv[3], NULL, 10) : 1; // Seed of every case
+
+    char *dynamics_types[] = {"BAOAB_LIMIT", "BAOAB_REGULAR", "MONTE-CARLO"};
+    char *potential_names[] = {"KT", "QUARTIC", "DIFF_WIDTH"};
+    int switch_regularities[] = {1, 10, 100};
+    long walker_counts[] = {1, BENCH_ENSEMBLE_WALKERS};
+
+    FILE *output_file = fopen(output_filename, "w");
+    if (output_file == NULL) {
+        printf("Failed to open benchmark file %s\n", output_filename);
+        exit(1);
+    }
+    fprintf(output_file, "Dynamics Type, Potential Name, Walkers, Bins, Switch regularity, Steps, Seconds, " \
+            "ns/step, steps/s, Tau, ESS/s\n");
+    printf("%-13s %-11s %7s %4s %6s %10s %12s %10s %12s\n", "dynamics", "potential", "walkers", "bins", "switch", \
+           "ns/step", "steps/s", "tau", "ESS/s");
+
+    uint64_t stream = 0; // Every case has its own random stream
+    for (int d = 0; d < 3; d++) {
+        for (int p = 0; p < 3; p++) {
+            for (int k = 0; k < 2; k++) {
+                for (int savebins = 0; savebins <= 1; savebins++) {
+                    for (int r = 0; r < 3; r++) {
+                        parameters params;
+                        long nowalkers = walker_counts[k];
+                        bench_parameters(&params, dynamics_types[d], potential_names[p], switch_regularities[r], \
+                                         nowalkers, walker_steps / nowalkers + 1);
+                        bench_result result = run_case(&params, savebins, seed, stream++);
+
+                        fprintf(output_file, "%s, %s, %ld, %d, %d, %ld, %.6g, %.6g, %.6g, %.6g, %.6g\n", \
+                                params.dynamics_type, params.potential_name, nowalkers, savebins, \
+                                params.switch_regularity, params.tot_steps - 1, result.seconds, result.ns_per_step, \
+                                result.steps_per_s, result.tau, result.ess_per_s);
+                        printf("%-13s %-11s %7ld %4d %6d %10.3f %12.4g %10.4g %12.4g\n", params.dynamics_type, \
+                               params.potential_name, nowalkers, savebins, params.switch_regularity, \
+                               result.ns_per_step, result.steps_per_s, result.tau, result.ess_per_s);
+                    }
+                }
+            }
+        }
+    }
+    fclose(output_file);
+    return 0;
+}
@@ -1 +1,6 @@
-gcc -std=c99 -o Lattice_Switch_1D main.c -lm 
+gcc -std=c99 -O3 -march=native -fopenmp $CFLAGS -o Lattice_Switch_1D main.c -lm -lz 
+gcc -std=c99 -O3 -march=native -fopenmp $CFLAGS -o Lattice_Switch_1D_bench bench.c -lm -lz 
+gcc -std=c99 -O3 -march=native -fopenmp -fPIC -shared -fvisibility=hidden $CFLAGS -o liblattice_switch.so library.c -lm -lz
+if command -v mpicc > /dev/null; then
+	mpicc -std=c99 -O3 -march=native -fopenmp -DUSE_MPI $CFLAGS -o Lattice_Switch_1D_mpi main.c -lm -lz
+fi
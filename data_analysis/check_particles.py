@@ -0,0 +1,59 @@
+"""
+Checks that a walker of several particles gives the same free energy difference per particle as a
+single particle. Runs the program on an input file once as it is and once with PARTICLES and
+DIMENSIONS added, and fails if the results differ by more than TOLERANCE standard errors. The exact
+difference is printed alongside, though the dynamics may be biased away from it by the timestep.
+
+    python check_particles.py ../Lattice_Switch_1D input.txt 4 2
+
+Given only the program, it checks each of CASES in turn.
+
+    python check_particles.py ../Lattice_Switch_1D
+"""
+import os
+import subprocess
+import sys
+import tempfile
+
+TOLERANCE = 4  # Largest difference allowed, in combined standard errors
+
+# Inputs checked by default, with their numbers of particles and dimensions
+CASES = [
+    ("BAOAB_REGULAR\nQUARTIC\n100000\n0\n10\n-2.5\n3\n1000\n0.5\n1\n0.01\n1\nREPLICAS 8\n", 4, 2),
+    ("MONTE-CARLO\nQUARTIC\n20000\n0\n10\n-2.5\n3\n1000\n0.5\n1\n0.5\nREPLICAS 8\n", 100, 1),
+]
+
+
+def run(program, input_text, seed=1):
+    'Runs the program on the input text, returning the estimate, its standard error and the exact difference'
+    with tempfile.TemporaryDirectory() as directory:
+        input_file = os.path.join(directory, "input.txt")
+        results_file = os.path.join(directory, "results.csv")
+        with open(input_file, "w") as f:
+            f.write(input_text)
+        subprocess.run([program, input_file, results_file, "NOBINS", str(seed)], check=True,
+                       stdout=subprocess.DEVNULL)
+        row = open(results_file).readline().split(",")
+    return float(row[5]), float(row[6]), float(row[-1])
+
+
+def check_particles(program, input_text, noparticles, dim=1):
+    'Returns whether the difference per particle of noparticles in dim dimensions matches the 1-D difference'
+    input_text = input_text.rstrip("\n") + "\n"
+    single, single_error, exact = run(program, input_text)
+    many, many_error, _ = run(program, input_text + "PARTICLES %d\nDIMENSIONS %d\n" % (noparticles, dim))
+    print("1 particle: %g +- %g" % (single, single_error))
+    print("%d particles in %d dimensions: %g +- %g" % (noparticles, dim, many, many_error))
+    print("Exact: %g" % exact)
+    return abs(many - single) <= TOLERANCE * (single_error ** 2 + many_error ** 2) ** 0.5
+
+
+if __name__ == "__main__":
+    if len(sys.argv) > 2:
+        dim = int(sys.argv[4]) if len(sys.argv) > 4 else 1
+        cases = [(open(sys.argv[2]).read(), int(sys.argv[3]), dim)]
+    else:
+        cases = CASES
+    if not all([check_particles(sys.argv[1], *case) for case in cases]):
+        print("The difference per particle does not match the 1-D difference")
+        sys.exit(1)
@@ -0,0 +1,67 @@
+"""
+Checks that a run killed while streaming and resumed with RESTART leaves a stream which can be read to
+the end. Runs the program on an input with STREAM and CHECKPOINT, kills it after KILL_SECONDS,
+resumes it, and fails unless every block of the stream can be decompressed and the last one ends at the
+end of the file. Events may be dropped when the writer falls behind, so they are not counted.
+
+    python check_stream_restart.py ../Lattice_Switch_1D
+"""
+import os
+import signal
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+from stream_reader import BLOCK_FORMAT, STREAM_MAGIC, read_events
+
+KILL_SECONDS = 0.5  # Time the first run is given before it is killed
+INPUT = "MONTE-CARLO\nQUARTIC\n4000000\n0\n10\n-2.5\n3\n1000\n0.5\n1\n0.5\nREPLICAS 4\nTHREADS 2\n" \
+        "STREAM 10\nCHECKPOINT 200000\n"
+
+
+def blocks_length(filename):
+    'Returns the length of the magic and the blocks of a stream, walking the block headers'
+    with open(filename, "rb") as f:
+        data = f.read()
+    block_size = struct.calcsize(BLOCK_FORMAT)
+    length = len(STREAM_MAGIC)
+    while length + block_size <= len(data):
+        _, compressed_size = struct.unpack_from(BLOCK_FORMAT, data, length)
+        length += block_size + compressed_size
+    return length
+
+
+def check_stream_restart(program):
+    'Returns whether the stream of a run killed and resumed can be read to its end'
+    with tempfile.TemporaryDirectory() as directory:
+        input_file = os.path.join(directory, "input.txt")
+        results_file = os.path.join(directory, "results.csv")
+        with open(input_file, "w") as f:
+            f.write(INPUT)
+        command = [program, input_file, results_file, "NOBINS", "1"]
+        first = subprocess.Popen(command, stdout=subprocess.DEVNULL)
+        time.sleep(KILL_SECONDS)
+        if first.poll() is not None:
+            print("The run finished before it could be killed")
+            return False
+        first.send_signal(signal.SIGKILL)
+        first.wait()
+        subprocess.run(command + ["RESTART"], check=True, stdout=subprocess.DEVNULL)
+
+        stream_file = results_file + ".stream"
+        try:
+            noevents = sum(1 for _ in read_events(stream_file))
+        except Exception as error:
+            print("Failed to read the stream: %s" % error)
+            return False
+        length, file_length = blocks_length(stream_file), os.path.getsize(stream_file)
+    print("%d events in blocks of %d bytes, of a file of %d bytes" % (noevents, length, file_length))
+    return noevents > 0 and length == file_length
+
+
+if __name__ == "__main__":
+    if not check_stream_restart(sys.argv[1]):
+        print("The stream of the resumed run cannot be read to the end")
+        sys.exit(1)
@@ -0,0 +1,146 @@
+"""
+Python bindings for the lattice switch library (liblattice_switch.so, built by compile.sh), so that
+parameter scans and plots run in one process, without running the program and parsing its output
+for every point. The per-replica results and the histogram of a run are NumPy arrays mapped onto
+the memory of the library, which ls_step updates in place, so reading them never copies.
+
+    from lattice_switch import Run
+    run = Run(open("input.txt").read(), seed=1, bins=True)
+    while run.step(10000):
+        print(run.estimate())
+    counts = run.bins  # Without the underflow and overflow bins
+    V = run.potential(run.bin_centres)
+"""
+import ctypes
+import os
+
+import numpy as np
+
+API_VERSION = 2
+
+
+class PointInfo(ctypes.Structure):
+    _fields_ = [("potential_name", ctypes.c_char * 256), ("dynamics_type", ctypes.c_char * 256),
+                ("kT", ctypes.c_double), ("step", ctypes.c_double), ("tot_steps", ctypes.c_long)]
+
+
+def load_library(path=None):
+    'Loads the library, by default from the directory above this one, and declares its functions'
+    if path is None:
+        path = os.path.join(os.path.dirname(os.path.abspath(__file__)), os.pardir, "liblattice_switch.so")
+    lib = ctypes.CDLL(path)
+    run_p, double_p, long_p = ctypes.c_void_p, ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_long)
+    signatures = {
+        "ls_api_version": (ctypes.c_int, []),
+        "ls_create": (run_p, [ctypes.c_char_p, ctypes.c_uint64, ctypes.c_int]),
+        "ls_create_from_file": (run_p, [ctypes.c_char_p, ctypes.c_uint64, ctypes.c_int]),
+        "ls_last_error": (ctypes.c_char_p, []),
+        "ls_free": (None, [run_p]),
+        "ls_nopoints": (ctypes.c_long, [run_p]),
+        "ls_noreplicas": (ctypes.c_int, [run_p]),
+        "ls_point": (None, [run_p, ctypes.c_long, ctypes.POINTER(PointInfo)]),
+        "ls_step": (ctypes.c_long, [run_p, ctypes.c_long]),
+        "ls_run_to_completion": (None, [run_p]),
+        "ls_estimate": (None, [run_p, ctypes.c_long, double_p, double_p]),
+        "ls_exact_difference": (ctypes.c_double, [run_p, ctypes.c_long, ctypes.c_int]),
+        "ls_replica_differences": (double_p, [run_p]),
+        "ls_replica_steps": (long_p, [run_p]),
+        "ls_bins": (long_p, [run_p, long_p, double_p, double_p]),
+        "ls_potential": (None, [run_p, ctypes.c_long, double_p, double_p, ctypes.c_long]),
+    }
+    for name, (restype, argtypes) in signatures.items():
+        function = getattr(lib, name)
+        function.restype = restype
+        function.argtypes = argtypes
+    if lib.ls_api_version() != API_VERSION:
+        raise RuntimeError("%s has API version %d, not %d" % (path, lib.ls_api_version(), API_VERSION))
+    return lib
+
+
+_lib = None
+
+
+def library():
+    'Returns the library, loading it on first use'
+    global _lib
+    if _lib is None:
+        _lib = load_library()
+    return _lib
+
+
+class Run:
+    'Every replica of every parameter point of an input, advanced in steps chosen by the caller'
+
+    def __init__(self, input_text=None, seed=1, bins=False, input_file=None):
+        self._lib = library()
+        if input_file is not None:
+            self._run = self._lib.ls_create_from_file(input_file.encode(), seed, int(bins))
+        else:
+            self._run = self._lib.ls_create(input_text.encode(), seed, int(bins))
+        if not self._run:
+            raise ValueError(self._lib.ls_last_error().decode())
+        self.nopoints = self._lib.ls_nopoints(self._run)
+        self.noreplicas = self._lib.ls_noreplicas(self._run)
+        shape = (self.nopoints, self.noreplicas)
+        # Views of the arrays of the library, which keep their address for the life of the run
+        self.replica_differences = np.ctypeslib.as_array(self._lib.ls_replica_differences(self._run), shape)
+        self.replica_steps = np.ctypeslib.as_array(self._lib.ls_replica_steps(self._run), shape)
+        nobins, x_min, x_max = ctypes.c_long(), ctypes.c_double(), ctypes.c_double()
+        counts = self._lib.ls_bins(self._run, ctypes.byref(nobins), ctypes.byref(x_min), ctypes.byref(x_max))
+        self.counts = np.ctypeslib.as_array(counts, (nobins.value + 2,)) if counts else None
+        if self.counts is not None:
+            width = (x_max.value - x_min.value) / nobins.value
+            self.bin_centres = x_min.value + width * (np.arange(nobins.value) + 0.5)
+
+    def close(self):
+        if self._run:
+            self._lib.ls_free(self._run)
+            self._run = None
+            self.replica_differences = self.replica_steps = self.counts = None
+
+    def __del__(self):
+        self.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def point(self, point=0):
+        'Returns the potential, dynamics, kT, step and number of steps of a point as a dictionary'
+        info = PointInfo()
+        self._lib.ls_point(self._run, point, ctypes.byref(info))
+        return {"potential_name": info.potential_name.decode(), "dynamics_type": info.dynamics_type.decode(),
+                "kT": info.kT, "step": info.step, "tot_steps": info.tot_steps}
+
+    def step(self, nosteps):
+        'Advances every unfinished replica by up to nosteps steps, returning the number still running'
+        return self._lib.ls_step(self._run, nosteps)
+
+    def run(self):
+        'Runs every replica to the end'
+        self._lib.ls_run_to_completion(self._run)
+
+    def estimate(self, point=0):
+        'Returns the mean free energy difference of a point over its replicas and its standard error'
+        mean, std_error = ctypes.c_double(), ctypes.c_double()
+        self._lib.ls_estimate(self._run, point, ctypes.byref(mean), ctypes.byref(std_error))
+        return mean.value, std_error.value
+
+    def exact(self, point=0, well=1):
+        'Returns the exact free energy difference of a point between the first well and another'
+        return self._lib.ls_exact_difference(self._run, point, well)
+
+    @property
+    def bins(self):
+        'Counts of the bins of the histogram of every replica together, a view without the outer bins'
+        return None if self.counts is None else self.counts[1:-1]
+
+    def potential(self, x, point=0):
+        'Evaluates the unshifted potential of a point at the positions x'
+        x = np.ascontiguousarray(x, dtype=np.float64)
+        V = np.empty_like(x)
+        double_p = ctypes.POINTER(ctypes.c_double)
+        self._lib.ls_potential(self._run, point, x.ctypes.data_as(double_p), V.ctypes.data_as(double_p), x.size)
+        return V
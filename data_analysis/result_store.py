@@ -0,0 +1,56 @@
+import mmap
+import struct
+import sys
+
+# Layout of the binary records written by ResultStore.h, in the byte order of the machine
+MAX_WELLS = 16  # Number of exact differences in each record
+RECORD_FORMAT = "=8sqQ64s64s6q6dqdqqqq3d2dq%dd2q" % (2 + MAX_WELLS)
+RECORD_FIELDS = ["magic", "record_size", "seed", "dynamics_type", "potential_name", "tot_steps", "start_well",
+                 "switch_regularity", "noreplicas", "nowalkers", "block_steps", "kT", "mass", "timestep",
+                 "jump_size", "friction_param", "tolerance", "adapt_steps", "target_acceptance", "gaussian_proposal",
+                 "tries", "exchange_steps", "estimators", "shift_value", "left_min", "right_min", "x_min", "x_max",
+                 "nobins", "energy_difference", "std_error"] + ["exact_%d" % k for k in range(MAX_WELLS)] + \
+                ["steps", "histogram_length"]
+REPLICA_FORMAT = "=2dq8d"
+STORE_MAGIC = b"LSRES006"
+
+
+def read_records(filename):
+    'Yields every complete record of a result store as a dictionary, reading the file through a memory map'
+    with open(filename, "rb") as f:
+        data = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        record_size = struct.calcsize(RECORD_FORMAT)
+        replica_size = struct.calcsize(REPLICA_FORMAT)
+        offset = 0
+        while len(data) - offset >= record_size:
+            record = dict(zip(RECORD_FIELDS, struct.unpack_from(RECORD_FORMAT, data, offset)))
+            if record["magic"] != STORE_MAGIC or offset + record["record_size"] > len(data):
+                break  # Incomplete record at the end of the store
+            record["dynamics_type"] = record["dynamics_type"].rstrip(b"\0").decode()
+            record["potential_name"] = record["potential_name"].rstrip(b"\0").decode()
+            # Exact F_0 - F_k of each well k, NAN beyond the wells of the potential
+            record["exact_differences"] = [record.pop("exact_%d" % k) for k in range(MAX_WELLS)]
+
+            pos = offset + record_size
+            record["replicas"] = [struct.unpack_from(REPLICA_FORMAT, data, pos + i * replica_size)
+                                  for i in range(record["noreplicas"])]
+            pos += record["noreplicas"] * replica_size
+            record["histogram"] = list(struct.unpack_from("=%dq" % record["histogram_length"], data, pos))
+
+            yield record
+            offset += record["record_size"]
+        data.close()
+
+
+def write_table(filename, fout):
+    'Writes the records of a result store as a table, in the format of combiner.py'
+    fout.write("Potential Name, Dynamics Type, No of steps, Timestep, kT, Free energy diff, Std error, Exact diff\n")
+    for record in read_records(filename):
+        step = record["jump_size"] if record["dynamics_type"] == "MONTE-CARLO" else record["timestep"]
+        fout.write("%s, %s, %d, %.17g, %.17g, %.17g, %.17g, %.12g\n" % (record["potential_name"],
+                   record["dynamics_type"], record["tot_steps"], step, record["kT"], record["energy_difference"],
+                   record["std_error"], record["exact_differences"][1]))
+
+
+if __name__ == "__main__":
+    write_table(sys.argv[1], sys.stdout)
@@ -0,0 +1,58 @@
+import struct
+import sys
+import zlib
+
+# Layout of the stream written by Stream.h, in the byte order of the machine
+STREAM_MAGIC = b"LSSTRM01"
+BLOCK_FORMAT = "=qq"
+HEADER_FORMAT = "=iiqq"
+POSITION_FORMAT = "=dq"
+EVENT_TYPES = ["sample", "switch", "histogram"]
+
+
+def read_events(filename):
+    'Yields every event of a stream as a dictionary, stopping at an incomplete block at the end of the file'
+    with open(filename, "rb") as f:
+        if f.read(len(STREAM_MAGIC)) != STREAM_MAGIC:
+            raise ValueError("%s is not a stream file" % filename)
+        block_size = struct.calcsize(BLOCK_FORMAT)
+        header_size = struct.calcsize(HEADER_FORMAT)
+        position_size = struct.calcsize(POSITION_FORMAT)
+        while True:
+            sizes = f.read(block_size)
+            if len(sizes) < block_size:
+                break
+            raw_size, compressed_size = struct.unpack(BLOCK_FORMAT, sizes)
+            compressed = f.read(compressed_size)
+            if len(compressed) < compressed_size:
+                break  # Incomplete block at the end of the stream
+            block = zlib.decompress(compressed)
+            if len(block) != raw_size:
+                raise ValueError("Corrupt block in %s" % filename)
+
+            pos = 0
+            while pos < len(block):
+                event_type, task, step, nocounts = struct.unpack_from(HEADER_FORMAT, block, pos)
+                pos += header_size
+                event = {"type": EVENT_TYPES[event_type], "task": task, "step": step}
+                if nocounts > 0:
+                    event["counts"] = list(struct.unpack_from("=%dq" % nocounts, block, pos))
+                    pos += 8 * nocounts
+                else:
+                    event["x"], event["well"] = struct.unpack_from(POSITION_FORMAT, block, pos)
+                    pos += position_size
+                yield event
+
+
+def write_table(filename, fout):
+    'Writes the samples and switches of a stream as a table, sorted by task and step'
+    events = [event for event in read_events(filename) if event["type"] != "histogram"]
+    events.sort(key=lambda event: (event["task"], event["step"]))
+    fout.write("Type, Task, Step, Position, Well\n")
+    for event in events:
+        fout.write("%s, %d, %d, %.17g, %d\n" % (event["type"], event["task"], event["step"], event["x"],
+                   event["well"]))
+
+
+if __name__ == "__main__":
+    write_table(sys.argv[1], sys.stdout)
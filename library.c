@@ -0,0 +1,434 @@
+/*
+	library.c
+	The lattice switch library, implementing the C API of LatticeSwitch.h. Each replica keeps
+	its walker or ensemble between calls, so a run can be advanced a few steps at a time and
+	inspected in between. The replicas of a call to ls_step run concurrently, each with the
+	random stream it has in the program, so a run stepped to the end gives the same results as
+	the program with the same input and seed.
+
+	Runs with parallel tempering, streaming, checkpoints, a tolerance, or walkers of several
+	particles or dimensions are left to the program, as they need the whole run at once.
+
+	The headers report an error in the input with printf and exit, as the program should stop.
+	In the library these are replaced by library_printf and library_exit, which while a run is
+	being created keep the message and return to ls_create, so it can refuse the run instead.
+*/
+
+#define _POSIX_C_SOURCE 200809L // For fmemopen, and fsync and fileno in Checkpoint.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <math.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+static char LAST_ERROR[1024]; // Messages printed while the last run was created, empty if it was
+static jmp_buf *ERROR_JUMP;   // Where an error returns to while a run is being created, NULL otherwise
+
+// Prints as printf, except while a run is being created, when the message is kept for ls_last_error
+static __attribute__((format(printf, 1, 2))) int library_printf(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length;
+    if (ERROR_JUMP != NULL) {
+        size_t used = strlen(LAST_ERROR);
+        length = vsnprintf(LAST_ERROR + used, sizeof(LAST_ERROR) - used, format, args);
+    } else {
+        length = vprintf(format, args);
+    }
+    va_end(args);
+    return length;
+}
+
+// Ends the process as exit, except while a run is being created, when the creation is abandoned
+static __attribute__((noreturn)) void library_exit(int status) {
+    if (ERROR_JUMP != NULL) longjmp(*ERROR_JUMP, 1);
+    exit(status);
+}
+
+#define printf(...) library_printf(__VA_ARGS__)
+#define exit(status) library_exit(status)
+
+#include "LatticeSwitch.h"
+#include "Parameters.h"
+#include "Walker.h"
+#include "Simulation.h"
+#include "Ensemble.h"
+#include "Histogram.h"
+#include "Sweep.h"
+#include "Replica.h"
+#include "Reference.h"
+
+/* Structure to store a run, every replica of every point of its sweep */
+struct ls_run {
+    parameters params;           // Parameters of the input, which the points of the sweep start from
+    sweep s;                     // Parameter points of the run
+    uint64_t seed;               // Seed of every random stream
+    int noreplicas;              // Number of replicas of each point
+    long notasks;                // Number of replicas over every point
+    int nothreads;               // Number of threads the replicas are run on
+    SimulationFun *simulations;  // Simulation of each point
+    walker *walkers;             // Walker of each replica, unused for ensembles
+    ensemble *ensembles;         // Ensemble of each replica, unused for single walkers
+    replica_progress *progress;  // How far each replica has got
+    histogram *bins;             // Histogram of each replica, NULL unless bins are saved
+    histogram merged;            // Histogram of every replica together
+    double *differences;         // Current free energy difference of each replica
+    long *steps;                 // Number of steps each replica has run
+    double *exact;               // Exact free energy differences of each point, MAX_WELLS for each (see Reference.h)
+    int shared_potential;        // Whether a point uses the TABULATED or EXPRESSION potential
+};
+
+/*
+    The TABULATED table and the EXPRESSION program are held once per process (see Potentials.h), so
+    while a live run uses either, another run may not load a different table, formula or minima. Its
+    input is read over them, so they are saved first and put back if the run is refused.
+*/
+static int SHARED_POTENTIAL_RUNS; // Number of live runs using the TABULATED or EXPRESSION potential
+
+/* Structure to store the TABULATED and EXPRESSION potentials */
+struct shared_potentials {
+    tabulated_potential table;    // The table, with a copy of its coefficients
+    expression_program program;
+    double minima[MAX_WELLS];     // Minima of the MINIMA option
+    int nominima;                 // Number of minima given
+    well_layout layout;           // Wells of the formula
+};
+
+typedef struct shared_potentials shared_potentials;
+
+static shared_potentials SAVED_POTENTIALS; // Potentials before the input of the run being created was read
+static int RESTORE_POTENTIALS;             // Indicates that they are put back if the run is refused
+
+static void save_shared_potentials(shared_potentials *saved) {
+    saved->table = TABULATED_TABLE;
+    if (TABULATED_TABLE.coeffs != NULL) {
+        void *coeffs;
+        if (posix_memalign(&coeffs, 64, sizeof(double[4]) * TABULATED_TABLE.nointervals) != 0) {
+            printf("Failed to allocate table of %ld intervals\n", TABULATED_TABLE.nointervals);
+            exit(1);
+        }
+        memcpy(coeffs, TABULATED_TABLE.coeffs, sizeof(double[4]) * TABULATED_TABLE.nointervals);
+        saved->table.coeffs = coeffs;
+    }
+    saved->program = EXPRESSION_PROGRAM;
+    memcpy(saved->minima, EXPRESSION_MINIMA, sizeof(EXPRESSION_MINIMA));
+    saved->nominima = EXPRESSION_NOMINIMA;
+    saved->layout = EXPRESSION_LAYOUT;
+}
+
+// Puts back the potentials saved, dropping the table loaded since
+static void restore_shared_potentials(shared_potentials *saved) {
+    free(TABULATED_TABLE.coeffs);
+    TABULATED_TABLE = saved->table;
+    EXPRESSION_PROGRAM = saved->program;
+    memcpy(EXPRESSION_MINIMA, saved->minima, sizeof(EXPRESSION_MINIMA));
+    EXPRESSION_NOMINIMA = saved->nominima;
+    EXPRESSION_LAYOUT = saved->layout;
+}
+
+// Returns whether the table, formula or minima differ from those saved
+static int shared_potentials_changed(const shared_potentials *saved) {
+    return strcmp(saved->table.filename, TABULATED_TABLE.filename) != 0 || \
+           strcmp(saved->program.text, EXPRESSION_PROGRAM.text) != 0 || saved->nominima != EXPRESSION_NOMINIMA || \
+           memcmp(saved->minima, EXPRESSION_MINIMA, sizeof(double) * EXPRESSION_NOMINIMA) != 0;
+}
+
+// Returns whether any point of a sweep uses the TABULATED or EXPRESSION potential
+static int uses_shared_potential(const sweep *s) {
+    for (long point = 0; point < s->nopoints; point++) {
+        const char *name = s->points[point].potential_name;
+        if (strcmp(name, "TABULATED") == 0 || strcmp(name, "EXPRESSION") == 0) return 1;
+    }
+    return 0;
+}
+
+
+LS_API int ls_api_version(void) {
+    return LS_API_VERSION;
+}
+
+static ls_run *CREATING_RUN; // Run being created, freed if it is refused
+
+// Creates a run from the parameters read from an input stream
+static ls_run *create_run(FILE *input_file, uint64_t seed, int savebins) {
+    ls_run *run = calloc(1, sizeof(ls_run));
+    if (run == NULL) {
+        printf("Failed to allocate run\n");
+        exit(1);
+    }
+    CREATING_RUN = run;
+    parameters *params = &run->params;
+    if (SHARED_POTENTIAL_RUNS > 0) {
+        save_shared_potentials(&SAVED_POTENTIALS);
+        RESTORE_POTENTIALS = 1;
+    }
+    read_parameters(params, input_file);
+    if (RESTORE_POTENTIALS) {
+        if (shared_potentials_changed(&SAVED_POTENTIALS)) {
+            printf("A run cannot change the TABLE, EXPRESSION or MINIMA while another run uses them\n");
+            exit(1);
+        }
+        free(SAVED_POTENTIALS.table.coeffs);
+        RESTORE_POTENTIALS = 0;
+    }
+    if (params->exchange_steps > 0 || params->stream_decimation > 0 || params->checkpoint_steps > 0 || \
+        params->tolerance > 0 || params->dim > 1 || params->noparticles > 1) {
+        printf("Runs with tempering, streaming, checkpoints, a tolerance or configurations need the program\n");
+        exit(1);
+    }
+
+    init_sweep(&run->s, params);
+    run->shared_potential = uses_shared_potential(&run->s);
+    SHARED_POTENTIAL_RUNS += run->shared_potential;
+    if (savebins && run->s.nopoints > 1) {
+        printf("Bins can only be saved for a single parameter point\n");
+        exit(1);
+    }
+    run->seed = seed;
+    run->noreplicas = params->noreplicas;
+    run->notasks = run->s.nopoints * params->noreplicas;
+    run->nothreads = 1;
+#ifdef _OPENMP
+    run->nothreads = (params->nothreads > 0) ? params->nothreads : omp_get_max_threads();
+#endif
+
+    run->simulations = malloc(sizeof(SimulationFun) * run->s.nopoints);
+    run->progress = malloc(sizeof(replica_progress) * run->notasks);
+    run->differences = malloc(sizeof(double) * run->notasks);
+    run->steps = calloc(run->notasks, sizeof(long));
+    run->exact = malloc(sizeof(double) * MAX_WELLS * run->s.nopoints);
+    if (params->nowalkers > 1) {
+        run->ensembles = malloc(sizeof(ensemble) * run->notasks);
+    } else {
+        run->walkers = malloc(sizeof(walker) * run->notasks);
+    }
+    if (run->simulations == NULL || run->progress == NULL || run->differences == NULL || run->steps == NULL || \
+        run->exact == NULL || (run->ensembles == NULL && run->walkers == NULL)) {
+        printf("Failed to allocate run of %ld replicas\n", run->notasks);
+        exit(1);
+    }
+
+    exact_differences(&run->s, run->exact, run->nothreads); // Before the replicas, as it may refuse the run
+
+    for (long point = 0; point < run->s.nopoints; point++) {
+        run->simulations[point] = Simulation_selector(run->s.points[point].dynamics_type, \
+                                                      run->s.points[point].potential_name);
+    }
+    for (long task = 0; task < run->notasks; task++) {
+        long point = task / run->noreplicas;
+        uint64_t stream = ((uint64_t) point << 32) | (uint64_t) (task % run->noreplicas); // As in the program
+        parameters *point_params = &run->s.points[point];
+        init_replica_progress(&run->progress[task], point_params);
+        if (run->ensembles != NULL) {
+            init_ensemble(&run->ensembles[task], seed, stream, point_params);
+        } else {
+            init_walker(&run->walkers[task], seed, stream, point_params);
+            run->walkers[task].tap = NULL;
+        }
+        run->differences[task] = NAN;
+    }
+
+    if (savebins) {
+        run->bins = malloc(sizeof(histogram) * run->notasks);
+        if (run->bins == NULL) {
+            printf("Failed to allocate histograms\n");
+            exit(1);
+        }
+        for (long task = 0; task < run->notasks; task++) init_histogram(&run->bins[task], params);
+        init_histogram(&run->merged, params);
+    }
+    return run;
+}
+
+/*
+    Creates a run, or returns NULL with the message for ls_last_error if its input is refused. The replicas
+    are set up last, and only fail to allocate, so a refused run frees its arrays but not their contents.
+*/
+static ls_run *try_create_run(FILE *input_file, uint64_t seed, int savebins) {
+    jmp_buf jump;
+    LAST_ERROR[0] = '\0';
+    CREATING_RUN = NULL;
+    RESTORE_POTENTIALS = 0;
+    if (setjmp(jump) != 0) {
+        ERROR_JUMP = NULL;
+        size_t length = strlen(LAST_ERROR);
+        while (length > 0 && LAST_ERROR[length - 1] == '\n') LAST_ERROR[--length] = '\0';
+        if (RESTORE_POTENTIALS) restore_shared_potentials(&SAVED_POTENTIALS);
+        RESTORE_POTENTIALS = 0;
+        ls_run *run = CREATING_RUN;
+        if (run != NULL) {
+            SHARED_POTENTIAL_RUNS -= run->shared_potential;
+            free(run->simulations);
+            free(run->progress);
+            free(run->differences);
+            free(run->steps);
+            free(run->exact);
+            free(run->walkers);
+            free(run->ensembles);
+            free(run->s.points);
+            free(run);
+        }
+        return NULL;
+    }
+    ERROR_JUMP = &jump;
+    ls_run *run = create_run(input_file, seed, savebins);
+    ERROR_JUMP = NULL;
+    return run;
+}
+
+LS_API ls_run *ls_create(const char *input_text, uint64_t seed, int savebins) {
+    FILE *input_file = fmemopen((void *) input_text, strlen(input_text), "r");
+    if (input_file == NULL) {
+        snprintf(LAST_ERROR, sizeof(LAST_ERROR), "Failed to read input text");
+        return NULL;
+    }
+    ls_run *run = try_create_run(input_file, seed, savebins);
+    fclose(input_file);
+    return run;
+}
+
+LS_API ls_run *ls_create_from_file(const char *input_filename, uint64_t seed, int savebins) {
+    FILE *input_file = fopen(input_filename, "r");
+    if (input_file == NULL) {
+        snprintf(LAST_ERROR, sizeof(LAST_ERROR), "Failed to open input file %s", input_filename);
+        return NULL;
+    }
+    ls_run *run = try_create_run(input_file, seed, savebins);
+    fclose(input_file);
+    return run;
+}
+
+LS_API const char *ls_last_error(void) {
+    return LAST_ERROR;
+}
+
+LS_API void ls_free(ls_run *run) {
+    if (run == NULL) return;
+    SHARED_POTENTIAL_RUNS -= run->shared_potential;
+    for (long task = 0; task < run->notasks; task++) {
+        if (run->ensembles != NULL) {
+            free_ensemble(&run->ensembles[task]);
+        } else {
+            free_walker(&run->walkers[task]);
+        }
+        if (run->bins != NULL) free_histogram(&run->bins[task]);
+    }
+    if (run->bins != NULL) free_histogram(&run->merged);
+    free(run->bins);
+    free(run->walkers);
+    free(run->ensembles);
+    free(run->progress);
+    free(run->differences);
+    free(run->steps);
+    free(run->exact);
+    free(run->simulations);
+    free_sweep(&run->s);
+    free(run);
+}
+
+LS_API long ls_nopoints(const ls_run *run) {
+    return run->s.nopoints;
+}
+
+LS_API int ls_noreplicas(const ls_run *run) {
+    return run->noreplicas;
+}
+
+LS_API void ls_point(const ls_run *run, long point, ls_point_info *info) {
+    parameters *params = &run->s.points[point];
+    snprintf(info->potential_name, sizeof(info->potential_name), "%s", params->potential_name);
+    snprintf(info->dynamics_type, sizeof(info->dynamics_type), "%s", params->dynamics_type);
+    info->kT = params->kT;
+    info->step = *step_parameter(params);
+    info->tot_steps = params->tot_steps;
+}
+
+// Advances a replica by up to nosteps steps, running its burn-in first if it has one
+static void advance_task(ls_run *run, long task, long nosteps) {
+    replica_progress *progress = &run->progress[task];
+    if (progress->done) return;
+    long point = task / run->noreplicas;
+    parameters *params = &run->s.points[point];
+    walker *w = (run->walkers != NULL) ? &run->walkers[task] : NULL;
+    ensemble *e = (run->ensembles != NULL) ? &run->ensembles[task] : NULL;
+    histogram *bins = (run->bins != NULL) ? &run->bins[task] : NULL;
+    SimulationFun simulation = run->simulations[point];
+
+    if (params->adapt_steps > 0 && progress->burn_in == 0) burn_in_replica(simulation, bins, w, e, params, progress);
+    if (params->bias_steps > 0 && progress->burn_in == 0) build_bias(simulation, bins, w, params, progress);
+
+    long end = (nosteps < params->tot_steps - progress->stepno) ? progress->stepno + nosteps : params->tot_steps;
+    if (end > progress->stepno) {
+        advance_replica(simulation, bins, w, e, params, progress->stepno, end);
+        progress->stepno = end;
+    }
+
+    if (progress->stepno >= params->tot_steps) {
+        finish_replica(w, e, params, progress);
+        run->differences[task] = progress->result.energy_difference;
+    } else if (progress->stepno > ((progress->burn_in > 0) ? progress->burn_in : 1)) {
+        replica_progress current = *progress; // Finishing a copy gives the estimate so far
+        finish_replica(w, e, params, &current);
+        run->differences[task] = current.result.energy_difference;
+    } // Otherwise no sample has been taken since the burn-in, and the difference stays NAN
+    run->steps[task] = progress->stepno - 1; // Steps are numbered from 1
+}
+
+LS_API long ls_step(ls_run *run, long nosteps) {
+    long running = 0; // Number of replicas still running after the steps
+#pragma omp parallel for schedule(dynamic) num_threads(run->nothreads) reduction(+:running)
+    for (long task = 0; task < run->notasks; task++) {
+        advance_task(run, task, nosteps);
+        running += !run->progress[task].done;
+    }
+    if (run->bins != NULL) {
+        // Sums the histograms of every replica in place, so the merged counts keep their address
+        memset(run->merged.counts, 0, sizeof(long) * (run->merged.nobins + 2));
+        for (long task = 0; task < run->notasks; task++) histogram_merge(&run->merged, &run->bins[task]);
+    }
+    return running;
+}
+
+LS_API void ls_run_to_completion(ls_run *run) {
+    while (ls_step(run, run->params.tot_steps) > 0);
+}
+
+LS_API void ls_estimate(const ls_run *run, long point, double *mean, double *std_error) {
+    const double *differences = &run->differences[point * run->noreplicas];
+    double sum = 0, squares = 0;
+    for (int i = 0; i < run->noreplicas; i++) sum += differences[i];
+    *mean = sum / run->noreplicas;
+    for (int i = 0; i < run->noreplicas; i++) squares += (differences[i] - *mean) * (differences[i] - *mean);
+    *std_error = sqrt(squares) / run->noreplicas; // As in the program
+}
+
+LS_API double ls_exact_difference(const ls_run *run, long point, int well) {
+    if (well < 1 || well >= run->s.points[point].nowells) return NAN;
+    return run->exact[point * MAX_WELLS + well];
+}
+
+LS_API const double *ls_replica_differences(const ls_run *run) {
+    return run->differences;
+}
+
+LS_API const long *ls_replica_steps(const ls_run *run) {
+    return run->steps;
+}
+
+LS_API const long *ls_bins(const ls_run *run, long *nobins, double *x_min, double *x_max) {
+    if (run->bins == NULL) return NULL;
+    *nobins = run->merged.nobins;
+    *x_min = run->merged.x_min;
+    *x_max = run->merged.x_max;
+    return run->merged.counts;
+}
+
+LS_API void ls_potential(const ls_run *run, long point, const double *x, double *V, long n) {
+    PotentialFun Poten = run->s.points[point].Poten;
+    for (long i = 0; i < n; i++) V[i] = (*Poten)(x[i]);
+}
@@ -1,178 +1,305 @@
+#define _POSIX_C_SOURCE 200809L // For fsync and fileno in Checkpoint.h
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 #include <math.h>
 #include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "Parameters.h"
-#include "Dynamics.h"
-#include "mt19937ar.h"
-
-// Returns the x-position of a particle in space given its displacement from the current well minima
-double x_pos(double displacement, int well, parameters *params) {
-    return displacement + params->minima[well];
-}
-
-// Returns the displacement from the current well minima given its x position in space
-double well_dis(double x_position, int well, parameters *params) {
-    return x_position - params->minima[well];
-}
-
-// Attempts a lattice switch from a given position in a well
-double lattice_switch(double x, int *cur_well, parameters *params) {
-    double dis = well_dis(x, *cur_well, params); // Displacement from the current well
-    int oth_well = (*cur_well + 1) % 2; // Other well
-    double diff_poten = (*params->Poten_shifted)(x_pos(dis, oth_well, params)) - \
-        (*params->Poten_shifted)(x); // Difference in potential
-    // Attempts a Monte-Carlo lattice switch
-    if (genrand_real1() < min(1, exp(-diff_poten / params->kT))) {
-        *cur_well = oth_well;
-        x = x_pos(dis, *cur_well, params);
+#include "Walker.h"
+#include "Simulation.h"
+#include "Ensemble.h"
+#include "Histogram.h"
+#include "Scheduler.h"
+#include "Sweep.h"
+#include "Convergence.h"
+#include "Checkpoint.h"
+#include "ResultStore.h"
+#include "Tempering.h"
+#include "Configuration.h"
+#include "Extrapolation.h"
+#include "Distributed.h"
+#include "Replica.h"
+#include "Reference.h"
+
+// Writes the counters of every replica as a JSON array, listing the parameters of each replica's point
+void write_counters_json(sweep *s, replica_result *results, char *filename) {
+    FILE *counters_file = fopen(filename, "w");
+    if (counters_file == NULL) {
+        printf("Failed to open counters file %s\n", filename);
+        exit(1);
     }
-    return x;
-}
-
-void add_to_bins(double x, long *bins, parameters *params) {
-    if (x < params->x_min) {
-        bins[0]++;
-    } else if (x > params->x_max) {
-        bins[params->nobins - 1]++;
-    } else {
-        for (long j = 1; j <= params->nobins; j++) {
-            if (x < params->x_min + j * params->bin_width) {
-                bins[j - 1]++;
-                break;
-            }
+    fprintf(counters_file, "[\n");
+    long task = 0;
+    for (long point = 0; point < s->nopoints; point++) {
+        parameters *params = &s->points[point];
+        for (int replica = 0; replica < params->noreplicas; replica++, task++) {
+            fprintf(counters_file, "  {\"point\": %ld, \"replica\": %d, \"potential\": \"%s\", \"dynamics\": \"%s\", " \
+                    "\"kT\": %.17g, \"step\": %.17g, \"switch_regularity\": %d, \"steps\": %ld, ", point, replica, \
+                    params->potential_name, params->dynamics_type, params->kT, *step_parameter(params), \
+                    params->switch_regularity, results[task].steps);
+            fprint_counters_json(counters_file, &results[task].count);
+            fprintf(counters_file, "}%s\n", (task + 1 < s->nopoints * params->noreplicas) ? "," : "");
         }
     }
+    fprintf(counters_file, "]\n");
+    fclose(counters_file);
 }
 
+int main(int argc, char **argv) {
+    distributed d; // Ranks sharing the tasks, a single one without MPI
+    init_distributed(&d, &argc, &argv);
 
+    char *input_filename = argv[1]; // Name of the parameter input file
+    char *datastore_filename = argv[2]; // Name of the file to store final calculated data
+    char *bins_filename = argv[3]; // Name of the bin output file
+    char *seed_str = argv[4]; // Seed of the simulation
+    int restart = (argc > 5 && strcmp(argv[5], "RESTART") == 0); // Resumes the replicas from their checkpoints
 
-// Calculates the free energy different between states in the two wells of a given potential function
-double calc_energy_difference(int savebins, char *bins_filename, parameters *params) {
-    double x = x_pos(0, params->start_well, params); // x-position initially at the bottom of the starting well
-    long no_left = 0; // Number of timesteps that the particle is in the left well
-    int cur_well = params->start_well; // Indicates which well the particle is in (0 is left well, 1 is right well)
+    char *ptr;
+    uint64_t seed = (uint64_t) strtoull(seed_str, &ptr, 10);
 
-    long *bins; // Array for storing amount of times the walker has visited each bin
+    // ///////////////////////////////
+    // CHANGE WHEN ACTUALLY SIMULATING
+//    seed = (unsigned long) time(NULL);
+    // ///////////////////////////////
 
-    if (savebins) {
-        bins = malloc(sizeof(long) * (params->nobins)); // Array to store number of times each bin has been visited
-        for (long j = 0; j < params->nobins; j++) bins[j] = 0;
+    int savebins = 1; // Variable for indicating if the data for bins will be saved or not
+    if (strcmp(bins_filename, "NOBINS") == 0) savebins = 0;
 
-        // Removes existing bin files
-        remove(bins_filename);
-    }
 
-    DynamicsFun DynFun = Dynamics_selector(params->dynamics_type); // Returns the desired dynamics function
+    parameters params; // Struct for storing parameters
+    store_parameters(&params, input_filename); // Fills the parameters struct with data from input file
 
-    if (strcmp(params->dynamics_type, "BAOAB_LIMIT") == 0) {
-        // Generates normally distributed values for R, which stores the current value and the value at the next timestep
-        params->R[0] = box_muller_rand();
-        params->R[1] = box_muller_rand();
+    sweep s; // Parameter points to run, a single point unless sweep options are given
+    init_sweep(&s, &params);
+    if (params.binary_store) check_store_names(s.points, s.nopoints);
+    if (savebins && s.nopoints > 1) {
+        printf("Bins can only be saved for a single parameter point\n");
+        exit(1);
     }
 
+    int noreplicas = params.noreplicas;
+    long notasks = s.nopoints * noreplicas; // Every replica of every point is a separate task
+
+    // Zeroed, since with MPI each rank only fills the results and histograms of the tasks it runs
+    replica_result *results = calloc(notasks, sizeof(replica_result)); // Results of each task
+    histogram *bins = calloc(noreplicas, sizeof(histogram)); // Histogram filled by each replica
+    histogram_2d *bins_2d = calloc(noreplicas, sizeof(histogram_2d)); // 2-D histogram filled by each replica
+    int savebins_2d = savebins && params.noybins > 0; // Whether a 2-D histogram is also saved
+    // Walkers made of several particles, or in several dimensions, are run as configurations
+    int configurations = (params.dim > 1 || params.noparticles > 1);
+    SimulationFun *simulations = malloc(sizeof(SimulationFun) * s.nopoints); // Simulation for each point
+    for (long point = 0; point < s.nopoints; point++) {
+        simulations[point] = Simulation_selector(s.points[point].dynamics_type, s.points[point].potential_name);
+    }
 
-    // Perform lattice switching method
-    for (long stepno = 1; stepno < params->tot_steps; stepno++) {
-
-        if (savebins) add_to_bins(x, bins, params);
-
-        if (cur_well == 0) {
-            // Indicates that the particle was in the left well
-            no_left++;
-        }
-
-        if (isnan(x) || (x == INFINITY) || (x == -INFINITY)) {
-            printf("Infinite x value reached\n");
+    int nothreads = 1;
+#ifdef _OPENMP
+    nothreads = (params.nothreads > 0) ? params.nothreads : omp_get_max_threads();
+#endif
+    // With parallel tempering, every replica of every ladder of temperatures is a task instead
+    int tempering = (params.exchange_steps > 0);
+    long noscheduled = tempering ? s.nopotentials * s.nosteps * noreplicas : notasks; // Number of tasks to schedule
+    scheduler sched; // Work-stealing scheduler for the tasks
+    init_scheduler(&sched, noscheduled, nothreads);
+    open_task_counter(&d, noscheduled);
+
+    // Trajectories are streamed by a background writer, with a ring of events for each thread
+    stream_writer writer;
+    char stream_filename[1100]; // Name of the stream file
+    if (params.stream_decimation > 0) {
+        snprintf(stream_filename, sizeof(stream_filename), "%s.stream", datastore_filename);
+        if (d.size > 1) {
+            // Every rank writes a stream of its own
+            snprintf(stream_filename, sizeof(stream_filename), "%s.stream.%d", datastore_filename, d.rank);
         }
+        init_stream_writer(&writer, stream_filename, nothreads, &params, restart);
+    }
 
-        // Perform dynamics step
-        x = (*DynFun)(x, params);
+    // Runs the tasks concurrently, each with its own walker, random stream and histogram
+#pragma omp parallel num_threads(nothreads)
+    {
+        int thread = 0;
+#ifdef _OPENMP
+        thread = omp_get_thread_num();
+#endif
+        long task;
+        while (distributed_next(&d, &sched, thread, &task)) {
+            if (tempering) {
+                long ladder_index = task / noreplicas;
+                run_ladder(&s, simulations, results, ladder_index / s.nosteps, ladder_index % s.nosteps, \
+                           (int) (task % noreplicas), seed);
+                continue;
+            }
 
-        // Recalibrate the wells if a particle has managed to cross over the barrier
-        if ((cur_well == 0) && (x > 0)) {
-            cur_well = 1;
-        } else if ((cur_well == 1) && (x < 0)) {
-            cur_well = 0;
-        }
+            long point = task / noreplicas;
+            int replica = (int) (task % noreplicas);
+            uint64_t stream = ((uint64_t) point << 32) | (uint64_t) replica; // Independent stream for every task
 
+            histogram *replica_bins = NULL;
+            if (savebins) {
+                replica_bins = &bins[replica];
+                init_histogram(replica_bins, &params);
+            }
+            histogram_2d *replica_bins_2d = NULL;
+            if (savebins_2d) {
+                replica_bins_2d = &bins_2d[replica];
+                init_histogram_2d(replica_bins_2d, &params);
+            }
+            if (configurations) {
+                ConfigurationFun simulation = Configuration_selector(s.points[point].dynamics_type, \
+                                                                     s.points[point].potential_name);
+                results[task] = run_configuration(simulation, replica_bins, replica_bins_2d, seed, stream, \
+                                                  &s.points[point]);
+                continue;
+            }
 
-        // Attempts a lattice switch
-        if (stepno % params->switch_regularity == 0) {
-            x = lattice_switch(x, &cur_well, params);
+            checkpoint ckpt; // Checkpoint of this task
+            checkpoint *task_ckpt = NULL;
+            if (params.checkpoint_steps > 0) {
+                task_ckpt = &ckpt;
+                init_checkpoint(task_ckpt, datastore_filename, task, seed, stream, replica_bins, &s.points[point]);
+            }
+            stream_tap tap = {NULL, (int) task, params.stream_decimation}; // Where this task streams its trajectory
+            if (params.stream_decimation > 0) tap.ring = &writer.rings[thread];
+            results[task] = run_replica(simulations[point], replica_bins, seed, stream, &s.points[point], \
+                                        task_ckpt, restart && task_ckpt != NULL, \
+                                        (params.stream_decimation > 0) ? &tap : NULL);
         }
     }
+    if (params.stream_decimation > 0) stop_stream_writer(&writer);
+    close_task_counter(&d);
+    free_scheduler(&sched);
+    free(simulations);
+    gather_results(&d, results, notasks);
 
     if (savebins) {
-        FILE *bins_file = fopen(bins_filename, "w"); // Data file to store bin data
-        for (long j = 1; j <= params->nobins; j++) {
-            // Fills data file with bin positions and how many hits they have
-            double bin_x_pos = params->x_min + j * params->bin_width;
-            fprintf(bins_file, "%g, %ld\n", bin_x_pos, bins[j - 1]);
+        // Merges the histograms of every replica into the first one, and those of every rank into rank 0
+        for (int i = 0; i < noreplicas; i++) {
+            if (bins[i].counts == NULL) init_histogram(&bins[i], &params); // Run by another rank
+        }
+        for (int i = 1; i < noreplicas; i++) {
+            histogram_merge(&bins[0], &bins[i]);
+            free_histogram(&bins[i]);
         }
-        fclose(bins_file);
+        reduce_counts(&d, bins[0].counts, bins[0].nobins + 2);
+        // A binary store holds the histogram in its record instead
+        if (d.rank == 0 && !params.binary_store) {
+            write_histogram(&bins[0], 1, bins_filename);
+            if (params.coarsen > 1) {
+                char coarse_filename[1024]; // Name of the file for the coarse histogram
+                snprintf(coarse_filename, sizeof(coarse_filename), "%s_coarse", bins_filename);
+                write_histogram(&bins[0], params.coarsen, coarse_filename);
+            }
+        }
+    }
+    if (savebins_2d) {
+        for (int i = 0; i < noreplicas; i++) {
+            if (bins_2d[i].counts == NULL) init_histogram_2d(&bins_2d[i], &params); // Run by another rank
+        }
+        for (int i = 1; i < noreplicas; i++) {
+            histogram_2d_merge(&bins_2d[0], &bins_2d[i]);
+            free_histogram_2d(&bins_2d[i]);
+        }
+        reduce_counts(&d, bins_2d[0].counts, (bins_2d[0].x_axis.nobins + 2) * (bins_2d[0].y_axis.nobins + 2));
+        if (d.rank == 0) {
+            char bins_2d_filename[1024]; // Name of the file for the 2-D histogram
+            snprintf(bins_2d_filename, sizeof(bins_2d_filename), "%s_2d", bins_filename);
+            write_histogram_2d(&bins_2d[0], bins_2d_filename);
+        }
+        free_histogram_2d(&bins_2d[0]);
+    }
+    free(bins_2d);
 
+    if (d.rank != 0) {
+        // Only rank 0 writes the results
+        if (savebins) free_histogram(&bins[0]);
         free(bins);
+        free(results);
+        free_sweep(&s);
+        finalize_distributed();
+        return 0;
     }
 
-    return -params->kT * log((double) (no_left) / (params->tot_steps - no_left)) + params->shift_value;
-}
-
-int main(int argc, char **argv) {
-    char *input_filename = argv[1]; // Name of the parameter input file
-    char *datastore_filename = argv[2]; // Name of the file to store final calculated data
-    char *bins_filename = argv[3]; // Name of the bin output file
-    char *seed_str = argv[4]; // Seed of the simulation
-
-    char *ptr;
-    unsigned long seed = (unsigned long) strtol(seed_str, &ptr, 10);
-
-    // ///////////////////////////////
-    // CHANGE WHEN ACTUALLY SIMULATING
-//    seed = (unsigned long) time(NULL);
-    // ///////////////////////////////
-
-    int savebins = 1; // Variable for indicating if the data for bins will be saved or not
-    if (strcmp(bins_filename, "NOBINS") == 0) savebins = 0;
-
-
-    init_genrand(seed); // Seeds the random number generators
-
-    parameters params; // Struct for storing parameters
-    store_parameters(&params, input_filename); // Fills the parameters struct with data from input file
+    double *means = malloc(sizeof(double) * s.nopoints); // Mean estimate of each point
+    double *std_errors = malloc(sizeof(double) * s.nopoints); // Standard error of each point
+    long *steps = malloc(sizeof(long) * s.nopoints); // Number of steps of each point, summed over the replicas
+
+    // Sums in replica order so that the results do not depend on the number of threads
+    for (long point = 0; point < s.nopoints; point++) {
+        replica_result *point_results = &results[point * noreplicas];
+        double mean_energy_diff = 0;
+        double std_error = 0;
+        steps[point] = 0;
+        for (int i = 0; i < noreplicas; i++) {
+            mean_energy_diff += point_results[i].energy_difference;
+            steps[point] += point_results[i].steps;
+        }
+        mean_energy_diff /= noreplicas;
+        for (int i = 0; i < noreplicas; i++) {
+            double diff = point_results[i].energy_difference - mean_energy_diff;
+            std_error += diff * diff;
+        }
+        means[point] = mean_energy_diff;
+        std_errors[point] = sqrt(std_error) / noreplicas;
+    }
 
-    double mean_energy_diff = 0;
-    double std_error = 0;
+    // Exact differences of every point, written next to the estimates
+    double *exact = malloc(sizeof(double) * MAX_WELLS * s.nopoints);
+    if (means == NULL || std_errors == NULL || steps == NULL || exact == NULL) {
+        printf("Failed to allocate the results of %ld points\n", s.nopoints);
+        exit(1);
+    }
+    exact_differences(&s, exact, nothreads);
 
-    double *energy_differences = malloc(sizeof(double) * 10);
+    if (COUNTERS) {
+        char counters_filename[1100]; // Name of the file for the counters of every replica
+        snprintf(counters_filename, sizeof(counters_filename), "%s.counters.json", datastore_filename);
+        write_counters_json(&s, results, counters_filename);
+    }
 
-    // Runs the procedure 10 times to calculate an average
-    for (int i = 0; i < 9; i++) {
-        energy_differences[i] = calc_energy_difference(0, bins_filename, &params); // Runs the lattice switch procedure to create data in file
-        mean_energy_diff += energy_differences[i];
+    if (params.binary_store) {
+        // Appends one record for every point, with the histogram if bins are saved
+        write_store_records(s.points, s.nopoints, seed, results, means, std_errors, steps, exact, \
+                            savebins ? &bins[0] : NULL, datastore_filename);
+    } else if (s.nopoints == 1) {
+        // Appends the data file with the mean and standard error, also listing the parameters associated with the run
+        FILE *datastore_file = fopen(datastore_filename, "a");
+        fprint_result(datastore_file, &s.points[0], means[0], std_errors[0], steps[0], results, exact);
+        fclose(datastore_file);
+    } else {
+        // Writes one table of every point of the sweep
+        write_sweep_table(&s, means, std_errors, steps, results, exact, datastore_filename);
+    }
+    if (params.extrapolate[0] != '\0') {
+        // Writes the differences of every potential and kT extrapolated to zero timestep
+        char extrapolation_filename[1100]; // Name of the file for the extrapolated differences
+        snprintf(extrapolation_filename, sizeof(extrapolation_filename), "%s.extrapolated", datastore_filename);
+        write_extrapolation_table(&s, means, std_errors, exact, extrapolation_filename);
     }
 
-    energy_differences[9] = calc_energy_difference(savebins, bins_filename, &params); // Runs the lattice switch procedure to create data in file
+    if (savebins) free_histogram(&bins[0]);
+    free(bins);
+    free(results);
 
-    mean_energy_diff += energy_differences[9];
-    mean_energy_diff /= 10;
-    for (int i = 0; i < 10; i++) {
-        std_error += (energy_differences[i] - mean_energy_diff) * (energy_differences[i] - mean_energy_diff);
-    }
-    std_error = sqrt(std_error) / 10;
-    free(energy_differences);
-
-    FILE *datastore_file = fopen(datastore_filename, "a");
-    // Appends the data file with the mean and standard error, also listing the parameters associated with the run
-    if (strcmp(params.dynamics_type, "BAOAB_LIMIT") == 0) {
-        fprintf(datastore_file, "%s, %s, %ld, %lf, %lf, %g, %g\n", params.potential_name, params.dynamics_type,
-                params.tot_steps, params.timestep, params.kT, mean_energy_diff, std_error);
-    } else if (strcmp(params.dynamics_type, "MONTE-CARLO") == 0) {
-        fprintf(datastore_file, "%s, %s, %ld, %lf, %lf, %g, %g\n", params.potential_name, params.dynamics_type,
-                params.tot_steps, params.jump_size, params.kT, mean_energy_diff, std_error);
+    // The results are stored, so the checkpoints are no longer needed
+    if (params.checkpoint_steps > 0) {
+        for (long task = 0; task < notasks; task++) {
+            char checkpoint_filename[1100]; // Name of the checkpoint file of the task
+            snprintf(checkpoint_filename, sizeof(checkpoint_filename), "%s.ckpt.%ld", datastore_filename, task);
+            remove(checkpoint_filename);
+        }
     }
 
-    fclose(datastore_file);
+    free(means);
+    free(std_errors);
+    free(steps);
+    free(exact);
+    free_sweep(&s);
+    finalize_distributed();
     return 0;
-}
\ No newline at end of file
+}